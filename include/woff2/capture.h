@@ -0,0 +1,74 @@
+/* Copyright 2026 Google Inc. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Opt-in capture of slow conversions, so they can be replayed later. */
+
+#ifndef WOFF2_WOFF2_CAPTURE_H_
+#define WOFF2_WOFF2_CAPTURE_H_
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <string>
+#include <woff2/decode.h>
+#include <woff2/encode.h>
+#include <woff2/output.h>
+
+namespace woff2 {
+
+struct WOFF2CaptureOptions {
+  WOFF2CaptureOptions() : latency_threshold_ms(0), memory_threshold_kb(0) {}
+
+  // Existing directory captured inputs are written to. Nothing is captured
+  // if empty.
+  std::string directory;
+  // Capture conversions that take longer than this; 0 disables the check.
+  double latency_threshold_ms;
+  // Capture conversions that raise the process' peak resident set size by
+  // more than this; 0 disables the check. Only a new peak is visible, so
+  // this is a lower bound on what the conversion used. Not supported on
+  // Windows.
+  size_t memory_threshold_kb;
+};
+
+// Describes a captured conversion; written next to the input as
+// <hash>.capture, where <hash> is the FNV-1a hash of the input in hex.
+struct WOFF2CaptureRecord {
+  WOFF2CaptureRecord()
+      : encode(false), input_length(0), input_hash(0), elapsed_ms(0),
+        memory_growth_kb(0), succeeded(false) {}
+
+  bool encode;  // ConvertTTFToWOFF2 if true, else ConvertWOFF2ToTTF
+  std::string input_path;
+  size_t input_length;
+  uint64_t input_hash;
+  double elapsed_ms;
+  size_t memory_growth_kb;
+  bool succeeded;
+  WOFF2Params params;  // encode only
+  WOFF2DecodeParams decode_params;  // decode only
+};
+
+// Same as ConvertTTFToWOFF2, but captures the input if the conversion exceeds
+// one of the thresholds. Capturing never changes the result.
+bool ConvertTTFToWOFF2WithCapture(const uint8_t *data, size_t length,
+                                  uint8_t *result, size_t *result_length,
+                                  const WOFF2Params& params,
+                                  const WOFF2CaptureOptions& options);
+
+// Same as ConvertWOFF2ToTTF, but captures the input if the conversion exceeds
+// one of the thresholds. Capturing never changes the result.
+bool ConvertWOFF2ToTTFWithCapture(const uint8_t *data, size_t length,
+                                  WOFF2Out* out,
+                                  const WOFF2DecodeParams& params,
+                                  const WOFF2CaptureOptions& options);
+
+// Reads a .capture file. Returns false if it can't be read or parsed.
+bool ReadWOFF2CaptureRecord(const std::string& path,
+                            WOFF2CaptureRecord* record);
+
+} // namespace woff2
+
+#endif  // WOFF2_WOFF2_CAPTURE_H_
@@ -11,10 +11,99 @@
 
 #include <stddef.h>
 #include <inttypes.h>
+#include <vector>
+#include <woff2/error.h>
 #include <woff2/output.h>
+#include <woff2/phase.h>
 
 namespace woff2 {
 
+// Facts about a font's glyf and loca tables, established while they are
+// rebuilt from their transformed form, so that a sanitizer run afterwards
+// need not parse glyf again. Only meaningful if verified is set; an
+// untransformed glyf table is copied without being looked at.
+struct WOFF2GlyfFacts {
+  bool verified;
+  uint16_t num_glyphs;
+  // Maxima over simple glyphs. Contour end points increase and point counts
+  // agree with them by construction. Kept wide so that values beyond what
+  // maxp can hold show up as inconsistent rather than wrapping.
+  uint32_t max_points;
+  uint16_t max_contours;
+  // Maximum instruction length over all glyphs.
+  uint32_t max_size_of_instructions;
+  // Maxima over composite glyphs, with components expanded down to simple
+  // glyphs, as defined for maxp.
+  uint32_t max_composite_points;
+  uint32_t max_composite_contours;
+  uint16_t max_component_elements;
+  uint16_t max_component_depth;
+  // Every component refers to a glyph id below num_glyphs.
+  bool component_ids_in_range;
+  // No composite glyph contains itself, directly or through other composites.
+  bool components_acyclic;
+  // Bounding boxes stored for simple glyphs match their points.
+  bool bboxes_match_points;
+  // loca offsets never decrease and all fit the loca format.
+  bool loca_monotonic;
+  // maxp numGlyphs equals num_glyphs and, for version 1.0 maxp, none of the
+  // maxima above exceeds the corresponding maxp field.
+  bool maxp_consistent;
+};
+
+struct WOFF2DecodeParams {
+  WOFF2DecodeParams()
+      : glyf_facts(NULL), skip_checksums(false), allow_gvar_transform(false),
+        allow_multi_stream(false), num_threads(1), phase_observer(NULL),
+        error(NULL) {}
+
+  // If set, receives one WOFF2GlyfFacts per font (one for a plain font, one
+  // per member of a collection). Costs a little extra work while decoding.
+  std::vector<WOFF2GlyfFacts>* glyf_facts;
+
+  // If set, no checksums are computed: the table directory checksums and
+  // head.checkSumAdjustment are left 0, which is NOT valid, so the font must
+  // not be handed to anything that checks them or stored. Everything else is
+  // validated as usual. Saves a pass over the output.
+  bool skip_checksums;
+
+  // If not empty, each font's tables are laid out in this order of tags, and
+  // tables whose tag isn't listed follow in their usual order. The table
+  // directory stays sorted by tag, so the result is a valid font either way.
+  // See LoadOrderTableTags().
+  std::vector<uint32_t> table_order;
+
+  // Accept gvar tables in our private transform, see
+  // WOFF2Params::transform_gvar. No other decoder reads them, so leave this
+  // off for fonts from untrusted sources; they are rejected then.
+  bool allow_gvar_transform;
+
+  // Accept files in our private multi-stream variant, see
+  // WOFF2Params::num_streams. Like allow_gvar_transform, leave this off for
+  // fonts from untrusted sources.
+  bool allow_multi_stream;
+
+  // Threads to decompress the streams of a file in our private multi-stream
+  // variant with. The default, 1, decompresses them on the calling thread;
+  // 0 means one per stream, up to the number of cores. Standard WOFF2 has a
+  // single stream, which is always decompressed on the calling thread.
+  int num_threads;
+
+  // If set, told when each phase of the conversion begins and ends.
+  WOFF2PhaseObserver* phase_observer;
+
+  // If set, receives the reason when the conversion fails. Left untouched
+  // when it succeeds. Telling a full output apart from a bad input means
+  // watching the writes, which costs one more call per write to out.
+  WOFF2Error* error;
+};
+
+// A table_order that puts the tables a renderer reads when it opens a font
+// first, the small metrics and layout tables, then loca and glyf, which are
+// read a glyph at a time. Fonts that are mmapped then fault in fewer pages on
+// load.
+std::vector<uint32_t> LoadOrderTableTags();
+
 // Compute the size of the final uncompressed font, or 0 on error.
 size_t ComputeWOFF2FinalSize(const uint8_t *data, size_t length);
 
@@ -30,6 +119,8 @@ bool ConvertWOFF2ToTTF(uint8_t *result, size_t result_length,
 // Please prefer this API.
 bool ConvertWOFF2ToTTF(const uint8_t *data, size_t length,
                        WOFF2Out* out);
+bool ConvertWOFF2ToTTF(const uint8_t *data, size_t length,
+                       WOFF2Out* out, const WOFF2DecodeParams& params);
 
 } // namespace woff2
 
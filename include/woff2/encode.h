@@ -11,17 +11,102 @@
 
 #include <stddef.h>
 #include <inttypes.h>
+#include <memory>
 #include <string>
+#include <vector>
+#include <woff2/error.h>
+#include <woff2/phase.h>
 
 namespace woff2 {
 
+// What the encoder settled on, see WOFF2Params::info.
+struct WOFF2EncodeInfo {
+  WOFF2EncodeInfo()
+      : brotli_quality(0), brotli_window(0), brotli_peak_memory(0),
+        content_total_bytes(0), content_compressible_bytes(0),
+        content_lowered(false) {}
+
+  // Brotli quality and window the table data was compressed with, which
+  // memory_limit or adapt_to_content may have lowered from the requested
+  // ones.
+  int brotli_quality;
+  int brotli_window;
+  // With memory_limit, the most memory the Brotli encoder held at once;
+  // otherwise 0.
+  size_t brotli_peak_memory;
+  // With adapt_to_content, the bytes of table data, and how many of them the
+  // samples suggest still compress; otherwise 0. content_lowered says
+  // whether that was few enough to lower the quality and window.
+  size_t content_total_bytes;
+  size_t content_compressible_bytes;
+  bool content_lowered;
+};
+
 struct WOFF2Params {
   WOFF2Params() : extended_metadata(""), brotli_quality(11),
-                  allow_transforms(true) {}
+                  allow_transforms(true), memory_limit(0),
+                  adapt_to_content(false), transform_gvar(false),
+                  desubroutinize_cff(false), verify(false),
+                  num_streams(1), num_threads(0), phase_observer(NULL),
+                  error(NULL), info(NULL) {}
 
   std::string extended_metadata;
   int brotli_quality;
   bool allow_transforms;
+  // Approximate ceiling, in bytes, on the memory the encoder uses in addition
+  // to the input and result buffers. When set, table data is streamed into
+  // the compressor without intermediate copies, buffers are released as soon
+  // as they are consumed, and the Brotli window (and if need be, quality) is
+  // reduced until the compressor's estimated footprint fits. The tables that
+  // normalizing and transforming hold count against the limit too: the
+  // conversion fails with kWOFF2ErrorLimitExceeded before they are made if
+  // an estimate from the input table sizes exceeds it, and afterwards if
+  // they did, or if the smallest Brotli configuration doesn't fit what is
+  // left; see WOFF2EncodeInfo for the settings that were used. Can't be
+  // combined with desubroutinize_cff, whose memory use isn't bounded. With
+  // WOFF2OutlineEncoder, the glyphs are held before the limit applies. 0
+  // means no limit.
+  size_t memory_limit;
+  // Sample the tables before compressing and, when almost all of the data is
+  // already compressed (PNG or gzip payloads in CBDT, sbix or SVG tables, or
+  // other high entropy content), lower the Brotli quality and window since
+  // the slow settings would gain next to nothing.
+  bool adapt_to_content;
+  // Apply our private gvar transform. This is NOT part of the WOFF2 spec:
+  // only this library's decoder can read the result, and only with
+  // WOFF2DecodeParams::allow_gvar_transform set, so use it only where both
+  // ends are under your control. Has no effect unless allow_transforms.
+  bool transform_gvar;
+  // Expand the subroutine calls of CFF and CFF2 charstrings and drop the
+  // subroutines, which Brotli compresses better. Rendering is unchanged, but
+  // the decoded font is no longer identical to the input. A table is kept as
+  // is when the rewritten one doesn't compress to fewer bytes.
+  bool desubroutinize_cff;
+  // Decode the result before returning it, keeping only the table directory,
+  // and fail unless every table decodes to the length and checksum of the
+  // normalized input. Costs about as much as decoding, without the output
+  // buffer.
+  bool verify;
+  // Compress the table data as up to this many independent Brotli streams,
+  // which the decoder can decompress in parallel, in our private multi-stream
+  // variant of WOFF2. This is NOT part of the WOFF2 spec: only this library's
+  // decoder can read the result, and only with
+  // WOFF2DecodeParams::allow_multi_stream set, so use it only where both
+  // ends are under your control. Streams are cut at table and glyf substream
+  // boundaries where possible and hold at least 64 KB each, so small fonts
+  // still get standard WOFF2. 1 always gives standard WOFF2. Ignored with
+  // memory_limit, which compresses in one stream.
+  int num_streams;
+  // Threads to compress the streams with; 0 means one per stream, up to the
+  // number of cores.
+  int num_threads;
+  // If set, told when each phase of the conversion begins and ends.
+  WOFF2PhaseObserver* phase_observer;
+  // If set, receives the reason when the conversion fails. Left untouched
+  // when it succeeds.
+  WOFF2Error* error;
+  // If set, filled in when the conversion succeeds.
+  WOFF2EncodeInfo* info;
 };
 
 // Returns an upper bound on the size of the compressed file.
@@ -38,6 +123,78 @@ bool ConvertTTFToWOFF2(const uint8_t *data, size_t length,
                        uint8_t *result, size_t *result_length,
                        const WOFF2Params& params);
 
+// A point of a simple glyph's contour, in font units.
+struct WOFF2OutlinePoint {
+  int x;
+  int y;
+  bool on_curve;
+};
+
+// A component of a composite glyph, with the fields of a glyf component
+// record. The encoder sets the MORE_COMPONENTS and WE_HAVE_INSTRUCTIONS flags;
+// the other flags select how the arguments and transform are stored.
+struct WOFF2OutlineComponent {
+  uint16_t flags;
+  uint16_t glyph_index;
+  int argument1;
+  int argument2;
+  // F2Dot14 scale, x and y scales, or 2x2 matrix, as the flags say.
+  int16_t transform[4];
+};
+
+// A glyph as it would be stored in the glyf table: either contours or
+// components, or neither for an empty glyph.
+struct WOFF2OutlineGlyph {
+  WOFF2OutlineGlyph()
+      : x_min(0), y_min(0), x_max(0), y_max(0), overlap_simple(false) {}
+
+  std::vector<std::vector<WOFF2OutlinePoint> > contours;
+  std::vector<WOFF2OutlineComponent> components;
+  std::vector<uint8_t> instructions;
+  int16_t x_min;
+  int16_t y_min;
+  int16_t x_max;
+  int16_t y_max;
+  // OVERLAP_SIMPLE flag of the first point.
+  bool overlap_simple;
+};
+
+// Compresses a TrueType font from glyph outlines and raw tables, without
+// building glyf and loca first: each glyph goes straight into the transformed
+// glyf table. Decoding gives the font whose glyf and loca tables hold the
+// glyphs in normalized form, as ConvertTTFToWOFF2() would for that font. The
+// glyf table is always transformed, so WOFF2Params::allow_transforms must be
+// set.
+class WOFF2OutlineEncoder {
+ public:
+  explicit WOFF2OutlineEncoder(int num_glyphs);
+  ~WOFF2OutlineEncoder();
+
+  // Adds a table, copying its data. glyf and loca are made from the glyphs,
+  // and DSIG is dropped, like ConvertTTFToWOFF2() does. head, hhea, hmtx and
+  // maxp are required.
+  bool AddTable(uint32_t tag, const uint8_t* data, size_t length);
+
+  // Adds the next glyph, in glyph id order.
+  bool AddGlyph(const WOFF2OutlineGlyph& glyph);
+
+  // Upper bound on the compressed size, once all glyphs have been added.
+  size_t MaxCompressedSize(const std::string& extended_metadata) const;
+
+  // Compresses the font into the target buffer, as ConvertTTFToWOFF2() does.
+  // All num_glyphs glyphs must have been added, and params.allow_transforms
+  // must be set. The encoder can't be used any further afterwards.
+  bool Finish(uint8_t* result, size_t* result_length,
+              const WOFF2Params& params);
+
+ private:
+  WOFF2OutlineEncoder(const WOFF2OutlineEncoder&);
+  void operator=(const WOFF2OutlineEncoder&);
+
+  struct State;
+  std::unique_ptr<State> state_;
+};
+
 } // namespace woff2
 
 #endif  // WOFF2_WOFF2_ENC_H_
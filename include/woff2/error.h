@@ -0,0 +1,59 @@
+/* Copyright 2026 Google Inc. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Why a conversion failed, for callers that decide whether to retry. */
+
+#ifndef WOFF2_WOFF2_ERROR_H_
+#define WOFF2_WOFF2_ERROR_H_
+
+#include <stddef.h>
+#include <inttypes.h>
+
+namespace woff2 {
+
+enum WOFF2ErrorCode {
+  kWOFF2ErrorNone,
+  // The input is malformed. Converting it again can't succeed.
+  kWOFF2ErrorInvalidInput,
+  // The result didn't fit the result buffer or the WOFF2Out. Converting
+  // again with more room can succeed.
+  kWOFF2ErrorOutputTooSmall,
+  // The input is well formed, but exceeds a limit meant to catch hostile
+  // inputs, such as an implausible compression ratio. Converting it again
+  // can't succeed.
+  kWOFF2ErrorLimitExceeded,
+  // A bug: e.g. verifying the encoded result failed, or Brotli failed to
+  // compress. Also reported when a WOFF2Out refuses a write it has room for.
+  kWOFF2ErrorInternal,
+};
+
+// Filled in when a conversion fails; see WOFF2Params::error and
+// WOFF2DecodeParams::error.
+struct WOFF2Error {
+  WOFF2Error() : code(kWOFF2ErrorNone), table_tag(0), offset(0) {}
+
+  WOFF2ErrorCode code;
+  // Tag of the table that was being converted, 0 if none was.
+  uint32_t table_tag;
+  // Where the offending data is, when decoding: the offset in the input of
+  // the header or directory field that was being read, or, with table_tag
+  // set, the offset of the table in the decompressed table data. 0 when
+  // unknown, and always when encoding.
+  size_t offset;
+};
+
+// Short description of the code, such as "invalid input".
+const char* WOFF2ErrorString(WOFF2ErrorCode code);
+
+// Whether converting the same input again, with more room for the result,
+// can succeed.
+inline bool WOFF2ErrorIsRetryable(WOFF2ErrorCode code) {
+  return code == kWOFF2ErrorOutputTooSmall;
+}
+
+} // namespace woff2
+
+#endif  // WOFF2_WOFF2_ERROR_H_
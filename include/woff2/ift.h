@@ -0,0 +1,59 @@
+/* Copyright 2026 Google Inc. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Glyph-keyed patches for Incremental Font Transfer: splitting a TrueType
+   font into a base font plus patches that add the glyph data of some glyphs,
+   and applying such patches, following the W3C Incremental Font Transfer
+   draft (https://www.w3.org/TR/IFT/). */
+
+#ifndef WOFF2_WOFF2_IFT_H_
+#define WOFF2_WOFF2_IFT_H_
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <string>
+#include <vector>
+
+namespace woff2 {
+
+struct IFTGlyphKeyedParams {
+  IFTGlyphKeyedParams() : uri_template("{id}.ifgk"), brotli_quality(11) {}
+
+  // The glyph ids each patch adds; patch i is patch map entry i + 1. A glyph
+  // may be in at most one patch, and the glyphs of no patch stay in the base
+  // font.
+  std::vector<std::vector<uint16_t> > patch_glyphs;
+  // Written to the patch map for clients to expand; not interpreted here.
+  std::string uri_template;
+  int brotli_quality;
+};
+
+struct IFTGlyphKeyedFont {
+  // A TrueType font with an 'IFT ' patch map, in which the glyphs of all
+  // patches are empty.
+  std::string base_font;
+  // The glyph-keyed ('ifgk') patch for each entry of patch_glyphs.
+  std::vector<std::string> patches;
+};
+
+// Splits the font into a base font and glyph-keyed patches for its glyf and
+// gvar tables. Only TrueType outlines are supported, and not collections.
+// Returns false if the font or the params are invalid.
+bool CreateGlyphKeyedPatches(const uint8_t* data, size_t length,
+                             const IFTGlyphKeyedParams& params,
+                             IFTGlyphKeyedFont* result);
+
+// Applies the glyph-keyed patch of patch map entry entry_index to a font
+// made by CreateGlyphKeyedPatches (or by previous calls to this), and marks
+// the entry applied. Meant for testing; it only supports glyf and gvar data.
+// Returns false if the patch doesn't apply.
+bool ApplyGlyphKeyedPatch(const uint8_t* font_data, size_t font_length,
+                          const uint8_t* patch_data, size_t patch_length,
+                          uint16_t entry_index, std::string* result);
+
+} // namespace woff2
+
+#endif  // WOFF2_WOFF2_IFT_H_
@@ -11,8 +11,15 @@
 
 #include <algorithm>
 #include <cstring>
+#include <limits>
 #include <memory>
 #include <string>
+#include <vector>
+
+#ifndef _WIN32
+// From <sys/uio.h>, which only WOFF2ChunkedOut::GetIovecs() callers need.
+struct iovec;
+#endif
 
 namespace woff2 {
 
@@ -41,6 +48,10 @@ class WOFF2Out {
   virtual bool Write(const void *buf, size_t offset, size_t n) = 0;
 
   virtual size_t Size() = 0;
+
+  // The most bytes the output can hold; writes past it fail. Outputs with
+  // no fixed limit return SIZE_MAX.
+  virtual size_t MaxSize() { return std::numeric_limits<size_t>::max(); }
 };
 
 /**
@@ -56,7 +67,7 @@ class WOFF2StringOut : public WOFF2Out {
   bool Write(const void *buf, size_t n) override;
   bool Write(const void *buf, size_t offset, size_t n) override;
   size_t Size() override { return offset_; }
-  size_t MaxSize() { return max_size_; }
+  size_t MaxSize() override { return max_size_; }
   void SetMaxSize(size_t max_size);
  private:
   std::string *buf_;
@@ -75,12 +86,85 @@ class WOFF2MemoryOut : public WOFF2Out {
   bool Write(const void *buf, size_t n) override;
   bool Write(const void *buf, size_t offset, size_t n) override;
   size_t Size() override { return offset_; }
+  size_t MaxSize() override { return buf_size_; }
  private:
   uint8_t* buf_;
   size_t buf_size_;
   size_t offset_;
 };
 
+/**
+ * Pool of fixed-size chunks for WOFF2ChunkedOut. Chunks released by outputs
+ * are kept and handed out again, so decoding many fonts in turn allocates
+ * only as many chunks as the largest one needs. Not thread safe.
+ */
+class WOFF2ChunkPool {
+ public:
+  static const size_t kDefaultChunkSize = 64 * 1024;
+
+  explicit WOFF2ChunkPool(size_t chunk_size = kDefaultChunkSize);
+
+  size_t ChunkSize() const { return chunk_size_; }
+  // Number of released chunks waiting to be reused.
+  size_t NumFree() const { return free_.size(); }
+
+  uint8_t* Allocate();
+  // Takes back a chunk returned by Allocate().
+  void Release(uint8_t* chunk);
+
+ private:
+  WOFF2ChunkPool(const WOFF2ChunkPool&);
+  void operator=(const WOFF2ChunkPool&);
+
+  size_t chunk_size_;
+  std::vector<std::unique_ptr<uint8_t[]> > free_;
+};
+
+/**
+ * Expanding woff2 out made of chunks from a WOFF2ChunkPool, which must
+ * outlive it. Unlike WOFF2StringOut it never moves bytes already written, so
+ * the final size need not be known up front. By default limited to
+ * kDefaultMaxSize.
+ */
+class WOFF2ChunkedOut : public WOFF2Out {
+ public:
+  // A run of output bytes, valid until the output is written to again.
+  struct Chunk {
+    const uint8_t* data;
+    size_t size;
+  };
+
+  explicit WOFF2ChunkedOut(WOFF2ChunkPool* pool);
+  ~WOFF2ChunkedOut() override;
+
+  bool Write(const void *buf, size_t n) override;
+  bool Write(const void *buf, size_t offset, size_t n) override;
+  size_t Size() override { return size_; }
+  size_t MaxSize() override { return max_size_; }
+  void SetMaxSize(size_t max_size);
+
+  // Replaces *chunks with the output, in order, without copying it.
+  void GetChunks(std::vector<Chunk>* chunks) const;
+#ifndef _WIN32
+  // As GetChunks(), in the form writev() takes.
+  void GetIovecs(std::vector<struct iovec>* iovecs) const;
+#endif
+  // Replaces *result with a contiguous copy of the output.
+  void Flatten(std::string* result) const;
+
+  // Empties the output, returning its chunks to the pool.
+  void Reset();
+
+ private:
+  WOFF2ChunkedOut(const WOFF2ChunkedOut&);
+  void operator=(const WOFF2ChunkedOut&);
+
+  WOFF2ChunkPool* pool_;
+  std::vector<uint8_t*> chunks_;
+  size_t max_size_;
+  size_t size_;
+};
+
 } // namespace woff2
 
 #endif  // WOFF2_WOFF2_OUT_H_
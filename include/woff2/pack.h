@@ -0,0 +1,110 @@
+/* Copyright 2026 Google Inc. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Packs of many WOFF2 files in one file, made to be mmapped: an index of the
+   files' names, locations and parsed headers, followed by the files. Finding
+   and enumerating fonts reads only the index, and the files are decoded in
+   place. */
+
+#ifndef WOFF2_WOFF2_PACK_H_
+#define WOFF2_WOFF2_PACK_H_
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <string>
+#include <vector>
+
+namespace woff2 {
+
+// An entry of a packed file's table directory.
+struct WOFF2PackTable {
+  uint32_t tag;
+  // Bits 6 and 7 of the flags byte, which pick the transform.
+  uint8_t transform_version;
+  uint32_t orig_length;
+  // transformLength if the table has one, else orig_length.
+  uint32_t transform_length;
+};
+
+// A packed WOFF2 file and the header fields enumerating fonts needs. The
+// pointers point into the pack.
+struct WOFF2PackEntry {
+  // NUL terminated, although names may hold NULs too.
+  const char* name;
+  size_t name_length;
+  // The whole WOFF2 file, ready for ConvertWOFF2ToTTF().
+  const uint8_t* data;
+  size_t length;
+  uint32_t flavor;
+  // As the file's header says; ComputeWOFF2FinalSize() gives the same.
+  uint32_t total_sfnt_size;
+  uint16_t num_tables;
+  // Fonts in a collection, 1 for a plain font.
+  uint16_t num_fonts;
+};
+
+// Builds a pack from WOFF2 files.
+class WOFF2PackWriter {
+ public:
+  // Adds a copy of a WOFF2 file under name, which must be unique in the pack.
+  // Returns false, adding nothing, if the name is taken or the file's header
+  // or table directory doesn't parse. The table data isn't looked at.
+  bool Add(const std::string& name, const uint8_t* data, size_t length);
+
+  // Writes the pack of the files added so far, in the order they were added.
+  // Returns false if it doesn't fit the 32 bit offsets of the format.
+  bool Finish(std::string* result) const;
+
+ private:
+  struct File {
+    std::string name;
+    std::string data;
+    uint32_t flavor;
+    uint32_t total_sfnt_size;
+    uint16_t num_fonts;
+    std::vector<WOFF2PackTable> tables;
+  };
+  std::vector<File> files_;
+};
+
+// Reads a pack in place. Opening it is O(1), and so are GetEntry(),
+// GetTable() and, on average, Find(); each checks only what it reads.
+class WOFF2PackReader {
+ public:
+  WOFF2PackReader();
+
+  // Reads the pack's header. data must stay valid and unchanged as long as
+  // the reader or anything it returned is used, e.g. the mapping of a pack
+  // file. Returns false if data isn't a pack this reader understands.
+  bool Open(const uint8_t* data, size_t length);
+
+  size_t num_entries() const { return num_entries_; }
+
+  // Entry i, for i below num_entries(). Returns false if the entry points
+  // outside the pack.
+  bool GetEntry(size_t i, WOFF2PackEntry* entry) const;
+
+  // Table directory entry j of entry i, for j below its num_tables.
+  bool GetTable(size_t i, size_t j, WOFF2PackTable* table) const;
+
+  // Looks up the entry named name through the pack's hash table.
+  bool Find(const char* name, size_t name_length, size_t* index) const;
+  bool Find(const std::string& name, size_t* index) const {
+    return Find(name.data(), name.size(), index);
+  }
+
+ private:
+  const uint8_t* data_;
+  size_t length_;
+  uint32_t num_entries_;
+  uint32_t num_buckets_;
+  uint32_t tables_offset_;
+  uint32_t num_table_records_;
+};
+
+} // namespace woff2
+
+#endif  // WOFF2_WOFF2_PACK_H_
@@ -0,0 +1,62 @@
+/* Copyright 2026 Google Inc. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Hooks around the phases of a conversion, for profiling them apart. */
+
+#ifndef WOFF2_WOFF2_PHASE_H_
+#define WOFF2_WOFF2_PHASE_H_
+
+#include <stddef.h>
+
+namespace woff2 {
+
+// Phases do not overlap. A phase may run several times in one conversion,
+// e.g. once per font of a collection.
+enum WOFF2Phase {
+  // Encoding: parsing the input font. Units are input bytes.
+  kWOFF2PhaseReadFont,
+  // Encoding: desubroutinizing CFF and CFF2, if asked to. Units are bytes
+  // of those tables in.
+  kWOFF2PhaseDesubroutinize,
+  // Encoding: rewriting every glyph in normalized form. Units are glyphs.
+  kWOFF2PhaseNormalize,
+  // Encoding: transforming glyf and loca. Units are glyphs.
+  kWOFF2PhaseTransform,
+  // Encoding: transforming gvar, if asked to. Units are gvar bytes in.
+  kWOFF2PhaseTransformGvar,
+  // Encoding: Brotli compression of the table data. Units are bytes in.
+  kWOFF2PhaseCompress,
+  // Decoding: Brotli decompression of the table data. Units are bytes out.
+  kWOFF2PhaseDecompress,
+  // Decoding: rebuilding glyf and loca. Units are glyphs.
+  kWOFF2PhaseReconstructGlyf,
+  // Decoding: writing every other table, the directory entries and
+  // checksums. Units are bytes out.
+  kWOFF2PhaseReconstructTables,
+  kWOFF2NumPhases
+};
+
+// Short name of the phase, such as "ReconstructGlyf".
+const char* WOFF2PhaseName(WOFF2Phase phase);
+
+// Whether the units of the phase are glyphs rather than bytes.
+bool WOFF2PhaseCountsGlyphs(WOFF2Phase phase);
+
+// Told when each phase begins and ends. Calls come from the converting
+// thread, in order, and are meant to be cheap; reading a few performance
+// counters is fine, anything slower skews the phases around it.
+class WOFF2PhaseObserver {
+ public:
+  virtual ~WOFF2PhaseObserver() {}
+
+  virtual void BeginPhase(WOFF2Phase phase) = 0;
+  // units is the amount of work the phase did, see WOFF2Phase.
+  virtual void EndPhase(WOFF2Phase phase, size_t units) = 0;
+};
+
+} // namespace woff2
+
+#endif  // WOFF2_WOFF2_PHASE_H_
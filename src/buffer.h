@@ -34,6 +34,8 @@ typedef unsigned __int64 uint64_t;
 #include <cstring>
 #include <limits>
 
+#include "./port.h"
+
 namespace woff2 {
 
 #if defined(_MSC_VER) || !defined(FONT_COMPRESSION_DEBUG)
@@ -104,6 +106,24 @@ class Buffer {
     return ReadU16(reinterpret_cast<uint16_t*>(value));
   }
 
+  // Reads n big-endian 16-bit values into host order.
+  bool ReadU16Array(uint16_t *values, size_t n) {
+    if (offset_ > length_ || n > (length_ - offset_) / 2) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    if (n == 0) {
+      return true;
+    }
+    std::memcpy(values, buffer_ + offset_, 2 * n);
+    ByteSwapU16Array(reinterpret_cast<uint8_t*>(values), n);
+    offset_ += 2 * n;
+    return true;
+  }
+
+  bool ReadS16Array(int16_t *values, size_t n) {
+    return ReadU16Array(reinterpret_cast<uint16_t*>(values), n);
+  }
+
   bool ReadU24(uint32_t *value) {
     if (offset_ + 3 > length_) {
       return FONT_COMPRESSION_FAILURE();
@@ -0,0 +1,314 @@
+/* Copyright 2026 Google Inc. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Opt-in capture of slow conversions, so they can be replayed later. */
+
+#include <woff2/capture.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace woff2 {
+
+namespace {
+
+const char kCaptureSuffix[] = ".capture";
+const char kInputSuffix[] = ".input";
+const char kExtendedMetadataSuffix[] = ".extended_metadata";
+
+uint64_t Fnv1aHash(const uint8_t* data, size_t length) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= data[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+// Peak resident set size of the process so far, 0 if unknown.
+size_t PeakRssKb() {
+#ifdef _WIN32
+  return 0;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#ifdef OS_MACOSX
+  return usage.ru_maxrss / 1024;  // bytes
+#else
+  return usage.ru_maxrss;  // kilobytes
+#endif
+#endif
+}
+
+class CaptureTimer {
+ public:
+  CaptureTimer()
+      : start_(std::chrono::steady_clock::now()), start_rss_kb_(PeakRssKb()) {}
+
+  double ElapsedMs() const {
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start_).count();
+  }
+
+  size_t MemoryGrowthKb() const {
+    size_t rss_kb = PeakRssKb();
+    return rss_kb > start_rss_kb_ ? rss_kb - start_rss_kb_ : 0;
+  }
+
+ private:
+  std::chrono::steady_clock::time_point start_;
+  size_t start_rss_kb_;
+};
+
+bool WriteFile(const std::string& path, const void* data, size_t length) {
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == NULL) {
+    return false;
+  }
+  bool ok = fwrite(data, 1, length, file) == length;
+  return fclose(file) == 0 && ok;
+}
+
+bool ExceedsThresholds(const WOFF2CaptureOptions& options,
+                       WOFF2CaptureRecord* record, const CaptureTimer& timer) {
+  record->elapsed_ms = timer.ElapsedMs();
+  record->memory_growth_kb = timer.MemoryGrowthKb();
+  if (options.directory.empty()) {
+    return false;
+  }
+  return (options.latency_threshold_ms > 0 &&
+          record->elapsed_ms > options.latency_threshold_ms) ||
+         (options.memory_threshold_kb > 0 &&
+          record->memory_growth_kb > options.memory_threshold_kb);
+}
+
+// Writes the input and its record to the capture directory. Failures are
+// ignored; capturing must not affect the conversion.
+void Capture(const uint8_t* data, size_t length,
+             const WOFF2CaptureOptions& options, WOFF2CaptureRecord* record) {
+  record->input_length = length;
+  record->input_hash = Fnv1aHash(data, length);
+  char hash[17];
+  snprintf(hash, sizeof(hash), "%016" PRIx64, record->input_hash);
+  const std::string base = options.directory + "/" + hash;
+  record->input_path = base + kInputSuffix;
+  if (!WriteFile(record->input_path, data, length)) {
+#ifdef FONT_COMPRESSION_BIN
+    fprintf(stderr, "Failed to capture input to %s\n",
+            record->input_path.c_str());
+#endif
+    return;
+  }
+
+  std::string text;
+  char line[256];
+  snprintf(line, sizeof(line), "operation: %s\n",
+           record->encode ? "encode" : "decode");
+  text += line;
+  text += "input: " + record->input_path + "\n";
+  snprintf(line, sizeof(line), "input_length: %zu\n", record->input_length);
+  text += line;
+  snprintf(line, sizeof(line), "input_hash: %016" PRIx64 "\n",
+           record->input_hash);
+  text += line;
+  snprintf(line, sizeof(line), "elapsed_ms: %.3f\n", record->elapsed_ms);
+  text += line;
+  snprintf(line, sizeof(line), "memory_growth_kb: %zu\n",
+           record->memory_growth_kb);
+  text += line;
+  snprintf(line, sizeof(line), "latency_threshold_ms: %.3f\n",
+           options.latency_threshold_ms);
+  text += line;
+  snprintf(line, sizeof(line), "memory_threshold_kb: %zu\n",
+           options.memory_threshold_kb);
+  text += line;
+  snprintf(line, sizeof(line), "succeeded: %d\n", record->succeeded);
+  text += line;
+  if (record->encode) {
+    const WOFF2Params& params = record->params;
+    snprintf(line, sizeof(line),
+             "brotli_quality: %d\nallow_transforms: %d\nmemory_limit: %zu\n"
+             "adapt_to_content: %d\ntransform_gvar: %d\n"
+             "desubroutinize_cff: %d\nverify: %d\nnum_streams: %d\n"
+             "num_threads: %d\n",
+             params.brotli_quality, params.allow_transforms,
+             params.memory_limit, params.adapt_to_content,
+             params.transform_gvar, params.desubroutinize_cff,
+             params.verify, params.num_streams, params.num_threads);
+    text += line;
+    if (!params.extended_metadata.empty()) {
+      const std::string metadata_path = base + kExtendedMetadataSuffix;
+      if (WriteFile(metadata_path, params.extended_metadata.data(),
+                    params.extended_metadata.size())) {
+        text += "extended_metadata: " + metadata_path + "\n";
+      }
+    }
+  } else {
+    const WOFF2DecodeParams& params = record->decode_params;
+    snprintf(line, sizeof(line),
+             "skip_checksums: %d\nallow_gvar_transform: %d\n"
+             "allow_multi_stream: %d\nnum_threads: %d\n",
+             params.skip_checksums, params.allow_gvar_transform,
+             params.allow_multi_stream, params.num_threads);
+    text += line;
+    if (!params.table_order.empty()) {
+      text += "table_order:";
+      for (uint32_t tag : params.table_order) {
+        snprintf(line, sizeof(line), " %08" PRIx32, tag);
+        text += line;
+      }
+      text += "\n";
+    }
+  }
+
+  const std::string record_path = base + kCaptureSuffix;
+  if (!WriteFile(record_path, text.data(), text.size())) {
+#ifdef FONT_COMPRESSION_BIN
+    fprintf(stderr, "Failed to write capture record %s\n",
+            record_path.c_str());
+#endif
+  }
+}
+
+bool ReadFile(const std::string& path, std::string* contents) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == NULL) {
+    return false;
+  }
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+    contents->append(buf, n);
+  }
+  bool ok = ferror(file) == 0;
+  fclose(file);
+  return ok;
+}
+
+}  // namespace
+
+bool ConvertTTFToWOFF2WithCapture(const uint8_t *data, size_t length,
+                                  uint8_t *result, size_t *result_length,
+                                  const WOFF2Params& params,
+                                  const WOFF2CaptureOptions& options) {
+  CaptureTimer timer;
+  WOFF2CaptureRecord record;
+  record.encode = true;
+  record.params = params;
+  record.succeeded = ConvertTTFToWOFF2(data, length, result, result_length,
+                                       params);
+  if (ExceedsThresholds(options, &record, timer)) {
+    Capture(data, length, options, &record);
+  }
+  return record.succeeded;
+}
+
+bool ConvertWOFF2ToTTFWithCapture(const uint8_t *data, size_t length,
+                                  WOFF2Out* out,
+                                  const WOFF2DecodeParams& params,
+                                  const WOFF2CaptureOptions& options) {
+  CaptureTimer timer;
+  WOFF2CaptureRecord record;
+  record.decode_params = params;
+  record.succeeded = ConvertWOFF2ToTTF(data, length, out, params);
+  if (ExceedsThresholds(options, &record, timer)) {
+    Capture(data, length, options, &record);
+  }
+  return record.succeeded;
+}
+
+bool ReadWOFF2CaptureRecord(const std::string& path,
+                            WOFF2CaptureRecord* record) {
+  std::string text;
+  if (!ReadFile(path, &text)) {
+    return false;
+  }
+  *record = WOFF2CaptureRecord();
+  bool have_operation = false;
+  size_t start = 0;
+  while (start < text.size()) {
+    size_t end = text.find('\n', start);
+    if (end == std::string::npos) {
+      end = text.size();
+    }
+    const std::string line = text.substr(start, end - start);
+    start = end + 1;
+    const size_t colon = line.find(": ");
+    if (colon == std::string::npos) {
+      continue;
+    }
+    const std::string key = line.substr(0, colon);
+    const std::string value = line.substr(colon + 2);
+    const char* v = value.c_str();
+    if (key == "operation") {
+      record->encode = value == "encode";
+      have_operation = record->encode || value == "decode";
+    } else if (key == "input") {
+      record->input_path = value;
+    } else if (key == "input_length") {
+      record->input_length = strtoull(v, NULL, 10);
+    } else if (key == "input_hash") {
+      record->input_hash = strtoull(v, NULL, 16);
+    } else if (key == "elapsed_ms") {
+      record->elapsed_ms = strtod(v, NULL);
+    } else if (key == "memory_growth_kb") {
+      record->memory_growth_kb = strtoull(v, NULL, 10);
+    } else if (key == "succeeded") {
+      record->succeeded = atoi(v) != 0;
+    } else if (key == "brotli_quality") {
+      record->params.brotli_quality = atoi(v);
+    } else if (key == "allow_transforms") {
+      record->params.allow_transforms = atoi(v) != 0;
+    } else if (key == "memory_limit") {
+      record->params.memory_limit = strtoull(v, NULL, 10);
+    } else if (key == "adapt_to_content") {
+      record->params.adapt_to_content = atoi(v) != 0;
+    } else if (key == "transform_gvar") {
+      record->params.transform_gvar = atoi(v) != 0;
+    } else if (key == "desubroutinize_cff") {
+      record->params.desubroutinize_cff = atoi(v) != 0;
+    } else if (key == "verify") {
+      record->params.verify = atoi(v) != 0;
+    } else if (key == "num_streams") {
+      record->params.num_streams = atoi(v);
+    } else if (key == "num_threads") {
+      if (record->encode) {
+        record->params.num_threads = atoi(v);
+      } else {
+        record->decode_params.num_threads = atoi(v);
+      }
+    } else if (key == "skip_checksums") {
+      record->decode_params.skip_checksums = atoi(v) != 0;
+    } else if (key == "allow_gvar_transform") {
+      record->decode_params.allow_gvar_transform = atoi(v) != 0;
+    } else if (key == "allow_multi_stream") {
+      record->decode_params.allow_multi_stream = atoi(v) != 0;
+    } else if (key == "table_order") {
+      char* tag_end;
+      for (uint32_t tag = strtoul(v, &tag_end, 16); tag_end != v;
+           tag = strtoul(v, &tag_end, 16)) {
+        record->decode_params.table_order.push_back(tag);
+        v = tag_end;
+      }
+    } else if (key == "extended_metadata") {
+      if (!ReadFile(value, &record->params.extended_metadata)) {
+        return false;
+      }
+    }
+  }
+  return have_operation && !record->input_path.empty();
+}
+
+} // namespace woff2
@@ -0,0 +1,1013 @@
+/* Copyright 2026 Google Inc. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Desubroutinization of CFF and CFF2 tables. */
+
+#include "./cff.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <vector>
+
+#include "./buffer.h"
+
+namespace woff2 {
+
+namespace {
+
+// DICT operators. Two byte operators, 12 followed by a second byte, are
+// numbered 1200 plus the second byte.
+const int kCharsetOp = 15;
+const int kEncodingOp = 16;
+const int kCharStringsOp = 17;
+const int kPrivateOp = 18;
+const int kSubrsOp = 19;
+const int kVsIndexDictOp = 22;
+const int kVariationStoreOp = 24;
+const int kCharstringTypeOp = 1206;
+const int kFdArrayOp = 1236;
+const int kFdSelectOp = 1237;
+
+// Charstring operators.
+const int kHStem = 1;
+const int kVStem = 3;
+const int kVMoveTo = 4;
+const int kRLineTo = 5;
+const int kHLineTo = 6;
+const int kVLineTo = 7;
+const int kRRCurveTo = 8;
+const int kCallSubr = 10;
+const int kReturn = 11;
+const int kEscape = 12;
+const int kEndChar = 14;
+const int kVsIndex = 15;
+const int kBlend = 16;
+const int kHStemHm = 18;
+const int kHintMask = 19;
+const int kCntrMask = 20;
+const int kRMoveTo = 21;
+const int kHMoveTo = 22;
+const int kVStemHm = 23;
+const int kRCurveLine = 24;
+const int kRLineCurve = 25;
+const int kVVCurveTo = 26;
+const int kHHCurveTo = 27;
+const int kCallGSubr = 29;
+const int kVHCurveTo = 30;
+const int kHVCurveTo = 31;
+const int kDotSection = 1200;
+const int kHFlex = 1234;
+const int kFlex = 1235;
+const int kHFlex1 = 1236;
+const int kFlex1 = 1237;
+
+// Type 2 and CFF2 charstring limits.
+const int kMaxSubrNesting = 10;
+const size_t kMaxStackDepth = 513;
+// Bound on an expanded charstring, so that subroutines calling each other
+// repeatedly can't make the output explode.
+const size_t kMaxCharStringLength = 65535;
+
+struct Span {
+  Span() : data(NULL), length(0) {}
+  Span(const uint8_t* d, size_t l) : data(d), length(l) {}
+  const uint8_t* data;
+  size_t length;
+};
+
+struct CffIndex {
+  CffIndex() : end(0) {}
+  std::vector<Span> objects;
+  // Table offset of the first byte after the INDEX.
+  size_t end;
+};
+
+struct DictEntry {
+  int op;
+  // The operand bytes, copied as they are unless they are offsets.
+  Span operands;
+  // Real operands are stored as 0; none of the ones we interpret are real.
+  std::vector<int32_t> values;
+};
+
+typedef std::vector<DictEntry> Dict;
+
+struct PrivateDict {
+  // Without the Subrs operator, which is dropped along with the subroutines.
+  Dict dict;
+  CffIndex subrs;
+  int vsindex;
+};
+
+struct CffFont {
+  bool cff2;
+  // Copied through unchanged; empty when absent.
+  Span names;
+  Span strings;
+  Span charset;
+  Span encoding;
+  Span fd_select;
+  Span variation_store;
+  Dict top_dict;
+  // The FDArray, empty if the font has none.
+  std::vector<Dict> font_dicts;
+  // One for each font dict, or the Top DICT's.
+  std::vector<PrivateDict> privates;
+  std::vector<std::vector<uint8_t> > char_strings;
+};
+
+// Where WriteCff put the parts that are referenced by offset.
+struct CffLayout {
+  uint32_t charset;
+  uint32_t encoding;
+  uint32_t fd_select;
+  uint32_t variation_store;
+  uint32_t char_strings;
+  uint32_t fd_array;
+  std::vector<uint32_t> private_offsets;
+  std::vector<uint32_t> private_sizes;
+};
+
+bool ReadOffset(Buffer* file, int off_size, uint32_t* value) {
+  *value = 0;
+  for (int i = 0; i < off_size; ++i) {
+    uint8_t byte;
+    if (!file->ReadU8(&byte)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    *value = (*value << 8) | byte;
+  }
+  return true;
+}
+
+// Reads the INDEX at offset. CFF2 INDEXes have a 32-bit count.
+bool ReadIndex(const uint8_t* data, size_t length, size_t offset, bool cff2,
+               CffIndex* index) {
+  if (offset > length) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  Buffer file(data + offset, length - offset);
+  uint32_t count;
+  if (cff2) {
+    if (!file.ReadU32(&count)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+  } else {
+    uint16_t count16;
+    if (!file.ReadU16(&count16)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    count = count16;
+  }
+  index->objects.clear();
+  if (count == 0) {
+    index->end = offset + file.offset();
+    return true;
+  }
+  uint8_t off_size;
+  if (!file.ReadU8(&off_size) || off_size < 1 || off_size > 4 ||
+      count >= (length - offset) / off_size) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  std::vector<uint32_t> offsets(count + 1);
+  for (uint32_t i = 0; i <= count; ++i) {
+    if (!ReadOffset(&file, off_size, &offsets[i])) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+  }
+  // Offsets are relative to the byte before the object data.
+  const size_t data_start = offset + file.offset() - 1;
+  if (offsets[0] != 1 || offsets[count] > length - data_start) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  index->objects.resize(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    if (offsets[i + 1] < offsets[i]) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    index->objects[i] = Span(data + data_start + offsets[i],
+                             offsets[i + 1] - offsets[i]);
+  }
+  index->end = data_start + offsets[count];
+  return true;
+}
+
+bool ParseDict(const uint8_t* data, size_t length, Dict* dict) {
+  dict->clear();
+  std::vector<int32_t> values;
+  size_t start = 0;
+  size_t i = 0;
+  while (i < length) {
+    const int b0 = data[i];
+    if (b0 <= 24) {
+      DictEntry entry;
+      entry.op = b0;
+      entry.operands = Span(data + start, i - start);
+      entry.values.swap(values);
+      if (b0 == kEscape) {
+        if (i + 1 >= length) {
+          return FONT_COMPRESSION_FAILURE();
+        }
+        entry.op = 1200 + data[++i];
+      }
+      dict->push_back(entry);
+      start = ++i;
+    } else if (b0 == 28) {
+      if (i + 3 > length) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      values.push_back(static_cast<int16_t>((data[i + 1] << 8) | data[i + 2]));
+      i += 3;
+    } else if (b0 == 29) {
+      if (i + 5 > length) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      values.push_back(static_cast<int32_t>(
+          (static_cast<uint32_t>(data[i + 1]) << 24) | (data[i + 2] << 16) |
+          (data[i + 3] << 8) | data[i + 4]));
+      i += 5;
+    } else if (b0 == 30) {
+      // A real, in nibbles up to and including an 0xf one.
+      for (++i;; ++i) {
+        if (i >= length) {
+          return FONT_COMPRESSION_FAILURE();
+        }
+        if ((data[i] >> 4) == 0xf || (data[i] & 0xf) == 0xf) {
+          break;
+        }
+      }
+      ++i;
+      values.push_back(0);
+    } else if (b0 >= 32 && b0 <= 246) {
+      values.push_back(b0 - 139);
+      ++i;
+    } else if (b0 >= 247 && b0 <= 254) {
+      if (i + 2 > length) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      const int magnitude = ((b0 - 247) & 3) * 256 + data[i + 1] + 108;
+      values.push_back(b0 <= 250 ? magnitude : -magnitude);
+      i += 2;
+    } else {
+      return FONT_COMPRESSION_FAILURE();
+    }
+  }
+  // Operands must be followed by their operator.
+  if (start != length) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  return true;
+}
+
+const DictEntry* FindOp(const Dict& dict, int op) {
+  for (const auto& entry : dict) {
+    if (entry.op == op) {
+      return &entry;
+    }
+  }
+  return NULL;
+}
+
+// Sets *value to the single, non-negative operand of op, or to -1 if the DICT
+// doesn't have op.
+bool ReadOffsetOperand(const Dict& dict, int op, int64_t* value) {
+  const DictEntry* entry = FindOp(dict, op);
+  *value = -1;
+  if (entry == NULL) {
+    return true;
+  }
+  if (entry->values.size() != 1 || entry->values[0] < 0) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  *value = entry->values[0];
+  return true;
+}
+
+bool ReadPrivateDict(const uint8_t* data, size_t length, const Dict& dict,
+                     bool cff2, PrivateDict* private_dict) {
+  const DictEntry* entry = FindOp(dict, kPrivateOp);
+  if (entry == NULL || entry->values.size() != 2 || entry->values[0] < 0 ||
+      entry->values[1] < 0) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  const size_t size = entry->values[0];
+  const size_t offset = entry->values[1];
+  Dict entries;
+  if (offset > length || size > length - offset ||
+      !ParseDict(data + offset, size, &entries)) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  private_dict->vsindex = 0;
+  for (const auto& private_entry : entries) {
+    if (private_entry.op == kSubrsOp) {
+      // Relative to the start of the Private DICT.
+      if (private_entry.values.size() != 1 || private_entry.values[0] < 0 ||
+          !ReadIndex(data, length, offset + private_entry.values[0], cff2,
+                     &private_dict->subrs)) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      continue;
+    }
+    if (private_entry.op == kVsIndexDictOp) {
+      if (private_entry.values.size() != 1) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      private_dict->vsindex = private_entry.values[0];
+    }
+    private_dict->dict.push_back(private_entry);
+  }
+  return true;
+}
+
+bool ReadCharset(const uint8_t* data, size_t length, size_t offset,
+                 size_t num_glyphs, Span* charset) {
+  if (offset > length) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  Buffer file(data + offset, length - offset);
+  uint8_t format;
+  if (!file.ReadU8(&format)) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  if (format == 0) {
+    if (!file.Skip(2 * (num_glyphs - 1))) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+  } else if (format == 1 || format == 2) {
+    // Ranges of SIDs, covering every glyph but .notdef.
+    for (size_t covered = 1; covered < num_glyphs;) {
+      uint16_t num_left;
+      if (!file.Skip(2)) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      if (format == 1) {
+        uint8_t num_left8;
+        if (!file.ReadU8(&num_left8)) {
+          return FONT_COMPRESSION_FAILURE();
+        }
+        num_left = num_left8;
+      } else if (!file.ReadU16(&num_left)) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      covered += num_left + 1;
+    }
+  } else {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  *charset = Span(data + offset, file.offset());
+  return true;
+}
+
+bool ReadEncoding(const uint8_t* data, size_t length, size_t offset,
+                  Span* encoding) {
+  if (offset > length) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  Buffer file(data + offset, length - offset);
+  uint8_t format;
+  uint8_t count;
+  if (!file.ReadU8(&format) || !file.ReadU8(&count)) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  if ((format & 0x7f) == 0) {
+    if (!file.Skip(count)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+  } else if ((format & 0x7f) == 1) {
+    if (!file.Skip(2 * count)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+  } else {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  // Supplements.
+  if ((format & 0x80) != 0) {
+    if (!file.ReadU8(&count) || !file.Skip(3 * count)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+  }
+  *encoding = Span(data + offset, file.offset());
+  return true;
+}
+
+// Reads the font dict index of each glyph. Formats 0 and 3 are CFF's, 4 is
+// CFF2's.
+bool ReadFdSelect(const uint8_t* data, size_t length, size_t offset,
+                  size_t num_glyphs, size_t num_fds, Span* fd_select,
+                  std::vector<uint16_t>* fds) {
+  if (offset > length) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  Buffer file(data + offset, length - offset);
+  uint8_t format;
+  if (!file.ReadU8(&format)) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  fds->resize(num_glyphs);
+  if (format == 0) {
+    for (size_t i = 0; i < num_glyphs; ++i) {
+      uint8_t fd;
+      if (!file.ReadU8(&fd)) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      (*fds)[i] = fd;
+    }
+  } else if (format == 3 || format == 4) {
+    uint32_t num_ranges;
+    uint32_t first;
+    if (format == 3) {
+      uint16_t num_ranges16;
+      uint16_t first16;
+      if (!file.ReadU16(&num_ranges16) || !file.ReadU16(&first16)) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      num_ranges = num_ranges16;
+      first = first16;
+    } else if (!file.ReadU32(&num_ranges) || !file.ReadU32(&first)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    if (first != 0) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    // Each range runs up to the first glyph of the next one, or the sentinel.
+    for (uint32_t i = 0; i < num_ranges; ++i) {
+      uint16_t fd;
+      uint32_t next;
+      if (format == 3) {
+        uint8_t fd8;
+        uint16_t next16;
+        if (!file.ReadU8(&fd8) || !file.ReadU16(&next16)) {
+          return FONT_COMPRESSION_FAILURE();
+        }
+        fd = fd8;
+        next = next16;
+      } else if (!file.ReadU16(&fd) || !file.ReadU32(&next)) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      if (next <= first || next > num_glyphs) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      std::fill(fds->begin() + first, fds->begin() + next, fd);
+      first = next;
+    }
+    if (first != num_glyphs) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+  } else {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  for (uint16_t fd : *fds) {
+    if (fd >= num_fds) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+  }
+  *fd_select = Span(data + offset, file.offset());
+  return true;
+}
+
+// Reads the extent of the CFF2 VariationStore and the number of regions of
+// each of its ItemVariationData, which blend needs to know how many operands
+// it takes.
+bool ReadVariationStore(const uint8_t* data, size_t length, size_t offset,
+                        Span* variation_store,
+                        std::vector<uint16_t>* region_counts) {
+  if (offset > length) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  Buffer file(data + offset, length - offset);
+  uint16_t store_length;
+  uint16_t format;
+  uint16_t count;
+  if (!file.ReadU16(&store_length) || store_length > length - offset - 2 ||
+      !file.ReadU16(&format) || format != 1 || !file.Skip(4) ||
+      !file.ReadU16(&count)) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  Buffer store(data + offset + 2, store_length);
+  region_counts->resize(count);
+  for (uint16_t i = 0; i < count; ++i) {
+    uint32_t data_offset;
+    if (!file.ReadU32(&data_offset) || data_offset > store_length) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    Buffer item_data(data + offset + 2 + data_offset,
+                     store_length - data_offset);
+    if (!item_data.Skip(4) || !item_data.ReadU16(&(*region_counts)[i])) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+  }
+  *variation_store = Span(data + offset, 2 + store_length);
+  return true;
+}
+
+int SubrBias(size_t count) {
+  if (count < 1240) {
+    return 107;
+  }
+  if (count < 33900) {
+    return 1131;
+  }
+  return 32768;
+}
+
+// Expands the subroutine calls of charstrings. The operand stack is followed
+// only as far as needed to find subroutine numbers, blend operand counts and
+// the number of stems, which sets the length of hintmask operators.
+class CharStringExpander {
+ public:
+  CharStringExpander(const CffIndex& global_subrs, const CffIndex& local_subrs,
+                     const std::vector<uint16_t>& region_counts, int vsindex,
+                     bool cff2)
+      : global_subrs_(global_subrs), local_subrs_(local_subrs),
+        region_counts_(region_counts), vsindex_(vsindex), cff2_(cff2),
+        num_stems_(0), last_number_start_(0), after_number_(false),
+        done_(false) {}
+
+  bool Expand(const Span& char_string, std::vector<uint8_t>* result) {
+    result->clear();
+    return Run(char_string, 0, result);
+  }
+
+ private:
+  bool Run(const Span& char_string, int depth, std::vector<uint8_t>* out) {
+    if (depth > kMaxSubrNesting) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    const uint8_t* data = char_string.data;
+    const size_t length = char_string.length;
+    size_t i = 0;
+    while (i < length && !done_) {
+      if (out->size() > kMaxCharStringLength) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      const int b0 = data[i];
+      if (b0 == 28 || b0 >= 32) {
+        size_t size = b0 == 28 ? 3 : b0 <= 246 ? 1 : b0 <= 254 ? 2 : 5;
+        if (i + size > length || stack_.size() >= kMaxStackDepth) {
+          return FONT_COMPRESSION_FAILURE();
+        }
+        double value;
+        if (b0 == 28) {
+          value = static_cast<int16_t>((data[i + 1] << 8) | data[i + 2]);
+        } else if (b0 <= 246) {
+          value = b0 - 139;
+        } else if (b0 <= 250) {
+          value = (b0 - 247) * 256 + data[i + 1] + 108;
+        } else if (b0 <= 254) {
+          value = -(b0 - 251) * 256 - data[i + 1] - 108;
+        } else {
+          // 16.16 fixed point.
+          value = static_cast<int32_t>(
+              (static_cast<uint32_t>(data[i + 1]) << 24) |
+              (data[i + 2] << 16) | (data[i + 3] << 8) | data[i + 4]) /
+              65536.0;
+        }
+        stack_.push_back(value);
+        last_number_start_ = out->size();
+        after_number_ = true;
+        out->insert(out->end(), data + i, data + i + size);
+        i += size;
+        continue;
+      }
+      ++i;
+
+      if (b0 == kCallSubr || b0 == kCallGSubr) {
+        const CffIndex& subrs = b0 == kCallSubr ? local_subrs_ : global_subrs_;
+        // The subroutine number must come straight from the charstring,
+        // since its bytes are removed along with the call.
+        if (!after_number_) {
+          return FONT_COMPRESSION_FAILURE();
+        }
+        const double index = stack_.back() + SubrBias(subrs.objects.size());
+        stack_.pop_back();
+        if (index < 0 || index >= subrs.objects.size() ||
+            index != std::floor(index)) {
+          return FONT_COMPRESSION_FAILURE();
+        }
+        out->resize(last_number_start_);
+        after_number_ = false;
+        if (!Run(subrs.objects[static_cast<size_t>(index)], depth + 1, out)) {
+          return FONT_COMPRESSION_FAILURE();
+        }
+        continue;
+      }
+      if (b0 == kReturn && !cff2_ && depth > 0) {
+        return true;
+      }
+
+      int op = b0;
+      if (b0 == kEscape) {
+        if (i >= length) {
+          return FONT_COMPRESSION_FAILURE();
+        }
+        op = 1200 + data[i++];
+      }
+      switch (op) {
+        case kHStem:
+        case kVStem:
+        case kHStemHm:
+        case kVStemHm:
+          num_stems_ += stack_.size() / 2;
+          break;
+        case kHintMask:
+        case kCntrMask: {
+          // Operands before the first hintmask are an implied vstemhm.
+          num_stems_ += stack_.size() / 2;
+          const size_t mask_size = (num_stems_ + 7) / 8;
+          if (i + mask_size > length) {
+            return FONT_COMPRESSION_FAILURE();
+          }
+          out->push_back(op);
+          out->insert(out->end(), data + i, data + i + mask_size);
+          i += mask_size;
+          stack_.clear();
+          after_number_ = false;
+          continue;
+        }
+        case kEndChar:
+          if (cff2_) {
+            return FONT_COMPRESSION_FAILURE();
+          }
+          done_ = true;
+          break;
+        case kVsIndex:
+          if (!cff2_ || stack_.empty()) {
+            return FONT_COMPRESSION_FAILURE();
+          }
+          vsindex_ = stack_.back();
+          break;
+        case kBlend: {
+          if (!cff2_ || stack_.empty() || vsindex_ < 0 ||
+              vsindex_ >= static_cast<int>(region_counts_.size())) {
+            return FONT_COMPRESSION_FAILURE();
+          }
+          // n default values, n deltas for each region, and n; leaves the n
+          // blended values, which we take to be the defaults.
+          const double n = stack_.back();
+          const size_t num_regions = region_counts_[vsindex_];
+          if (n < 0 || n != std::floor(n) ||
+              n * (num_regions + 1) + 1 > stack_.size()) {
+            return FONT_COMPRESSION_FAILURE();
+          }
+          stack_.resize(stack_.size() - static_cast<size_t>(n) * num_regions -
+                        1);
+          out->push_back(op);
+          after_number_ = false;
+          continue;
+        }
+        case kVMoveTo:
+        case kRLineTo:
+        case kHLineTo:
+        case kVLineTo:
+        case kRRCurveTo:
+        case kRMoveTo:
+        case kHMoveTo:
+        case kRCurveLine:
+        case kRLineCurve:
+        case kVVCurveTo:
+        case kHHCurveTo:
+        case kVHCurveTo:
+        case kHVCurveTo:
+        case kDotSection:
+        case kHFlex:
+        case kFlex:
+        case kHFlex1:
+        case kFlex1:
+          break;
+        default:
+          // Reserved operators, and the arithmetic and storage ones whose
+          // results we don't evaluate.
+          return FONT_COMPRESSION_FAILURE();
+      }
+      if (op >= 1200) {
+        out->push_back(kEscape);
+        out->push_back(op - 1200);
+      } else {
+        out->push_back(op);
+      }
+      stack_.clear();
+      after_number_ = false;
+    }
+    return true;
+  }
+
+  const CffIndex& global_subrs_;
+  const CffIndex& local_subrs_;
+  const std::vector<uint16_t>& region_counts_;
+  int vsindex_;
+  bool cff2_;
+  std::vector<double> stack_;
+  size_t num_stems_;
+  // Where the bytes of the last number start in the output, and whether
+  // nothing was written after it.
+  size_t last_number_start_;
+  bool after_number_;
+  // Set by endchar, which ends the charstring from within any subroutine.
+  bool done_;
+};
+
+// Parses the font and expands all of its charstrings. Returns false if the
+// font can't be desubroutinized, or has no subroutines.
+bool ReadCff(const uint8_t* data, size_t length, CffFont* font) {
+  Buffer file(data, length);
+  uint8_t major;
+  uint8_t header_size;
+  if (!file.ReadU8(&major) || !file.Skip(1) || !file.ReadU8(&header_size)) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  CffIndex global_subrs;
+  if (major == 1) {
+    font->cff2 = false;
+    CffIndex names;
+    CffIndex top_dicts;
+    CffIndex strings;
+    if (header_size < 4 ||
+        !ReadIndex(data, length, header_size, false, &names) ||
+        !ReadIndex(data, length, names.end, false, &top_dicts) ||
+        top_dicts.objects.size() != 1 ||
+        !ReadIndex(data, length, top_dicts.end, false, &strings) ||
+        !ReadIndex(data, length, strings.end, false, &global_subrs) ||
+        !ParseDict(top_dicts.objects[0].data, top_dicts.objects[0].length,
+                   &font->top_dict)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    font->names = Span(data + header_size, names.end - header_size);
+    font->strings = Span(data + top_dicts.end, strings.end - top_dicts.end);
+    const DictEntry* type = FindOp(font->top_dict, kCharstringTypeOp);
+    if (type != NULL && (type->values.size() != 1 || type->values[0] != 2)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+  } else if (major == 2) {
+    font->cff2 = true;
+    uint16_t top_dict_length;
+    if (header_size < 5 || !file.ReadU16(&top_dict_length) ||
+        top_dict_length > length - header_size ||
+        !ParseDict(data + header_size, top_dict_length, &font->top_dict) ||
+        !ReadIndex(data, length, header_size + top_dict_length, true,
+                   &global_subrs)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+  } else {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  const bool cff2 = font->cff2;
+
+  int64_t char_strings_offset;
+  CffIndex char_strings;
+  if (!ReadOffsetOperand(font->top_dict, kCharStringsOp,
+                         &char_strings_offset) ||
+      char_strings_offset < 0 ||
+      !ReadIndex(data, length, char_strings_offset, cff2, &char_strings) ||
+      char_strings.objects.empty()) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  const size_t num_glyphs = char_strings.objects.size();
+
+  std::vector<uint16_t> region_counts;
+  int64_t offset;
+  if (!ReadOffsetOperand(font->top_dict, kVariationStoreOp, &offset) ||
+      (offset >= 0 && (!cff2 ||
+                       !ReadVariationStore(data, length, offset,
+                                           &font->variation_store,
+                                           &region_counts)))) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  // Offsets 0 to 2 stand for predefined charsets, 0 and 1 for predefined
+  // encodings.
+  if (!ReadOffsetOperand(font->top_dict, kCharsetOp, &offset) ||
+      (offset > 2 && !ReadCharset(data, length, offset, num_glyphs,
+                                  &font->charset)) ||
+      !ReadOffsetOperand(font->top_dict, kEncodingOp, &offset) ||
+      (offset > 1 && !ReadEncoding(data, length, offset, &font->encoding))) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+
+  std::vector<uint16_t> fds;
+  if (!ReadOffsetOperand(font->top_dict, kFdArrayOp, &offset)) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  if (offset >= 0) {
+    CffIndex fd_array;
+    if (!ReadIndex(data, length, offset, cff2, &fd_array) ||
+        fd_array.objects.empty()) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    font->font_dicts.resize(fd_array.objects.size());
+    font->privates.resize(fd_array.objects.size());
+    for (size_t i = 0; i < fd_array.objects.size(); ++i) {
+      if (!ParseDict(fd_array.objects[i].data, fd_array.objects[i].length,
+                     &font->font_dicts[i]) ||
+          !ReadPrivateDict(data, length, font->font_dicts[i], cff2,
+                           &font->privates[i])) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+    }
+    if (!ReadOffsetOperand(font->top_dict, kFdSelectOp, &offset) ||
+        (offset >= 0 && !ReadFdSelect(data, length, offset, num_glyphs,
+                                      fd_array.objects.size(),
+                                      &font->fd_select, &fds)) ||
+        (offset < 0 && fd_array.objects.size() != 1)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+  } else if (cff2) {
+    return FONT_COMPRESSION_FAILURE();
+  } else if (FindOp(font->top_dict, kPrivateOp) != NULL) {
+    font->privates.resize(1);
+    if (!ReadPrivateDict(data, length, font->top_dict, cff2,
+                         &font->privates[0])) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+  }
+
+  bool has_subrs = !global_subrs.objects.empty();
+  for (const auto& private_dict : font->privates) {
+    has_subrs |= !private_dict.subrs.objects.empty();
+  }
+  if (!has_subrs) {
+    return false;
+  }
+
+  const CffIndex no_subrs;
+  font->char_strings.resize(num_glyphs);
+  for (size_t i = 0; i < num_glyphs; ++i) {
+    const size_t fd = fds.empty() ? 0 : fds[i];
+    const PrivateDict* private_dict =
+        font->privates.empty() ? NULL : &font->privates[fd];
+    CharStringExpander expander(
+        global_subrs, private_dict ? private_dict->subrs : no_subrs,
+        region_counts, private_dict ? private_dict->vsindex : 0, cff2);
+    if (!expander.Expand(char_strings.objects[i], &font->char_strings[i])) {
+#ifdef FONT_COMPRESSION_BIN
+      fprintf(stderr, "Can't desubroutinize charstring %zu.\n", i);
+#endif
+      return FONT_COMPRESSION_FAILURE();
+    }
+  }
+  return true;
+}
+
+// Offsets and Private DICT sizes are written as 5 byte integers, so that the
+// size of a DICT doesn't depend on their values.
+void WriteDict(const Dict& dict,
+               const std::map<int, std::vector<uint32_t> >& offsets,
+               std::vector<uint8_t>* out) {
+  for (const auto& entry : dict) {
+    const auto it = offsets.find(entry.op);
+    if (it != offsets.end()) {
+      for (uint32_t value : it->second) {
+        out->push_back(29);
+        out->push_back(value >> 24);
+        out->push_back(value >> 16);
+        out->push_back(value >> 8);
+        out->push_back(value);
+      }
+    } else {
+      out->insert(out->end(), entry.operands.data,
+                  entry.operands.data + entry.operands.length);
+    }
+    if (entry.op >= 1200) {
+      out->push_back(kEscape);
+      out->push_back(entry.op - 1200);
+    } else {
+      out->push_back(entry.op);
+    }
+  }
+}
+
+void WriteIndex(const std::vector<std::vector<uint8_t> >& objects, bool cff2,
+                std::vector<uint8_t>* out) {
+  const uint32_t count = objects.size();
+  if (cff2) {
+    out->push_back(count >> 24);
+    out->push_back(count >> 16);
+  }
+  out->push_back(count >> 8);
+  out->push_back(count);
+  if (count == 0) {
+    return;
+  }
+  uint32_t last_offset = 1;
+  for (const auto& object : objects) {
+    last_offset += object.size();
+  }
+  int off_size = 1;
+  while (off_size < 4 && (last_offset >> (8 * off_size)) != 0) {
+    ++off_size;
+  }
+  out->push_back(off_size);
+  uint32_t offset = 1;
+  for (uint32_t i = 0; i <= count; ++i) {
+    for (int shift = 8 * (off_size - 1); shift >= 0; shift -= 8) {
+      out->push_back(offset >> shift);
+    }
+    if (i < count) {
+      offset += objects[i].size();
+    }
+  }
+  for (const auto& object : objects) {
+    out->insert(out->end(), object.begin(), object.end());
+  }
+}
+
+void AppendSpan(const Span& span, uint32_t* offset, std::vector<uint8_t>* out) {
+  *offset = out->size();
+  out->insert(out->end(), span.data, span.data + span.length);
+}
+
+// Writes the font with empty global subroutines and without local ones,
+// taking the offsets the DICTs refer to from offsets, and records in layout
+// where everything ended up. Nothing moves when only offsets change, so a
+// second call with the first call's layout writes the final table.
+void WriteCff(const CffFont& font, const CffLayout& offsets,
+              std::vector<uint8_t>* out, CffLayout* layout) {
+  std::map<int, std::vector<uint32_t> > top_offsets;
+  top_offsets[kCharStringsOp] = {offsets.char_strings};
+  if (font.charset.length > 0) {
+    top_offsets[kCharsetOp] = {offsets.charset};
+  }
+  if (font.encoding.length > 0) {
+    top_offsets[kEncodingOp] = {offsets.encoding};
+  }
+  if (font.fd_select.length > 0) {
+    top_offsets[kFdSelectOp] = {offsets.fd_select};
+  }
+  if (font.variation_store.length > 0) {
+    top_offsets[kVariationStoreOp] = {offsets.variation_store};
+  }
+  if (!font.font_dicts.empty()) {
+    top_offsets[kFdArrayOp] = {offsets.fd_array};
+  } else if (!font.privates.empty()) {
+    top_offsets[kPrivateOp] = {offsets.private_sizes[0],
+                               offsets.private_offsets[0]};
+  }
+  std::vector<uint8_t> top_dict;
+  WriteDict(font.top_dict, top_offsets, &top_dict);
+
+  out->clear();
+  uint32_t unused;
+  if (!font.cff2) {
+    const uint8_t header[] = {1, 0, 4, 4};
+    out->insert(out->end(), header, header + sizeof(header));
+    AppendSpan(font.names, &unused, out);
+    WriteIndex({top_dict}, false, out);
+    AppendSpan(font.strings, &unused, out);
+  } else {
+    const uint8_t header[] = {2, 0, 5,
+                              static_cast<uint8_t>(top_dict.size() >> 8),
+                              static_cast<uint8_t>(top_dict.size())};
+    out->insert(out->end(), header, header + sizeof(header));
+    out->insert(out->end(), top_dict.begin(), top_dict.end());
+  }
+  WriteIndex({}, font.cff2, out);
+
+  AppendSpan(font.variation_store, &layout->variation_store, out);
+  AppendSpan(font.charset, &layout->charset, out);
+  AppendSpan(font.encoding, &layout->encoding, out);
+  AppendSpan(font.fd_select, &layout->fd_select, out);
+  layout->char_strings = out->size();
+  WriteIndex(font.char_strings, font.cff2, out);
+
+  if (!font.font_dicts.empty()) {
+    std::vector<std::vector<uint8_t> > font_dicts(font.font_dicts.size());
+    for (size_t i = 0; i < font.font_dicts.size(); ++i) {
+      std::map<int, std::vector<uint32_t> > private_offset;
+      private_offset[kPrivateOp] = {offsets.private_sizes[i],
+                                    offsets.private_offsets[i]};
+      WriteDict(font.font_dicts[i], private_offset, &font_dicts[i]);
+    }
+    layout->fd_array = out->size();
+    WriteIndex(font_dicts, font.cff2, out);
+  }
+
+  layout->private_offsets.resize(font.privates.size());
+  layout->private_sizes.resize(font.privates.size());
+  for (size_t i = 0; i < font.privates.size(); ++i) {
+    layout->private_offsets[i] = out->size();
+    WriteDict(font.privates[i].dict, std::map<int, std::vector<uint32_t> >(),
+              out);
+    layout->private_sizes[i] = out->size() - layout->private_offsets[i];
+  }
+}
+
+}  // namespace
+
+bool DesubroutinizeCff(const uint8_t* data, size_t length,
+                       std::vector<uint8_t>* result) {
+  CffFont font;
+  if (!ReadCff(data, length, &font)) {
+    return false;
+  }
+  CffLayout layout = CffLayout();
+  layout.private_offsets.resize(font.privates.size());
+  layout.private_sizes.resize(font.privates.size());
+  CffLayout final_layout;
+  WriteCff(font, layout, result, &final_layout);
+  WriteCff(font, final_layout, result, &layout);
+  return true;
+}
+
+} // namespace woff2
@@ -0,0 +1,29 @@
+/* Copyright 2026 Google Inc. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Rewriting of CFF and CFF2 tables for better compression. */
+
+#ifndef WOFF2_CFF_H_
+#define WOFF2_CFF_H_
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <vector>
+
+namespace woff2 {
+
+// Writes to *result a copy of the CFF or CFF2 table in which every charstring
+// has its subroutine calls expanded in place and the global and local
+// subroutines are dropped, which renders the same but compresses better.
+// Returns false, leaving the table to be kept as is, if the table has no
+// subroutines, uses charstring operators whose effect on the stack can't be
+// followed statically, or can't be parsed.
+bool DesubroutinizeCff(const uint8_t* data, size_t length,
+                       std::vector<uint8_t>* result);
+
+} // namespace woff2
+
+#endif  // WOFF2_CFF_H_
@@ -230,18 +230,50 @@ void StoreInstructions(const Glyph& glyph, size_t* offset, uint8_t* dst) {
 }
 
 bool StoreEndPtsOfContours(const Glyph& glyph, size_t* offset, uint8_t* dst) {
+  // Gather the end points in host order, then swap them all at once.
+  uint8_t* end_points = dst + *offset;
   int end_point = -1;
-  for (const auto& contour : glyph.contours) {
+  for (size_t i = 0; i < glyph.contours.size(); ++i) {
+    const auto& contour = glyph.contours[i];
     end_point += contour.size();
     if (contour.size() > std::numeric_limits<uint16_t>::max() ||
         end_point > std::numeric_limits<uint16_t>::max()) {
       return FONT_COMPRESSION_FAILURE();
     }
-    Store16(end_point, offset, dst);
+    uint16_t value = end_point;
+    memcpy(end_points + 2 * i, &value, 2);
   }
+  ByteSwapU16Array(end_points, glyph.contours.size());
+  *offset += 2 * glyph.contours.size();
   return true;
 }
 
+// Returns the flag of a point, without the repeat and overlap bits, and adds
+// the sizes of its coordinates to *x_bytes and *y_bytes.
+int PointFlag(const Glyph::Point& point, int last_x, int last_y,
+              size_t* x_bytes, size_t* y_bytes) {
+  int flag = point.on_curve ? kFLAG_ONCURVE : 0;
+  int dx = point.x - last_x;
+  int dy = point.y - last_y;
+  if (dx == 0) {
+    flag |= kFLAG_XREPEATSIGN;
+  } else if (dx > -256 && dx < 256) {
+    flag |= kFLAG_XSHORT | (dx > 0 ? kFLAG_XREPEATSIGN : 0);
+    *x_bytes += 1;
+  } else {
+    *x_bytes += 2;
+  }
+  if (dy == 0) {
+    flag |= kFLAG_YREPEATSIGN;
+  } else if (dy > -256 && dy < 256) {
+    flag |= kFLAG_YSHORT | (dy > 0 ? kFLAG_YREPEATSIGN : 0);
+    *y_bytes += 1;
+  } else {
+    *y_bytes += 2;
+  }
+  return flag;
+}
+
 bool StorePoints(const Glyph& glyph, size_t* offset,
                  uint8_t* dst, size_t dst_size) {
   int previous_flag = -1;
@@ -254,29 +286,11 @@ bool StorePoints(const Glyph& glyph, size_t* offset,
   // Store the flags and calculate the total size of the x and y coordinates.
   for (const auto& contour : glyph.contours) {
     for (const auto& point : contour) {
-      int flag = point.on_curve ? kFLAG_ONCURVE : 0;
+      int flag = PointFlag(point, last_x, last_y, &x_bytes, &y_bytes);
       if (previous_flag == -1 && glyph.overlap_simple_flag_set) {
         // First flag needs to have overlap simple bit set.
         flag = flag | kFLAG_OVERLAP_SIMPLE;
       }
-      int dx = point.x - last_x;
-      int dy = point.y - last_y;
-      if (dx == 0) {
-        flag |= kFLAG_XREPEATSIGN;
-      } else if (dx > -256 && dx < 256) {
-        flag |= kFLAG_XSHORT | (dx > 0 ? kFLAG_XREPEATSIGN : 0);
-        x_bytes += 1;
-      } else {
-        x_bytes += 2;
-      }
-      if (dy == 0) {
-        flag |= kFLAG_YREPEATSIGN;
-      } else if (dy > -256 && dy < 256) {
-        flag |= kFLAG_YSHORT | (dy > 0 ? kFLAG_YREPEATSIGN : 0);
-        y_bytes += 1;
-      } else {
-        y_bytes += 2;
-      }
       if (flag == previous_flag && repeat_count != 255) {
         dst[*offset - 1] |= kFLAG_REPEAT;
         repeat_count++;
@@ -342,6 +356,45 @@ bool StorePoints(const Glyph& glyph, size_t* offset,
 
 }  // namespace
 
+size_t StoredGlyphSize(const Glyph& glyph) {
+  if (glyph.composite_data_size > 0) {
+    return 10 + glyph.composite_data_size +
+        (glyph.have_instructions ? 2 + glyph.instructions_size : 0);
+  }
+  if (glyph.contours.empty()) {
+    return 0;
+  }
+  // Counts the flag bytes the way StorePoints() run-length codes them.
+  size_t flag_bytes = 0;
+  size_t x_bytes = 0;
+  size_t y_bytes = 0;
+  int previous_flag = -1;
+  int repeat_count = 0;
+  int last_x = 0;
+  int last_y = 0;
+  for (const auto& contour : glyph.contours) {
+    for (const auto& point : contour) {
+      int flag = PointFlag(point, last_x, last_y, &x_bytes, &y_bytes);
+      if (previous_flag == -1 && glyph.overlap_simple_flag_set) {
+        flag = flag | kFLAG_OVERLAP_SIMPLE;
+      }
+      if (flag == previous_flag && repeat_count != 255) {
+        if (repeat_count++ == 0) {
+          ++flag_bytes;
+        }
+      } else {
+        ++flag_bytes;
+        repeat_count = 0;
+      }
+      last_x = point.x;
+      last_y = point.y;
+      previous_flag = flag;
+    }
+  }
+  return 12 + 2 * glyph.contours.size() + glyph.instructions_size +
+      flag_bytes + x_bytes + y_bytes;
+}
+
 bool StoreGlyph(const Glyph& glyph, uint8_t* dst, size_t* dst_size) {
   size_t offset = 0;
   if (glyph.composite_data_size > 0) {
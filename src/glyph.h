@@ -66,6 +66,9 @@ bool ReadGlyph(const uint8_t* data, size_t len, Glyph* glyph);
 // Returns false on buffer overflow.
 bool StoreGlyph(const Glyph& glyph, uint8_t* dst, size_t* dst_size);
 
+// Returns the (unpadded) size StoreGlyph() stores the glyph in.
+size_t StoredGlyphSize(const Glyph& glyph);
+
 } // namespace woff2
 
 #endif  // WOFF2_GLYPH_H_
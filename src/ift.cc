@@ -0,0 +1,599 @@
+/* Copyright 2026 Google Inc. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Glyph-keyed patches for Incremental Font Transfer. */
+
+#include <woff2/ift.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <set>
+#include <utility>
+
+#include <brotli/decode.h>
+#include <brotli/encode.h>
+
+#include "./buffer.h"
+#include "./font.h"
+#include "./normalize.h"
+#include "./port.h"
+#include "./round.h"
+#include "./store_bytes.h"
+#include "./table_tags.h"
+#include "./woff2_common.h"
+
+namespace woff2 {
+
+namespace {
+
+// Patch map ('IFT ' table) format 1, mapping glyph ids to entries.
+const uint8_t kPatchMapFormat = 1;
+const size_t kPatchMapCompatibilityIdOffset = 4;
+// Patch format of the entries, glyph keyed.
+const uint8_t kGlyphKeyedPatchFormat = 3;
+const uint32_t kGlyphKeyedPatchTag = 0x6966676b;  // "ifgk"
+const size_t kCompatibilityIdSize = 16;
+const size_t kGlyphKeyedPatchHeaderSize = 4 + 4 + 1 + kCompatibilityIdSize + 4;
+// GlyphPatches flag: glyph ids are stored as uint24 rather than uint16.
+const uint8_t kGlyphIdsAreWide = 1;
+// Upper bound on the decompressed size of a patch we accept.
+const uint32_t kMaxGlyphPatchesSize = 256 * 1024 * 1024;
+const size_t kIndexToLocFormatOffset = 51;
+
+// Glyph data of one table, by glyph id.
+typedef std::vector<std::pair<const uint8_t*, size_t> > GlyphSpans;
+
+// What we keep of gvar besides the glyph variation data.
+struct GvarLayout {
+  const uint8_t* header;  // kGvarHeaderSize bytes
+  bool long_offsets;
+  // Bytes between the offsets and the glyph variation data, where the shared
+  // tuples live.
+  const uint8_t* shared;
+  size_t shared_size;
+  uint32_t shared_tuples_offset;  // from the start of shared
+};
+
+uint64_t Fnv1aHash(const uint8_t* data, size_t length, uint64_t hash) {
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= data[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+bool ReadGlyfSpans(const Font& font, int num_glyphs, GlyphSpans* spans) {
+  spans->resize(num_glyphs);
+  for (int i = 0; i < num_glyphs; ++i) {
+    if (!GetGlyphData(font, i, &(*spans)[i].first, &(*spans)[i].second)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+  }
+  return true;
+}
+
+// Parses gvar. Only the usual layout is supported: header, offsets, shared
+// tuples, then the glyph variation data.
+bool ReadGvarSpans(const Font::Table& gvar, int num_glyphs,
+                   GvarLayout* layout, GlyphSpans* spans) {
+  Buffer file(gvar.data, gvar.length);
+  uint16_t axis_count, shared_tuple_count, glyph_count, flags;
+  uint32_t shared_tuples_offset, data_offset;
+  if (!file.Skip(4) || !file.ReadU16(&axis_count) ||
+      !file.ReadU16(&shared_tuple_count) ||
+      !file.ReadU32(&shared_tuples_offset) || !file.ReadU16(&glyph_count) ||
+      !file.ReadU16(&flags) || !file.ReadU32(&data_offset) ||
+      glyph_count != num_glyphs) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  layout->header = gvar.data;
+  layout->long_offsets = flags & 1;
+  std::vector<uint32_t> offsets(glyph_count + 1);
+  for (size_t i = 0; i <= glyph_count; ++i) {
+    uint16_t short_offset;
+    if (layout->long_offsets ? !file.ReadU32(&offsets[i])
+                             : !file.ReadU16(&short_offset)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    if (!layout->long_offsets) {
+      offsets[i] = 2 * short_offset;
+    }
+  }
+  const size_t offsets_end = file.offset();
+  const size_t shared_tuples_size = 2ULL * axis_count * shared_tuple_count;
+  if (data_offset < offsets_end || data_offset > gvar.length ||
+      (shared_tuples_size > 0 &&
+       (shared_tuples_offset < offsets_end ||
+        shared_tuples_offset + shared_tuples_size > data_offset))) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  layout->shared = gvar.data + offsets_end;
+  layout->shared_size = data_offset - offsets_end;
+  layout->shared_tuples_offset =
+      shared_tuples_size > 0 ? shared_tuples_offset - offsets_end : 0;
+
+  spans->resize(glyph_count);
+  for (size_t i = 0; i < glyph_count; ++i) {
+    if (offsets[i + 1] < offsets[i] ||
+        offsets[i + 1] > gvar.length - data_offset) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    (*spans)[i].first = gvar.data + data_offset + offsets[i];
+    (*spans)[i].second = offsets[i + 1] - offsets[i];
+  }
+  return true;
+}
+
+// Writes glyf and loca for the given glyphs, in the short loca format if
+// *index_format asks for it and the glyphs fit, else in the long one.
+void WriteGlyfLoca(const GlyphSpans& spans, int* index_format,
+                   std::vector<uint8_t>* glyf, std::vector<uint8_t>* loca) {
+  std::vector<uint32_t> loca_values(spans.size() + 1);
+  size_t glyf_size = 0;
+  for (size_t i = 0; i < spans.size(); ++i) {
+    loca_values[i] = glyf_size;
+    glyf_size += Round4(spans[i].second);
+  }
+  loca_values[spans.size()] = glyf_size;
+  if (glyf_size >= (1UL << 17)) {
+    *index_format = 1;
+  }
+
+  glyf->assign(glyf_size, 0);
+  for (size_t i = 0; i < spans.size(); ++i) {
+    if (spans[i].second > 0) {
+      memcpy(&(*glyf)[loca_values[i]], spans[i].first, spans[i].second);
+    }
+  }
+  if (*index_format == 0) {
+    std::vector<uint16_t> short_values(loca_values.size());
+    for (size_t i = 0; i < loca_values.size(); ++i) {
+      short_values[i] = loca_values[i] >> 1;
+    }
+    loca->resize(2 * short_values.size());
+    StoreU16Array(&(*loca)[0], 0, short_values.data(), short_values.size());
+  } else {
+    loca->resize(4 * loca_values.size());
+    StoreU32Array(&(*loca)[0], 0, loca_values.data(), loca_values.size());
+  }
+}
+
+// Writes gvar for the given glyph variation data, keeping the short offset
+// format when the data allows it.
+void WriteGvar(const GvarLayout& layout, const GlyphSpans& spans,
+               std::vector<uint8_t>* gvar) {
+  std::vector<uint32_t> offsets(spans.size() + 1);
+  bool long_offsets = layout.long_offsets;
+  uint32_t data_size = 0;
+  for (size_t i = 0; i < spans.size(); ++i) {
+    offsets[i] = data_size;
+    data_size += spans[i].second;
+    long_offsets |= (spans[i].second & 1) != 0;
+  }
+  offsets[spans.size()] = data_size;
+  long_offsets |= data_size >= (1UL << 17);
+
+  const size_t offsets_size = offsets.size() * (long_offsets ? 4 : 2);
+  const uint32_t shared_start = kGvarHeaderSize + offsets_size;
+  const uint32_t data_offset = shared_start + layout.shared_size;
+  gvar->assign(data_offset + data_size, 0);
+  uint8_t* dst = &(*gvar)[0];
+  memcpy(dst, layout.header, kGvarHeaderSize);
+  StoreU32(dst, 8, shared_start + layout.shared_tuples_offset);
+  uint16_t flags = (layout.header[14] << 8) | layout.header[15];
+  Store16(dst, 14, long_offsets ? flags | 1 : flags & ~1);
+  StoreU32(dst, 16, data_offset);
+  if (long_offsets) {
+    StoreU32Array(dst, kGvarHeaderSize, offsets.data(), offsets.size());
+  } else {
+    std::vector<uint16_t> short_offsets(offsets.size());
+    for (size_t i = 0; i < offsets.size(); ++i) {
+      short_offsets[i] = offsets[i] >> 1;
+    }
+    StoreU16Array(dst, kGvarHeaderSize, short_offsets.data(),
+                  short_offsets.size());
+  }
+  if (layout.shared_size > 0) {
+    memcpy(dst + shared_start, layout.shared, layout.shared_size);
+  }
+  size_t offset = data_offset;
+  for (const auto& span : spans) {
+    if (span.second > 0) {
+      memcpy(dst + offset, span.first, span.second);
+    }
+    offset += span.second;
+  }
+}
+
+void SetTableData(Font* font, uint32_t tag, std::vector<uint8_t>* data) {
+  if (font->FindTable(tag) == NULL) {
+    Font::Table& table = font->tables[tag];
+    table.tag = tag;
+    table.checksum = 0;
+    table.offset = 0;
+    table.reuse_of = NULL;
+    table.flag_byte = 0;
+    font->num_tables = font->tables.size();
+  }
+  Font::Table& table = font->tables[tag];
+  table.buffer.swap(*data);
+  table.length = table.buffer.size();
+  table.data = table.buffer.empty() ? NULL : &table.buffer[0];
+}
+
+bool MakeEditable(Font::Table* table) {
+  if (table->buffer.empty()) {
+    table->buffer.assign(table->data, table->data + table->length);
+    table->buffer.resize(Round4(table->length));
+    table->data = &table->buffer[0];
+  }
+  return true;
+}
+
+// Writes the glyf, loca and gvar tables for the spans, then serializes the
+// font.
+bool FinishFont(Font* font, const GlyphSpans& glyf_spans,
+                const GvarLayout* gvar_layout, const GlyphSpans& gvar_spans,
+                std::string* result) {
+  Font::Table* head_table = font->FindTable(kHeadTableTag);
+  if (head_table == NULL || head_table->length <= kIndexToLocFormatOffset ||
+      !MakeEditable(head_table)) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  int index_format = head_table->buffer[kIndexToLocFormatOffset];
+  std::vector<uint8_t> glyf, loca;
+  WriteGlyfLoca(glyf_spans, &index_format, &glyf, &loca);
+  head_table->buffer[kIndexToLocFormatOffset] = index_format;
+  if (gvar_layout != NULL) {
+    std::vector<uint8_t> gvar;
+    WriteGvar(*gvar_layout, gvar_spans, &gvar);
+    SetTableData(font, kGvarTableTag, &gvar);
+  }
+  SetTableData(font, kGlyfTableTag, &glyf);
+  SetTableData(font, kLocaTableTag, &loca);
+
+  if (!NormalizeOffsets(font) || !FixChecksums(font)) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  result->assign(FontFileSize(*font), 0);
+  if (!WriteFont(*font, reinterpret_cast<uint8_t*>(&(*result)[0]),
+                 result->size())) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  return true;
+}
+
+// The patch map, with every glyph of patch i mapped to entry i + 1.
+std::vector<uint8_t> PatchMap(const IFTGlyphKeyedParams& params,
+                              int num_glyphs,
+                              const uint8_t* compatibility_id) {
+  const uint16_t max_entry_index = params.patch_glyphs.size();
+  std::vector<uint16_t> entries(num_glyphs, 0);
+  for (size_t i = 0; i < params.patch_glyphs.size(); ++i) {
+    for (uint16_t glyph_id : params.patch_glyphs[i]) {
+      entries[glyph_id] = i + 1;
+    }
+  }
+  uint16_t first_mapped_glyph = 0;
+  while (first_mapped_glyph < num_glyphs && entries[first_mapped_glyph] == 0) {
+    ++first_mapped_glyph;
+  }
+  const bool wide_entries = max_entry_index > 0xff;
+  const size_t bitmap_size = (max_entry_index + 8) / 8;
+  const size_t header_size = 1 + 3 + kCompatibilityIdSize + 2 + 2 + 3 + 4 +
+      4 + bitmap_size + 2 + params.uri_template.size() + 1;
+  const size_t glyph_map_size = 2 +
+      (num_glyphs - first_mapped_glyph) * (wide_entries ? 2 : 1);
+
+  std::vector<uint8_t> map(header_size + glyph_map_size, 0);
+  uint8_t* dst = &map[0];
+  size_t offset = 0;
+  dst[offset++] = kPatchMapFormat;
+  offset += 3;  // reserved
+  StoreBytes(compatibility_id, kCompatibilityIdSize, &offset, dst);
+  Store16(max_entry_index, &offset, dst);
+  Store16(max_entry_index, &offset, dst);  // maxGlyphMapEntryIndex
+  dst[offset++] = num_glyphs >> 16;
+  Store16(num_glyphs & 0xffff, &offset, dst);
+  StoreU32(header_size, &offset, dst);  // glyphMapOffset
+  StoreU32(0, &offset, dst);  // featureMapOffset, none
+  offset += bitmap_size;  // appliedEntriesBitMap, nothing applied yet
+  Store16(params.uri_template.size(), &offset, dst);
+  StoreBytes(reinterpret_cast<const uint8_t*>(params.uri_template.data()),
+             params.uri_template.size(), &offset, dst);
+  dst[offset++] = kGlyphKeyedPatchFormat;
+
+  Store16(first_mapped_glyph, &offset, dst);
+  for (int i = first_mapped_glyph; i < num_glyphs; ++i) {
+    if (wide_entries) {
+      Store16(entries[i], &offset, dst);
+    } else {
+      dst[offset++] = entries[i];
+    }
+  }
+  return map;
+}
+
+// Builds the glyph-keyed patch carrying the given tables' data for glyph_ids.
+bool GlyphKeyedPatch(const std::vector<uint16_t>& glyph_ids,
+                     const std::vector<std::pair<uint32_t,
+                                                 const GlyphSpans*> >& tables,
+                     const uint8_t* compatibility_id, int quality,
+                     std::string* patch) {
+  const size_t num_offsets = glyph_ids.size() * tables.size() + 1;
+  size_t data_size = 0;
+  for (const auto& table : tables) {
+    for (uint16_t glyph_id : glyph_ids) {
+      data_size += (*table.second)[glyph_id].second;
+    }
+  }
+  const size_t header_size = 4 + 1 + 2 * glyph_ids.size() +
+      4 * tables.size() + 4 * num_offsets;
+  if (header_size + data_size > kMaxGlyphPatchesSize) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+
+  // GlyphPatches: the data of every glyph of the first table, then of every
+  // glyph of the next one, and so on.
+  std::vector<uint8_t> glyph_patches(header_size + data_size);
+  uint8_t* dst = &glyph_patches[0];
+  size_t offset = 0;
+  StoreU32(glyph_ids.size(), &offset, dst);
+  dst[offset++] = tables.size();
+  StoreU16Array(glyph_ids.data(), glyph_ids.size(), &offset, dst);
+  for (const auto& table : tables) {
+    StoreU32(table.first, &offset, dst);
+  }
+  uint32_t data_offset = header_size;
+  size_t data_end = header_size;
+  for (const auto& table : tables) {
+    for (uint16_t glyph_id : glyph_ids) {
+      StoreU32(data_offset, &offset, dst);
+      const auto& span = (*table.second)[glyph_id];
+      StoreBytes(span.first, span.second, &data_end, dst);
+      data_offset += span.second;
+    }
+  }
+  StoreU32(data_offset, &offset, dst);
+
+  size_t compressed_size = BrotliEncoderMaxCompressedSize(glyph_patches.size());
+  patch->assign(kGlyphKeyedPatchHeaderSize + compressed_size, 0);
+  uint8_t* out = reinterpret_cast<uint8_t*>(&(*patch)[0]);
+  if (!BrotliEncoderCompress(quality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_FONT,
+                             glyph_patches.size(), glyph_patches.data(),
+                             &compressed_size,
+                             out + kGlyphKeyedPatchHeaderSize)) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  patch->resize(kGlyphKeyedPatchHeaderSize + compressed_size);
+  offset = 0;
+  StoreU32(kGlyphKeyedPatchTag, &offset, out);
+  StoreU32(0, &offset, out);  // reserved
+  out[offset++] = 0;  // flags, glyph ids are uint16
+  StoreBytes(compatibility_id, kCompatibilityIdSize, &offset, out);
+  StoreU32(glyph_patches.size(), &offset, out);  // maxUncompressedLength
+  return true;
+}
+
+}  // namespace
+
+bool CreateGlyphKeyedPatches(const uint8_t* data, size_t length,
+                             const IFTGlyphKeyedParams& params,
+                             IFTGlyphKeyedFont* result) {
+  Font font;
+  if (!ReadFont(data, length, &font) || !NormalizeFont(&font) ||
+      font.FindTable(kGlyfTableTag) == NULL) {
+#ifdef FONT_COMPRESSION_BIN
+    fprintf(stderr, "Glyph keyed patches need a TrueType font.\n");
+#endif
+    return FONT_COMPRESSION_FAILURE();
+  }
+  const int num_glyphs = NumGlyphs(font);
+  if (params.patch_glyphs.size() > 0xffff) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  std::set<uint16_t> patched;
+  for (const auto& glyph_ids : params.patch_glyphs) {
+    for (uint16_t glyph_id : glyph_ids) {
+      if (glyph_id >= num_glyphs || !patched.insert(glyph_id).second) {
+#ifdef FONT_COMPRESSION_BIN
+        fprintf(stderr, "Glyph %d is out of range or in two patches.\n",
+                glyph_id);
+#endif
+        return FONT_COMPRESSION_FAILURE();
+      }
+    }
+  }
+
+  GlyphSpans glyf_spans;
+  if (!ReadGlyfSpans(font, num_glyphs, &glyf_spans)) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  const Font::Table* gvar_table = font.FindTable(kGvarTableTag);
+  GvarLayout gvar_layout;
+  GlyphSpans gvar_spans;
+  if (gvar_table != NULL &&
+      !ReadGvarSpans(*gvar_table, num_glyphs, &gvar_layout, &gvar_spans)) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+
+  // Identifies the base font, so patches only apply to the font they were
+  // cut from.
+  uint8_t compatibility_id[kCompatibilityIdSize];
+  size_t offset = 0;
+  uint64_t hash = Fnv1aHash(data, length, 0xcbf29ce484222325ULL);
+  for (const auto& glyph_ids : params.patch_glyphs) {
+    hash = Fnv1aHash(reinterpret_cast<const uint8_t*>(glyph_ids.data()),
+                     2 * glyph_ids.size(), hash);
+  }
+  uint64_t hash2 = Fnv1aHash(reinterpret_cast<const uint8_t*>(&hash),
+                             sizeof(hash), 0x84222325cbf29ce4ULL);
+  StoreU32(hash >> 32, &offset, compatibility_id);
+  StoreU32(hash, &offset, compatibility_id);
+  StoreU32(hash2 >> 32, &offset, compatibility_id);
+  StoreU32(hash2, &offset, compatibility_id);
+
+  std::vector<std::pair<uint32_t, const GlyphSpans*> > tables;
+  tables.push_back(std::make_pair(kGlyfTableTag, &glyf_spans));
+  if (gvar_table != NULL) {
+    tables.push_back(std::make_pair(kGvarTableTag, &gvar_spans));
+  }
+  result->patches.resize(params.patch_glyphs.size());
+  for (size_t i = 0; i < params.patch_glyphs.size(); ++i) {
+    std::vector<uint16_t> glyph_ids = params.patch_glyphs[i];
+    std::sort(glyph_ids.begin(), glyph_ids.end());
+    if (!GlyphKeyedPatch(glyph_ids, tables, compatibility_id,
+                         params.brotli_quality, &result->patches[i])) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+  }
+
+  // The base font has every patched glyph empty. The spans point into font,
+  // so the new tables are built before any of its tables are replaced.
+  GlyphSpans base_glyf = glyf_spans;
+  GlyphSpans base_gvar = gvar_spans;
+  for (uint16_t glyph_id : patched) {
+    base_glyf[glyph_id].second = 0;
+    if (gvar_table != NULL) {
+      base_gvar[glyph_id].second = 0;
+    }
+  }
+  std::vector<uint8_t> patch_map = PatchMap(params, num_glyphs,
+                                            compatibility_id);
+  SetTableData(&font, kIftTableTag, &patch_map);
+  return FinishFont(&font, base_glyf, gvar_table ? &gvar_layout : NULL,
+                    base_gvar, &result->base_font);
+}
+
+bool ApplyGlyphKeyedPatch(const uint8_t* font_data, size_t font_length,
+                          const uint8_t* patch_data, size_t patch_length,
+                          uint16_t entry_index, std::string* result) {
+  Font font;
+  if (!ReadFont(font_data, font_length, &font)) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  Font::Table* patch_map = font.FindTable(kIftTableTag);
+  if (patch_map == NULL ||
+      patch_map->length < kPatchMapCompatibilityIdOffset +
+                          kCompatibilityIdSize + 4 ||
+      patch_map->data[0] != kPatchMapFormat) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  const uint8_t* compatibility_id =
+      patch_map->data + kPatchMapCompatibilityIdOffset;
+  Buffer map(patch_map->data, patch_map->length);
+  uint16_t max_entry_index;
+  if (!map.Skip(kPatchMapCompatibilityIdOffset + kCompatibilityIdSize) ||
+      !map.ReadU16(&max_entry_index) || !map.Skip(2 + 3 + 4 + 4) ||
+      entry_index == 0 || entry_index > max_entry_index) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  const size_t applied_offset = map.offset();
+  if (!map.Skip((max_entry_index + 8) / 8)) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+
+  Buffer patch(patch_data, patch_length);
+  uint32_t tag, reserved, max_length;
+  uint8_t flags;
+  if (!patch.ReadU32(&tag) || tag != kGlyphKeyedPatchTag ||
+      !patch.ReadU32(&reserved) || !patch.ReadU8(&flags) ||
+      patch_length < kGlyphKeyedPatchHeaderSize ||
+      memcmp(patch_data + patch.offset(), compatibility_id,
+             kCompatibilityIdSize) != 0 ||
+      !patch.Skip(kCompatibilityIdSize) || !patch.ReadU32(&max_length) ||
+      max_length > kMaxGlyphPatchesSize) {
+#ifdef FONT_COMPRESSION_BIN
+    fprintf(stderr, "Not a glyph keyed patch for this font.\n");
+#endif
+    return FONT_COMPRESSION_FAILURE();
+  }
+  std::vector<uint8_t> glyph_patches(max_length);
+  size_t glyph_patches_size = max_length;
+  if (BrotliDecoderDecompress(patch_length - patch.offset(),
+                              patch_data + patch.offset(),
+                              &glyph_patches_size, glyph_patches.data()) !=
+      BROTLI_DECODER_RESULT_SUCCESS) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+
+  Buffer patches(glyph_patches.data(), glyph_patches_size);
+  uint32_t glyph_count;
+  uint8_t table_count;
+  if (!patches.ReadU32(&glyph_count) || !patches.ReadU8(&table_count) ||
+      glyph_count > glyph_patches_size) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  std::vector<uint32_t> glyph_ids(glyph_count);
+  for (uint32_t i = 0; i < glyph_count; ++i) {
+    uint16_t glyph_id;
+    if (flags & kGlyphIdsAreWide) {
+      if (!patches.ReadU24(&glyph_ids[i])) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+    } else if (!patches.ReadU16(&glyph_id)) {
+      return FONT_COMPRESSION_FAILURE();
+    } else {
+      glyph_ids[i] = glyph_id;
+    }
+  }
+  std::vector<uint32_t> tags(table_count);
+  std::vector<uint32_t> offsets(glyph_count * table_count + 1);
+  for (uint8_t i = 0; i < table_count; ++i) {
+    if (!patches.ReadU32(&tags[i])) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+  }
+  for (size_t i = 0; i < offsets.size(); ++i) {
+    if (!patches.ReadU32(&offsets[i]) ||
+        (i > 0 && offsets[i] < offsets[i - 1]) ||
+        offsets[i] > glyph_patches_size) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+  }
+
+  const int num_glyphs = NumGlyphs(font);
+  GlyphSpans glyf_spans, gvar_spans;
+  GvarLayout gvar_layout;
+  const Font::Table* gvar_table = font.FindTable(kGvarTableTag);
+  if (!ReadGlyfSpans(font, num_glyphs, &glyf_spans) ||
+      (gvar_table != NULL &&
+       !ReadGvarSpans(*gvar_table, num_glyphs, &gvar_layout, &gvar_spans))) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  for (uint8_t i = 0; i < table_count; ++i) {
+    GlyphSpans* spans;
+    if (tags[i] == kGlyfTableTag) {
+      spans = &glyf_spans;
+    } else if (tags[i] == kGvarTableTag && gvar_table != NULL) {
+      spans = &gvar_spans;
+    } else {
+#ifdef FONT_COMPRESSION_BIN
+      fprintf(stderr, "Unsupported table 0x%08x in patch.\n", tags[i]);
+#endif
+      return FONT_COMPRESSION_FAILURE();
+    }
+    for (uint32_t j = 0; j < glyph_count; ++j) {
+      if (glyph_ids[j] >= static_cast<uint32_t>(num_glyphs)) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      const size_t index = static_cast<size_t>(i) * glyph_count + j;
+      (*spans)[glyph_ids[j]].first = glyph_patches.data() + offsets[index];
+      (*spans)[glyph_ids[j]].second = offsets[index + 1] - offsets[index];
+    }
+  }
+
+  if (!MakeEditable(patch_map)) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  patch_map->buffer[applied_offset + entry_index / 8] |=
+      1 << (entry_index % 8);
+  return FinishFont(&font, glyf_spans, gvar_table ? &gvar_layout : NULL,
+                    gvar_spans, result);
+}
+
+} // namespace woff2
@@ -10,6 +10,7 @@
 
 #include <inttypes.h>
 #include <stddef.h>
+#include <vector>
 
 #include "./buffer.h"
 #include "./port.h"
@@ -24,12 +25,16 @@ namespace woff2 {
 
 namespace {
 
-void StoreLoca(int index_fmt, uint32_t value, size_t* offset, uint8_t* dst) {
+size_t StoreLoca(int index_fmt, const std::vector<uint32_t>& loca_values,
+                 uint8_t* dst) {
   if (index_fmt == 0) {
-    Store16(value >> 1, offset, dst);
-  } else {
-    StoreU32(value, offset, dst);
+    std::vector<uint16_t> short_values(loca_values.size());
+    for (size_t i = 0; i < loca_values.size(); ++i) {
+      short_values[i] = loca_values[i] >> 1;
+    }
+    return StoreU16Array(dst, 0, short_values.data(), short_values.size());
   }
+  return StoreU32Array(dst, 0, loca_values.data(), loca_values.size());
 }
 
 }  // namespace
@@ -47,10 +52,10 @@ bool WriteNormalizedLoca(int index_fmt, int num_glyphs, Font* font) {
   uint8_t* glyf_dst = num_glyphs ? &glyf_table->buffer[0] : NULL;
   uint8_t* loca_dst = &loca_table->buffer[0];
   uint32_t glyf_offset = 0;
-  size_t loca_offset = 0;
+  std::vector<uint32_t> loca_values(num_glyphs + 1);
 
   for (int i = 0; i < num_glyphs; ++i) {
-    StoreLoca(index_fmt, glyf_offset, &loca_offset, loca_dst);
+    loca_values[i] = glyf_offset;
     Glyph glyph;
     const uint8_t* glyph_data;
     size_t glyph_size;
@@ -71,7 +76,8 @@ bool WriteNormalizedLoca(int index_fmt, int num_glyphs, Font* font) {
     glyf_offset += glyf_dst_size;
   }
 
-  StoreLoca(index_fmt, glyf_offset, &loca_offset, loca_dst);
+  loca_values[num_glyphs] = glyf_offset;
+  size_t loca_offset = StoreLoca(index_fmt, loca_values, loca_dst);
 
   glyf_table->buffer.resize(glyf_offset);
   glyf_table->data = glyf_offset ? &glyf_table->buffer[0] : NULL;
@@ -217,9 +223,11 @@ bool FixChecksums(Font* font) {
   for (auto& i : font->tables) {
     Font::Table* table = &i.second;
     if (table->IsReused()) {
+      // Already summed along with the earlier font that has it first.
       table = table->reuse_of;
+    } else {
+      table->checksum = ComputeULongSum(table->data, table->length);
     }
-    table->checksum = ComputeULongSum(table->data, table->length);
     file_checksum += table->checksum;
 
     if (table->tag == kHeadTableTag) {
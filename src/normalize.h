@@ -22,7 +22,8 @@ struct FontCollection;
 bool NormalizeOffsets(Font* font);
 
 // Changes the checksum fields of the table headers and the checksum field of
-// the head table so that it matches the current data.
+// the head table so that it matches the current data. Tables a collection font
+// shares with an earlier font keep the checksum computed for that font.
 bool FixChecksums(Font* font);
 
 // Parses each of the glyphs in the font and writes them again to the glyf
@@ -0,0 +1,335 @@
+/* Copyright 2026 Google Inc. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Packs of many WOFF2 files in one file. */
+
+#include <woff2/pack.h>
+
+#include <string.h>
+#include <limits>
+
+#include "./buffer.h"
+#include "./round.h"
+#include "./store_bytes.h"
+#include "./table_tags.h"
+#include "./variable_length.h"
+#include "./woff2_common.h"
+
+namespace woff2 {
+
+namespace {
+
+// A pack is, with all numbers big endian and all offsets from its start:
+//
+//   header       UInt32 signature, UInt16 majorVersion, UInt16 minorVersion,
+//                UInt32 numEntries, UInt32 numBuckets, UInt32 tablesOffset,
+//                UInt32 numTableRecords
+//   entries      numEntries records of kEntrySize bytes: UInt32 nameHash
+//                (high, low), UInt32 nameOffset, UInt16 nameLength,
+//                UInt16 numTables, UInt32 dataOffset, UInt32 dataLength,
+//                UInt32 flavor, UInt32 totalSfntSize, UInt32 firstTable,
+//                UInt16 numFonts, UInt16 reserved
+//   buckets      numBuckets UInt32s, a power of two of them: a hash table of
+//                entry index + 1, 0 for empty, probed linearly from the
+//                bucket the low bits of nameHash pick
+//   tables       at tablesOffset, numTableRecords records of kTableSize
+//                bytes, each entry's numTables from its firstTable on:
+//                UInt32 tag, UInt8 transformVersion, UInt8 reserved[3],
+//                UInt32 origLength, UInt32 transformLength
+//   names        each NUL terminated
+//   files        the WOFF2 files, each at a multiple of 4
+const uint32_t kPackSignature = 0x774f4650;  // "wOFP"
+const uint16_t kPackMajorVersion = 1;
+const size_t kPackHeaderSize = 24;
+const size_t kEntrySize = 40;
+const size_t kTableSize = 16;
+
+const size_t kWoff2HeaderSize = 48;
+
+uint64_t Fnv1aHash(const char* data, size_t length) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= static_cast<uint8_t>(data[i]);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+uint32_t LoadU32(const uint8_t* p) {
+  return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) |
+      p[3];
+}
+
+uint16_t LoadU16(const uint8_t* p) {
+  return (p[0] << 8) | p[1];
+}
+
+// Whether [offset, offset + size) lies within length bytes.
+bool InBounds(uint64_t offset, uint64_t size, size_t length) {
+  return offset <= length && size <= length - offset;
+}
+
+}  // namespace
+
+bool WOFF2PackWriter::Add(const std::string& name, const uint8_t* data,
+                          size_t length) {
+  if (name.size() > 0xffff) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  for (const File& file : files_) {
+    if (file.name == name) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+  }
+
+  File file;
+  Buffer buffer(data, length);
+  uint32_t signature, reported_length;
+  uint16_t num_tables;
+  if (!buffer.ReadU32(&signature) ||
+      (signature != kWoff2Signature &&
+       signature != kWoff2MultiStreamSignature) ||
+      !buffer.ReadU32(&file.flavor) || !buffer.ReadU32(&reported_length) ||
+      reported_length != length || !buffer.ReadU16(&num_tables) ||
+      num_tables == 0 || !buffer.Skip(2) ||
+      !buffer.ReadU32(&file.total_sfnt_size) ||
+      !buffer.Skip(kWoff2HeaderSize - 20)) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+
+  file.tables.resize(num_tables);
+  for (WOFF2PackTable& table : file.tables) {
+    uint8_t flag_byte;
+    if (!buffer.ReadU8(&flag_byte)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    table.tag = kKnownTags[flag_byte & 0x3f];
+    if ((flag_byte & 0x3f) == 0x3f && !buffer.ReadU32(&table.tag)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    table.transform_version = flag_byte >> 6;
+    if (!ReadBase128(&buffer, &table.orig_length)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    table.transform_length = table.orig_length;
+    // glyf and loca are transformed with version 0, the others without.
+    const bool glyf_or_loca =
+        table.tag == kGlyfTableTag || table.tag == kLocaTableTag;
+    if ((glyf_or_loca ? table.transform_version == 0
+                      : table.transform_version != 0) &&
+        !ReadBase128(&buffer, &table.transform_length)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+  }
+
+  file.num_fonts = 1;
+  if (file.flavor == kTtcFontFlavor) {
+    unsigned int num_fonts;
+    if (!buffer.Skip(4) || !Read255UShort(&buffer, &num_fonts) ||
+        num_fonts == 0) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    file.num_fonts = num_fonts;
+  }
+
+  file.name = name;
+  file.data.assign(reinterpret_cast<const char*>(data), length);
+  files_.push_back(file);
+  return true;
+}
+
+bool WOFF2PackWriter::Finish(std::string* result) const {
+  uint32_t num_buckets = 1;
+  while (num_buckets < 2 * files_.size()) {
+    num_buckets *= 2;
+  }
+  uint64_t num_table_records = 0;
+  uint64_t names_length = 0;
+  for (const File& file : files_) {
+    num_table_records += file.tables.size();
+    names_length += file.name.size() + 1;
+  }
+  const uint64_t tables_offset = kPackHeaderSize +
+      kEntrySize * files_.size() + 4 * static_cast<uint64_t>(num_buckets);
+  uint64_t pack_length = Round4(tables_offset +
+      kTableSize * num_table_records + names_length);
+  for (const File& file : files_) {
+    pack_length = Round4(pack_length + file.data.size());
+  }
+  if (pack_length > std::numeric_limits<uint32_t>::max()) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+
+  std::vector<uint8_t> pack(pack_length, 0);
+  uint8_t* dst = pack.data();
+  size_t offset = 0;
+  StoreU32(kPackSignature, &offset, dst);
+  Store16(kPackMajorVersion, &offset, dst);
+  Store16(0, &offset, dst);  // minorVersion
+  StoreU32(files_.size(), &offset, dst);
+  StoreU32(num_buckets, &offset, dst);
+  StoreU32(tables_offset, &offset, dst);
+  StoreU32(num_table_records, &offset, dst);
+
+  const size_t buckets_offset = kPackHeaderSize + kEntrySize * files_.size();
+  size_t table_offset = tables_offset;
+  size_t name_offset = tables_offset + kTableSize * num_table_records;
+  size_t data_offset = Round4(name_offset + names_length);
+  uint32_t first_table = 0;
+  for (size_t i = 0; i < files_.size(); ++i) {
+    const File& file = files_[i];
+    const uint64_t hash = Fnv1aHash(file.name.data(), file.name.size());
+    StoreU32(hash >> 32, &offset, dst);
+    StoreU32(hash & 0xffffffff, &offset, dst);
+    StoreU32(name_offset, &offset, dst);
+    Store16(file.name.size(), &offset, dst);
+    Store16(file.tables.size(), &offset, dst);
+    StoreU32(data_offset, &offset, dst);
+    StoreU32(file.data.size(), &offset, dst);
+    StoreU32(file.flavor, &offset, dst);
+    StoreU32(file.total_sfnt_size, &offset, dst);
+    StoreU32(first_table, &offset, dst);
+    Store16(file.num_fonts, &offset, dst);
+    Store16(0, &offset, dst);  // reserved
+
+    uint32_t bucket = hash & (num_buckets - 1);
+    while (LoadU32(dst + buckets_offset + 4 * bucket) != 0) {
+      bucket = (bucket + 1) & (num_buckets - 1);
+    }
+    size_t bucket_offset = buckets_offset + 4 * bucket;
+    StoreU32(i + 1, &bucket_offset, dst);
+
+    for (const WOFF2PackTable& table : file.tables) {
+      StoreU32(table.tag, &table_offset, dst);
+      dst[table_offset] = table.transform_version;
+      table_offset += 4;
+      StoreU32(table.orig_length, &table_offset, dst);
+      StoreU32(table.transform_length, &table_offset, dst);
+    }
+    first_table += file.tables.size();
+
+    StoreBytes(reinterpret_cast<const uint8_t*>(file.name.data()),
+               file.name.size(), &name_offset, dst);
+    ++name_offset;  // NUL
+
+    StoreBytes(reinterpret_cast<const uint8_t*>(file.data.data()),
+               file.data.size(), &data_offset, dst);
+    data_offset = Round4(data_offset);
+  }
+
+  result->assign(reinterpret_cast<const char*>(pack.data()), pack.size());
+  return true;
+}
+
+WOFF2PackReader::WOFF2PackReader()
+    : data_(NULL), length_(0), num_entries_(0), num_buckets_(0),
+      tables_offset_(0), num_table_records_(0) {}
+
+bool WOFF2PackReader::Open(const uint8_t* data, size_t length) {
+  num_entries_ = 0;
+  if (length < kPackHeaderSize || LoadU32(data) != kPackSignature ||
+      LoadU16(data + 4) != kPackMajorVersion) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  const uint32_t num_entries = LoadU32(data + 8);
+  const uint32_t num_buckets = LoadU32(data + 12);
+  const uint32_t tables_offset = LoadU32(data + 16);
+  const uint32_t num_table_records = LoadU32(data + 20);
+  // Lookups need an empty bucket to stop at.
+  if (num_buckets == 0 || (num_buckets & (num_buckets - 1)) != 0 ||
+      num_buckets <= num_entries ||
+      !InBounds(kPackHeaderSize, kEntrySize * static_cast<uint64_t>(
+          num_entries) + 4 * static_cast<uint64_t>(num_buckets), length) ||
+      !InBounds(tables_offset,
+                kTableSize * static_cast<uint64_t>(num_table_records),
+                length)) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  data_ = data;
+  length_ = length;
+  num_entries_ = num_entries;
+  num_buckets_ = num_buckets;
+  tables_offset_ = tables_offset;
+  num_table_records_ = num_table_records;
+  return true;
+}
+
+bool WOFF2PackReader::GetEntry(size_t i, WOFF2PackEntry* entry) const {
+  if (i >= num_entries_) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  const uint8_t* record = data_ + kPackHeaderSize + kEntrySize * i;
+  const uint32_t name_offset = LoadU32(record + 8);
+  const uint16_t name_length = LoadU16(record + 12);
+  const uint16_t num_tables = LoadU16(record + 14);
+  const uint32_t data_offset = LoadU32(record + 16);
+  const uint32_t data_length = LoadU32(record + 20);
+  const uint32_t first_table = LoadU32(record + 32);
+  if (!InBounds(name_offset, name_length + 1, length_) ||
+      data_[name_offset + name_length] != 0 ||
+      !InBounds(data_offset, data_length, length_) ||
+      static_cast<uint64_t>(first_table) + num_tables > num_table_records_) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  entry->name = reinterpret_cast<const char*>(data_ + name_offset);
+  entry->name_length = name_length;
+  entry->data = data_ + data_offset;
+  entry->length = data_length;
+  entry->flavor = LoadU32(record + 24);
+  entry->total_sfnt_size = LoadU32(record + 28);
+  entry->num_tables = num_tables;
+  entry->num_fonts = LoadU16(record + 36);
+  return true;
+}
+
+bool WOFF2PackReader::GetTable(size_t i, size_t j,
+                               WOFF2PackTable* table) const {
+  if (i >= num_entries_) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  const uint8_t* record = data_ + kPackHeaderSize + kEntrySize * i;
+  const uint64_t index = static_cast<uint64_t>(LoadU32(record + 32)) + j;
+  if (j >= LoadU16(record + 14) || index >= num_table_records_) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  const uint8_t* table_record = data_ + tables_offset_ + kTableSize * index;
+  table->tag = LoadU32(table_record);
+  table->transform_version = table_record[4];
+  table->orig_length = LoadU32(table_record + 8);
+  table->transform_length = LoadU32(table_record + 12);
+  return true;
+}
+
+bool WOFF2PackReader::Find(const char* name, size_t name_length,
+                           size_t* index) const {
+  if (num_entries_ == 0) {
+    return false;
+  }
+  const uint64_t hash = Fnv1aHash(name, name_length);
+  const uint8_t* buckets = data_ + kPackHeaderSize + kEntrySize * num_entries_;
+  uint32_t bucket = hash & (num_buckets_ - 1);
+  for (uint32_t probes = 0; probes < num_buckets_; ++probes) {
+    const uint32_t entry_index = LoadU32(buckets + 4 * bucket);
+    if (entry_index == 0 || entry_index > num_entries_) {
+      return false;
+    }
+    const uint8_t* record =
+        data_ + kPackHeaderSize + kEntrySize * (entry_index - 1);
+    WOFF2PackEntry entry;
+    if (LoadU32(record) == hash >> 32 &&
+        LoadU32(record + 4) == (hash & 0xffffffff) &&
+        GetEntry(entry_index - 1, &entry) &&
+        entry.name_length == name_length &&
+        memcmp(entry.name, name, name_length) == 0) {
+      *index = entry_index - 1;
+      return true;
+    }
+    bucket = (bucket + 1) & (num_buckets_ - 1);
+  }
+  return false;
+}
+
+} // namespace woff2
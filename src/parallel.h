@@ -0,0 +1,60 @@
+/* Copyright 2026 Google Inc. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Running independent jobs on several threads. */
+
+#ifndef WOFF2_PARALLEL_H_
+#define WOFF2_PARALLEL_H_
+
+#include <stddef.h>
+#include <algorithm>
+#include <atomic>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace woff2 {
+
+// Calls job(i) for every i below num_jobs, on up to num_threads threads
+// counting the calling one, and returns once all calls have. 0 threads means
+// one per core. Jobs must not throw, and must not touch each other's data.
+// If threads can't be started, the jobs run on those that could be.
+template <typename Job>
+void RunParallel(size_t num_jobs, size_t num_threads, const Job& job) {
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  num_threads = std::min(num_threads, num_jobs);
+  if (num_threads <= 1) {
+    for (size_t i = 0; i < num_jobs; ++i) {
+      job(i);
+    }
+    return;
+  }
+  std::atomic<size_t> next(0);
+  auto run = [&]() {
+    for (size_t i = next++; i < num_jobs; i = next++) {
+      job(i);
+    }
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads - 1);
+  for (size_t i = 1; i < num_threads; ++i) {
+    try {
+      threads.emplace_back(run);
+    } catch (const std::system_error&) {
+      break;
+    }
+  }
+  run();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+} // namespace woff2
+
+#endif  // WOFF2_PARALLEL_H_
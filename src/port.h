@@ -10,6 +10,9 @@
 #define WOFF2_PORT_H_
 
 #include <assert.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
 
 namespace woff2 {
 
@@ -63,4 +66,86 @@ inline int Log2Floor(uint32 n) {
 #endif  /* endianness */
 #endif  /* CPU whitelist */
 
+#if defined(WOFF_LITTLE_ENDIAN) && defined(__SSE2__)
+#include <emmintrin.h>
+#define WOFF2_SSE2_BYTE_SWAP
+#elif defined(WOFF_LITTLE_ENDIAN) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define WOFF2_NEON_BYTE_SWAP
+#endif
+
+namespace woff2 {
+
+inline bool IsLittleEndianHost() {
+#if defined(WOFF_LITTLE_ENDIAN)
+  return true;
+#elif defined(WOFF_BIG_ENDIAN)
+  return false;
+#else
+  const uint16_t one = 1;
+  uint8_t first;
+  memcpy(&first, &one, 1);
+  return first == 1;
+#endif
+}
+
+// Converts n big-endian 16-bit values at data to host order in place, or
+// back; a no-op on big-endian hosts. data need not be aligned.
+inline void ByteSwapU16Array(uint8_t* data, size_t n) {
+  if (!IsLittleEndianHost()) {
+    return;
+  }
+  size_t i = 0;
+#if defined(WOFF2_SSE2_BYTE_SWAP)
+  for (; i + 8 <= n; i += 8) {
+    __m128i* p = reinterpret_cast<__m128i*>(data + 2 * i);
+    __m128i v = _mm_loadu_si128(p);
+    _mm_storeu_si128(p, _mm_or_si128(_mm_slli_epi16(v, 8),
+                                     _mm_srli_epi16(v, 8)));
+  }
+#elif defined(WOFF2_NEON_BYTE_SWAP)
+  for (; i + 8 <= n; i += 8) {
+    vst1q_u8(data + 2 * i, vrev16q_u8(vld1q_u8(data + 2 * i)));
+  }
+#endif
+  for (; i < n; ++i) {
+    uint8_t* p = data + 2 * i;
+    uint8_t t = p[0];
+    p[0] = p[1];
+    p[1] = t;
+  }
+}
+
+// Same as ByteSwapU16Array, for 32-bit values.
+inline void ByteSwapU32Array(uint8_t* data, size_t n) {
+  if (!IsLittleEndianHost()) {
+    return;
+  }
+  size_t i = 0;
+#if defined(WOFF2_SSE2_BYTE_SWAP)
+  for (; i + 4 <= n; i += 4) {
+    __m128i* p = reinterpret_cast<__m128i*>(data + 4 * i);
+    __m128i v = _mm_loadu_si128(p);
+    v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    _mm_storeu_si128(p, _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)));
+  }
+#elif defined(WOFF2_NEON_BYTE_SWAP)
+  for (; i + 4 <= n; i += 4) {
+    vst1q_u8(data + 4 * i, vrev32q_u8(vld1q_u8(data + 4 * i)));
+  }
+#endif
+  for (; i < n; ++i) {
+    uint8_t* p = data + 4 * i;
+    uint8_t t = p[0];
+    p[0] = p[3];
+    p[3] = t;
+    t = p[1];
+    p[1] = p[2];
+    p[2] = t;
+  }
+}
+
+} // namespace woff2
+
 #endif  // WOFF2_PORT_H_
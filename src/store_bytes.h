@@ -44,6 +44,37 @@ inline void Store16(int val, size_t* offset, uint8_t* dst) {
   dst[(*offset)++] = val;
 }
 
+// Stores n values as big-endian 16-bit integers.
+inline size_t StoreU16Array(uint8_t* dst, size_t offset,
+                            const uint16_t* values, size_t n) {
+  if (n == 0) {
+    return offset;
+  }
+  memcpy(dst + offset, values, 2 * n);
+  ByteSwapU16Array(dst + offset, n);
+  return offset + 2 * n;
+}
+
+inline size_t StoreU32Array(uint8_t* dst, size_t offset,
+                            const uint32_t* values, size_t n) {
+  if (n == 0) {
+    return offset;
+  }
+  memcpy(dst + offset, values, 4 * n);
+  ByteSwapU32Array(dst + offset, n);
+  return offset + 4 * n;
+}
+
+inline void StoreU16Array(const uint16_t* values, size_t n, size_t* offset,
+                          uint8_t* dst) {
+  *offset = StoreU16Array(dst, *offset, values, n);
+}
+
+inline void StoreU32Array(const uint32_t* values, size_t n, size_t* offset,
+                          uint8_t* dst) {
+  *offset = StoreU32Array(dst, *offset, values, n);
+}
+
 inline void StoreBytes(const uint8_t* data, size_t len,
                        size_t* offset, uint8_t* dst) {
   memcpy(&dst[*offset], data, len);
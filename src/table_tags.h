@@ -19,9 +19,17 @@ static const uint32_t kHeadTableTag = 0x68656164;
 static const uint32_t kLocaTableTag = 0x6c6f6361;
 static const uint32_t kDsigTableTag = 0x44534947;
 static const uint32_t kCffTableTag = 0x43464620;
+static const uint32_t kCff2TableTag = 0x43464632;
 static const uint32_t kHmtxTableTag = 0x686d7478;
 static const uint32_t kHheaTableTag = 0x68686561;
 static const uint32_t kMaxpTableTag = 0x6d617870;
+static const uint32_t kCbdtTableTag = 0x43424454;
+static const uint32_t kSbixTableTag = 0x73626978;
+static const uint32_t kSvgTableTag = 0x53564720;
+static const uint32_t kGvarTableTag = 0x67766172;
+static const uint32_t kColrTableTag = 0x434f4c52;
+static const uint32_t kOs2TableTag = 0x4f532f32;
+static const uint32_t kIftTableTag = 0x49465420;
 
 extern const uint32_t kKnownTags[];
 
@@ -8,16 +8,62 @@
 
 #include "./transform.h"
 
+#include <algorithm>
 #include <complex>  // for std::abs
 
 #include "./buffer.h"
 #include "./font.h"
 #include "./glyph.h"
+#include "./store_bytes.h"
 #include "./table_tags.h"
 #include "./variable_length.h"
+#include "./woff2_common.h"
 
 namespace woff2 {
 
+void WriteTriplet(bool on_curve, int x, int y,
+                  std::vector<uint8_t>* flag_byte_stream,
+                  std::vector<uint8_t>* glyph_stream) {
+  int abs_x = std::abs(x);
+  int abs_y = std::abs(y);
+  int on_curve_bit = on_curve ? 0 : 128;
+  int x_sign_bit = (x < 0) ? 0 : 1;
+  int y_sign_bit = (y < 0) ? 0 : 1;
+  int xy_sign_bits = x_sign_bit + 2 * y_sign_bit;
+  if (x == 0 && abs_y < 1280) {
+    flag_byte_stream->push_back(on_curve_bit +
+                                ((abs_y & 0xf00) >> 7) + y_sign_bit);
+    glyph_stream->push_back(abs_y & 0xff);
+  } else if (y == 0 && abs_x < 1280) {
+    flag_byte_stream->push_back(on_curve_bit + 10 +
+                                ((abs_x & 0xf00) >> 7) + x_sign_bit);
+    glyph_stream->push_back(abs_x & 0xff);
+  } else if (abs_x < 65 && abs_y < 65) {
+    flag_byte_stream->push_back(on_curve_bit + 20 +
+                                ((abs_x - 1) & 0x30) +
+                                (((abs_y - 1) & 0x30) >> 2) +
+                                xy_sign_bits);
+    glyph_stream->push_back((((abs_x - 1) & 0xf) << 4) | ((abs_y - 1) & 0xf));
+  } else if (abs_x < 769 && abs_y < 769) {
+    flag_byte_stream->push_back(on_curve_bit + 84 +
+                                12 * (((abs_x - 1) & 0x300) >> 8) +
+                                (((abs_y - 1) & 0x300) >> 6) + xy_sign_bits);
+    glyph_stream->push_back((abs_x - 1) & 0xff);
+    glyph_stream->push_back((abs_y - 1) & 0xff);
+  } else if (abs_x < 4096 && abs_y < 4096) {
+    flag_byte_stream->push_back(on_curve_bit + 120 + xy_sign_bits);
+    glyph_stream->push_back(abs_x >> 4);
+    glyph_stream->push_back(((abs_x & 0xf) << 4) | (abs_y >> 8));
+    glyph_stream->push_back(abs_y & 0xff);
+  } else {
+    flag_byte_stream->push_back(on_curve_bit + 124 + xy_sign_bits);
+    glyph_stream->push_back(abs_x >> 8);
+    glyph_stream->push_back(abs_x & 0xff);
+    glyph_stream->push_back(abs_y >> 8);
+    glyph_stream->push_back(abs_y & 0xff);
+  }
+}
+
 namespace {
 
 const int FLAG_ARG_1_AND_2_ARE_WORDS = 1 << 0;
@@ -31,10 +77,10 @@ void WriteBytes(std::vector<uint8_t>* out, const uint8_t* data, size_t len) {
   memcpy(&(*out)[offset], data, len);
 }
 
-void WriteBytes(std::vector<uint8_t>* out, const std::vector<uint8_t>& in) {
-  for (size_t i = 0; i < in.size(); ++i) {
-    out->push_back(in[i]);
-  }
+// Appends in to out and releases the memory held by in.
+void WriteAndReleaseBytes(std::vector<uint8_t>* out, std::vector<uint8_t>* in) {
+  WriteBytes(out, in->data(), in->size());
+  std::vector<uint8_t>().swap(*in);
 }
 
 void WriteUShort(std::vector<uint8_t>* out, int value) {
@@ -42,6 +88,13 @@ void WriteUShort(std::vector<uint8_t>* out, int value) {
   out->push_back(value & 255);
 }
 
+void WriteUShortArray(std::vector<uint8_t>* out, const uint16_t* values,
+                      size_t n) {
+  size_t offset = out->size();
+  out->resize(offset + 2 * n);
+  StoreU16Array(out->data(), offset, values, n);
+}
+
 void WriteLong(std::vector<uint8_t>* out, int value) {
   out->push_back((value >> 24) & 255);
   out->push_back((value >> 16) & 255);
@@ -49,199 +102,315 @@ void WriteLong(std::vector<uint8_t>* out, int value) {
   out->push_back(value & 255);
 }
 
-// Glyf table preprocessing, based on
-// GlyfEncoder.java
-class GlyfEncoder {
- public:
-  explicit GlyfEncoder(int num_glyphs)
-      : n_glyphs_(num_glyphs) {
-    bbox_bitmap_.resize(((num_glyphs + 31) >> 5) << 2);
+}  // namespace
+
+GlyfEncoder::GlyfEncoder(int num_glyphs) : n_glyphs_(num_glyphs) {
+  bbox_bitmap_.resize(((num_glyphs + 31) >> 5) << 2);
+}
+
+bool GlyfEncoder::Encode(int glyph_id, const Glyph& glyph) {
+  if (glyph.composite_data_size > 0) {
+    WriteCompositeGlyph(glyph_id, glyph);
+  } else if (glyph.contours.size() > 0) {
+    WriteSimpleGlyph(glyph_id, glyph);
+  } else {
+    WriteUShort(&n_contour_stream_, 0);
+  }
+  return true;
+}
+
+void GlyfEncoder::GetTransformedGlyfBytes(std::vector<uint8_t>* result) {
+  result->reserve(result->size() + 36 + n_contour_stream_.size() +
+                  n_points_stream_.size() + flag_byte_stream_.size() +
+                  glyph_stream_.size() + composite_stream_.size() +
+                  bbox_bitmap_.size() + bbox_stream_.size() +
+                  instruction_stream_.size() + overlap_bitmap_.size());
+  WriteUShort(result, 0);  // Version
+  WriteUShort(result, overlap_bitmap_.empty()
+                          ? 0x00
+                          : FLAG_OVERLAP_SIMPLE_BITMAP);  // Flags
+  WriteUShort(result, n_glyphs_);
+  WriteUShort(result, 0);  // index_format, will be set later
+  WriteLong(result, n_contour_stream_.size());
+  WriteLong(result, n_points_stream_.size());
+  WriteLong(result, flag_byte_stream_.size());
+  WriteLong(result, glyph_stream_.size());
+  WriteLong(result, composite_stream_.size());
+  WriteLong(result, bbox_bitmap_.size() + bbox_stream_.size());
+  WriteLong(result, instruction_stream_.size());
+  WriteAndReleaseBytes(result, &n_contour_stream_);
+  WriteAndReleaseBytes(result, &n_points_stream_);
+  WriteAndReleaseBytes(result, &flag_byte_stream_);
+  WriteAndReleaseBytes(result, &glyph_stream_);
+  WriteAndReleaseBytes(result, &composite_stream_);
+  WriteAndReleaseBytes(result, &bbox_bitmap_);
+  WriteAndReleaseBytes(result, &bbox_stream_);
+  WriteAndReleaseBytes(result, &instruction_stream_);
+  if (!overlap_bitmap_.empty()) {
+    WriteAndReleaseBytes(result, &overlap_bitmap_);
   }
+}
 
-  bool Encode(int glyph_id, const Glyph& glyph) {
-    if (glyph.composite_data_size > 0) {
-      WriteCompositeGlyph(glyph_id, glyph);
-    } else if (glyph.contours.size() > 0) {
-      WriteSimpleGlyph(glyph_id, glyph);
-    } else {
-      WriteUShort(&n_contour_stream_, 0);
+void GlyfEncoder::WriteInstructions(const Glyph& glyph) {
+  Write255UShort(&glyph_stream_, glyph.instructions_size);
+  WriteBytes(&instruction_stream_,
+             glyph.instructions_data, glyph.instructions_size);
+}
+
+bool GlyfEncoder::ShouldWriteSimpleGlyphBbox(const Glyph& glyph) {
+  if (glyph.contours.empty() || glyph.contours[0].empty()) {
+    return glyph.x_min || glyph.y_min || glyph.x_max || glyph.y_max;
+  }
+
+  int16_t x_min = glyph.contours[0][0].x;
+  int16_t y_min = glyph.contours[0][0].y;
+  int16_t x_max = x_min;
+  int16_t y_max = y_min;
+  for (const auto& contour : glyph.contours) {
+    for (const auto& point : contour) {
+      if (point.x < x_min) x_min = point.x;
+      if (point.x > x_max) x_max = point.x;
+      if (point.y < y_min) y_min = point.y;
+      if (point.y > y_max) y_max = point.y;
     }
-    return true;
   }
 
-  void GetTransformedGlyfBytes(std::vector<uint8_t>* result) {
-    WriteUShort(result, 0);  // Version
-    WriteUShort(result, overlap_bitmap_.empty()
-                            ? 0x00
-                            : FLAG_OVERLAP_SIMPLE_BITMAP);  // Flags
-    WriteUShort(result, n_glyphs_);
-    WriteUShort(result, 0);  // index_format, will be set later
-    WriteLong(result, n_contour_stream_.size());
-    WriteLong(result, n_points_stream_.size());
-    WriteLong(result, flag_byte_stream_.size());
-    WriteLong(result, glyph_stream_.size());
-    WriteLong(result, composite_stream_.size());
-    WriteLong(result, bbox_bitmap_.size() + bbox_stream_.size());
-    WriteLong(result, instruction_stream_.size());
-    WriteBytes(result, n_contour_stream_);
-    WriteBytes(result, n_points_stream_);
-    WriteBytes(result, flag_byte_stream_);
-    WriteBytes(result, glyph_stream_);
-    WriteBytes(result, composite_stream_);
-    WriteBytes(result, bbox_bitmap_);
-    WriteBytes(result, bbox_stream_);
-    WriteBytes(result, instruction_stream_);
-    if (!overlap_bitmap_.empty()) {
-      WriteBytes(result, overlap_bitmap_);
+  if (glyph.x_min != x_min)
+    return true;
+  if (glyph.y_min != y_min)
+    return true;
+  if (glyph.x_max != x_max)
+    return true;
+  if (glyph.y_max != y_max)
+    return true;
+
+  return false;
+}
+
+void GlyfEncoder::WriteSimpleGlyph(int glyph_id, const Glyph& glyph) {
+  if (glyph.overlap_simple_flag_set) {
+    EnsureOverlapBitmap();
+    overlap_bitmap_[glyph_id >> 3] |= 0x80 >> (glyph_id & 7);
+  }
+  int num_contours = glyph.contours.size();
+  WriteUShort(&n_contour_stream_, num_contours);
+  if (ShouldWriteSimpleGlyphBbox(glyph)) {
+    WriteBbox(glyph_id, glyph);
+  }
+  for (int i = 0; i < num_contours; i++) {
+    Write255UShort(&n_points_stream_, glyph.contours[i].size());
+  }
+  int lastX = 0;
+  int lastY = 0;
+  for (int i = 0; i < num_contours; i++) {
+    int num_points = glyph.contours[i].size();
+    for (int j = 0; j < num_points; j++) {
+      int x = glyph.contours[i][j].x;
+      int y = glyph.contours[i][j].y;
+      int dx = x - lastX;
+      int dy = y - lastY;
+      WriteTriplet(glyph.contours[i][j].on_curve, dx, dy,
+                   &flag_byte_stream_, &glyph_stream_);
+      lastX = x;
+      lastY = y;
     }
   }
+  if (num_contours > 0) {
+    WriteInstructions(glyph);
+  }
+}
 
- private:
-  void WriteInstructions(const Glyph& glyph) {
-    Write255UShort(&glyph_stream_, glyph.instructions_size);
-    WriteBytes(&instruction_stream_,
-               glyph.instructions_data, glyph.instructions_size);
+void GlyfEncoder::WriteCompositeGlyph(int glyph_id, const Glyph& glyph) {
+  WriteUShort(&n_contour_stream_, -1);
+  WriteBbox(glyph_id, glyph);
+  WriteBytes(&composite_stream_,
+             glyph.composite_data,
+             glyph.composite_data_size);
+  if (glyph.have_instructions) {
+    WriteInstructions(glyph);
   }
+}
 
-  bool ShouldWriteSimpleGlyphBbox(const Glyph& glyph) {
-    if (glyph.contours.empty() || glyph.contours[0].empty()) {
-      return glyph.x_min || glyph.y_min || glyph.x_max || glyph.y_max;
-    }
+void GlyfEncoder::WriteBbox(int glyph_id, const Glyph& glyph) {
+  bbox_bitmap_[glyph_id >> 3] |= 0x80 >> (glyph_id & 7);
+  const int16_t bbox[] = { glyph.x_min, glyph.y_min, glyph.x_max,
+                           glyph.y_max };
+  WriteUShortArray(&bbox_stream_, reinterpret_cast<const uint16_t*>(bbox),
+                   4);
+}
 
-    int16_t x_min = glyph.contours[0][0].x;
-    int16_t y_min = glyph.contours[0][0].y;
-    int16_t x_max = x_min;
-    int16_t y_max = y_min;
-    for (const auto& contour : glyph.contours) {
-      for (const auto& point : contour) {
-        if (point.x < x_min) x_min = point.x;
-        if (point.x > x_max) x_max = point.x;
-        if (point.y < y_min) y_min = point.y;
-        if (point.y > y_max) y_max = point.y;
-      }
-    }
+void GlyfEncoder::EnsureOverlapBitmap() {
+  if (overlap_bitmap_.empty()) {
+    overlap_bitmap_.resize((n_glyphs_ + 7) >> 3);
+  }
+}
 
-    if (glyph.x_min != x_min)
-      return true;
-    if (glyph.y_min != y_min)
-      return true;
-    if (glyph.x_max != x_max)
-      return true;
-    if (glyph.y_max != y_max)
-      return true;
+namespace {
 
-    return false;
+// Private, non-standard gvar transform. The tuple variation data of each
+// glyph is split into a header stream (tuple variation counts and headers), a
+// point number stream (shared and private packed point numbers) and a delta
+// stream (packed deltas), analogous to the glyf substreams. The packed data is
+// moved verbatim, and the offsets array, dataOffset fields and padding are
+// derived when decoding. Layout of the transformed table:
+//   UInt8[20]  gvar header, as in the original table
+//   UInt16     flags, bit 0 set if glyph data is padded to an even length
+//   UInt32     header stream size
+//   UInt32     point stream size
+//   UInt32     delta stream size
+//   F2Dot14[]  shared tuples, as in the original table
+//   UInt8[]    bitmap of glyphs that have variation data, same as glyf bbox
+//   UInt8[]    header stream
+//   UInt8[]    point stream
+//   UInt8[]    delta stream
+// Returns false if the table isn't laid out the way the decoder rebuilds it,
+// in which case it has to be stored untransformed.
+bool TransformGvarData(const uint8_t* data, size_t length, bool padded,
+                       std::vector<uint8_t>* result) {
+  Buffer file(data, length);
+  uint16_t major_version, axis_count, shared_tuple_count, glyph_count, flags;
+  uint32_t shared_tuples_offset, glyph_data_offset;
+  if (!file.ReadU16(&major_version) || major_version != 1 ||
+      !file.Skip(2) ||  // minorVersion
+      !file.ReadU16(&axis_count) || !file.ReadU16(&shared_tuple_count) ||
+      !file.ReadU32(&shared_tuples_offset) || !file.ReadU16(&glyph_count) ||
+      !file.ReadU16(&flags) || !file.ReadU32(&glyph_data_offset)) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  const bool long_offsets = (flags & 1) != 0;
+  if (!long_offsets && !padded) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  const size_t offsets_size =
+      (static_cast<size_t>(glyph_count) + 1) * (long_offsets ? 4 : 2);
+  const size_t shared_tuples_size =
+      static_cast<size_t>(shared_tuple_count) * axis_count * 2;
+  if (shared_tuples_offset != kGvarHeaderSize + offsets_size ||
+      glyph_data_offset != shared_tuples_offset + shared_tuples_size ||
+      glyph_data_offset > length) {
+    return FONT_COMPRESSION_FAILURE();
   }
 
-  void WriteSimpleGlyph(int glyph_id, const Glyph& glyph) {
-    if (glyph.overlap_simple_flag_set) {
-      EnsureOverlapBitmap();
-      overlap_bitmap_[glyph_id >> 3] |= 0x80 >> (glyph_id & 7);
+  std::vector<uint32_t> offsets(glyph_count + 1);
+  for (uint32_t& offset : offsets) {
+    uint16_t short_offset;
+    if (long_offsets ? !file.ReadU32(&offset) : !file.ReadU16(&short_offset)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    if (!long_offsets) {
+      offset = 2 * static_cast<uint32_t>(short_offset);
+    }
+  }
+  // Check every offset up front; the glyph loop below reads the data between
+  // consecutive offsets.
+  const size_t glyph_data_length = length - glyph_data_offset;
+  if (offsets[0] != 0 || offsets[glyph_count] != glyph_data_length) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  for (uint16_t i = 0; i < glyph_count; ++i) {
+    if (offsets[i + 1] < offsets[i] || offsets[i + 1] > glyph_data_length) {
+      return FONT_COMPRESSION_FAILURE();
     }
-    int num_contours = glyph.contours.size();
-    WriteUShort(&n_contour_stream_, num_contours);
-    if (ShouldWriteSimpleGlyphBbox(glyph)) {
-      WriteBbox(glyph_id, glyph);
+  }
+
+  std::vector<uint8_t> bitmap(((glyph_count + 31) >> 5) << 2);
+  std::vector<uint8_t> header_stream;
+  std::vector<uint8_t> point_stream;
+  std::vector<uint8_t> delta_stream;
+  for (uint16_t i = 0; i < glyph_count; ++i) {
+    if (offsets[i + 1] == offsets[i]) {
+      continue;
     }
-    for (int i = 0; i < num_contours; i++) {
-      Write255UShort(&n_points_stream_, glyph.contours[i].size());
+    bitmap[i >> 3] |= 0x80 >> (i & 7);
+    const uint8_t* glyph_data = data + glyph_data_offset + offsets[i];
+    const size_t glyph_size = offsets[i + 1] - offsets[i];
+    Buffer glyph(glyph_data, glyph_size);
+    uint16_t tuple_variation_count, data_offset;
+    if (!glyph.ReadU16(&tuple_variation_count) ||
+        !glyph.ReadU16(&data_offset)) {
+      return FONT_COMPRESSION_FAILURE();
     }
-    int lastX = 0;
-    int lastY = 0;
-    for (int i = 0; i < num_contours; i++) {
-      int num_points = glyph.contours[i].size();
-      for (int j = 0; j < num_points; j++) {
-        int x = glyph.contours[i][j].x;
-        int y = glyph.contours[i][j].y;
-        int dx = x - lastX;
-        int dy = y - lastY;
-        WriteTriplet(glyph.contours[i][j].on_curve, dx, dy);
-        lastX = x;
-        lastY = y;
+    WriteUShort(&header_stream, tuple_variation_count);
+
+    const int num_tuples = tuple_variation_count & 0x0fff;
+    std::vector<uint16_t> data_sizes(num_tuples);
+    std::vector<bool> private_points(num_tuples);
+    for (int j = 0; j < num_tuples; ++j) {
+      uint16_t tuple_index;
+      const size_t header_start = glyph.offset();
+      if (!glyph.ReadU16(&data_sizes[j]) || !glyph.ReadU16(&tuple_index)) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      size_t num_coordinates = 0;
+      if (tuple_index & 0x8000) num_coordinates += axis_count;  // peak
+      if (tuple_index & 0x4000) num_coordinates += 2 * axis_count;  // region
+      private_points[j] = (tuple_index & 0x2000) != 0;
+      if (!glyph.Skip(2 * num_coordinates)) {
+        return FONT_COMPRESSION_FAILURE();
       }
+      WriteBytes(&header_stream, glyph_data + header_start,
+                 glyph.offset() - header_start);
     }
-    if (num_contours > 0) {
-      WriteInstructions(glyph);
+    if (glyph.offset() != data_offset) {
+      return FONT_COMPRESSION_FAILURE();
     }
-  }
 
-  void WriteCompositeGlyph(int glyph_id, const Glyph& glyph) {
-    WriteUShort(&n_contour_stream_, -1);
-    WriteBbox(glyph_id, glyph);
-    WriteBytes(&composite_stream_,
-               glyph.composite_data,
-               glyph.composite_data_size);
-    if (glyph.have_instructions) {
-      WriteInstructions(glyph);
+    size_t points_length;
+    if (tuple_variation_count & 0x8000) {
+      if (!PackedPointNumbersLength(glyph_data + glyph.offset(),
+                                    glyph_size - glyph.offset(),
+                                    &points_length)) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      WriteBytes(&point_stream, glyph_data + glyph.offset(), points_length);
+      glyph.Skip(points_length);
     }
-  }
-
-  void WriteBbox(int glyph_id, const Glyph& glyph) {
-    bbox_bitmap_[glyph_id >> 3] |= 0x80 >> (glyph_id & 7);
-    WriteUShort(&bbox_stream_, glyph.x_min);
-    WriteUShort(&bbox_stream_, glyph.y_min);
-    WriteUShort(&bbox_stream_, glyph.x_max);
-    WriteUShort(&bbox_stream_, glyph.y_max);
-  }
-
-  void WriteTriplet(bool on_curve, int x, int y) {
-    int abs_x = std::abs(x);
-    int abs_y = std::abs(y);
-    int on_curve_bit = on_curve ? 0 : 128;
-    int x_sign_bit = (x < 0) ? 0 : 1;
-    int y_sign_bit = (y < 0) ? 0 : 1;
-    int xy_sign_bits = x_sign_bit + 2 * y_sign_bit;
-    if (x == 0 && abs_y < 1280) {
-      flag_byte_stream_.push_back(on_curve_bit +
-                                  ((abs_y & 0xf00) >> 7) + y_sign_bit);
-      glyph_stream_.push_back(abs_y & 0xff);
-    } else if (y == 0 && abs_x < 1280) {
-      flag_byte_stream_.push_back(on_curve_bit + 10 +
-                                  ((abs_x & 0xf00) >> 7) + x_sign_bit);
-      glyph_stream_.push_back(abs_x & 0xff);
-    } else if (abs_x < 65 && abs_y < 65) {
-      flag_byte_stream_.push_back(on_curve_bit + 20 +
-                                  ((abs_x - 1) & 0x30) +
-                                  (((abs_y - 1) & 0x30) >> 2) +
-                                  xy_sign_bits);
-      glyph_stream_.push_back((((abs_x - 1) & 0xf) << 4) | ((abs_y - 1) & 0xf));
-    } else if (abs_x < 769 && abs_y < 769) {
-      flag_byte_stream_.push_back(on_curve_bit + 84 +
-                                  12 * (((abs_x - 1) & 0x300) >> 8) +
-                                  (((abs_y - 1) & 0x300) >> 6) + xy_sign_bits);
-      glyph_stream_.push_back((abs_x - 1) & 0xff);
-      glyph_stream_.push_back((abs_y - 1) & 0xff);
-    } else if (abs_x < 4096 && abs_y < 4096) {
-      flag_byte_stream_.push_back(on_curve_bit + 120 + xy_sign_bits);
-      glyph_stream_.push_back(abs_x >> 4);
-      glyph_stream_.push_back(((abs_x & 0xf) << 4) | (abs_y >> 8));
-      glyph_stream_.push_back(abs_y & 0xff);
-    } else {
-      flag_byte_stream_.push_back(on_curve_bit + 124 + xy_sign_bits);
-      glyph_stream_.push_back(abs_x >> 8);
-      glyph_stream_.push_back(abs_x & 0xff);
-      glyph_stream_.push_back(abs_y >> 8);
-      glyph_stream_.push_back(abs_y & 0xff);
+    for (int j = 0; j < num_tuples; ++j) {
+      points_length = 0;
+      if (private_points[j] &&
+          !PackedPointNumbersLength(glyph_data + glyph.offset(),
+                                    glyph_size - glyph.offset(),
+                                    &points_length)) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      if (points_length > data_sizes[j] ||
+          glyph_size - glyph.offset() < data_sizes[j]) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      WriteBytes(&point_stream, glyph_data + glyph.offset(), points_length);
+      WriteBytes(&delta_stream, glyph_data + glyph.offset() + points_length,
+                 data_sizes[j] - points_length);
+      glyph.Skip(data_sizes[j]);
     }
-  }
 
-  void EnsureOverlapBitmap() {
-    if (overlap_bitmap_.empty()) {
-      overlap_bitmap_.resize((n_glyphs_ + 7) >> 3);
+    // Short offsets can only address even lengths; with long offsets some
+    // encoders pad anyway.
+    if (padded && (glyph.offset() & 1) != 0) {
+      uint8_t padding;
+      if (!glyph.ReadU8(&padding) || padding != 0) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+    }
+    if (glyph.offset() != glyph_size) {
+      return FONT_COMPRESSION_FAILURE();
     }
   }
 
-  std::vector<uint8_t> n_contour_stream_;
-  std::vector<uint8_t> n_points_stream_;
-  std::vector<uint8_t> flag_byte_stream_;
-  std::vector<uint8_t> composite_stream_;
-  std::vector<uint8_t> bbox_bitmap_;
-  std::vector<uint8_t> bbox_stream_;
-  std::vector<uint8_t> glyph_stream_;
-  std::vector<uint8_t> instruction_stream_;
-  std::vector<uint8_t> overlap_bitmap_;
-  int n_glyphs_;
-};
+  result->reserve(kGvarHeaderSize + 14 + shared_tuples_size + bitmap.size() +
+                  header_stream.size() + point_stream.size() +
+                  delta_stream.size());
+  WriteBytes(result, data, kGvarHeaderSize);
+  WriteUShort(result, padded ? 1 : 0);
+  WriteLong(result, header_stream.size());
+  WriteLong(result, point_stream.size());
+  WriteLong(result, delta_stream.size());
+  WriteBytes(result, data + shared_tuples_offset, shared_tuples_size);
+  WriteAndReleaseBytes(result, &bitmap);
+  WriteAndReleaseBytes(result, &header_stream);
+  WriteAndReleaseBytes(result, &point_stream);
+  WriteAndReleaseBytes(result, &delta_stream);
+  return true;
+}
 
 }  // namespace
 
@@ -331,15 +500,22 @@ bool TransformHmtxTable(Font* font) {
 
   int num_glyphs = NumGlyphs(*font);
 
-  // Most fonts can be transformed; assume it's a go until proven otherwise
-  std::vector<uint16_t> advance_widths;
-  std::vector<int16_t> proportional_lsbs;
-  std::vector<int16_t> monospace_lsbs;
+  // [0, num_hmetrics) are proportional hMetrics, advance width and lsb
+  // pairs; [num_hmetrics, num_glyphs) are monospace leftSideBearing's.
+  const int num_proportional = std::min<int>(num_hmetrics, num_glyphs);
+  std::vector<uint16_t> h_metrics(2 * num_proportional);
+  std::vector<int16_t> monospace_lsbs(num_glyphs - num_proportional);
+  Buffer hmtx_buf(hmtx_table->data, hmtx_table->length);
+  if (!hmtx_buf.ReadU16Array(h_metrics.data(), h_metrics.size()) ||
+      !hmtx_buf.ReadS16Array(monospace_lsbs.data(), monospace_lsbs.size())) {
+    // A short hmtx can't be transformed; leave it as it is.
+    return true;
+  }
 
+  // Most fonts can be transformed; assume it's a go until proven otherwise
   bool remove_proportional_lsb = true;
   bool remove_monospace_lsb = (num_glyphs - num_hmetrics) > 0;
 
-  Buffer hmtx_buf(hmtx_table->data, hmtx_table->length);
   for (int i = 0; i < num_glyphs; i++) {
     Glyph glyph;
     const uint8_t* glyph_data;
@@ -349,34 +525,16 @@ bool TransformHmtxTable(Font* font) {
       return FONT_COMPRESSION_FAILURE();
     }
 
-    uint16_t advance_width = 0;
-    int16_t lsb = 0;
-
-    if (i < num_hmetrics) {
-      // [0, num_hmetrics) are proportional hMetrics
-      if (!hmtx_buf.ReadU16(&advance_width)) {
-        return FONT_COMPRESSION_FAILURE();
-      }
-
-      if (!hmtx_buf.ReadS16(&lsb)) {
-        return FONT_COMPRESSION_FAILURE();
-      }
-
+    if (i < num_proportional) {
+      int16_t lsb = h_metrics[2 * i + 1];
       if (glyph_size > 0 && glyph.x_min != lsb) {
         remove_proportional_lsb = false;
       }
-
-      advance_widths.push_back(advance_width);
-      proportional_lsbs.push_back(lsb);
     } else {
-      // [num_hmetrics, num_glyphs) are monospace leftSideBearing's
-      if (!hmtx_buf.ReadS16(&lsb)) {
-        return FONT_COMPRESSION_FAILURE();
-      }
+      int16_t lsb = monospace_lsbs[i - num_proportional];
       if (glyph_size > 0 && glyph.x_min != lsb) {
         remove_monospace_lsb = false;
       }
-      monospace_lsbs.push_back(lsb);
     }
 
     // If we know we can't optimize, bail out completely
@@ -385,6 +543,13 @@ bool TransformHmtxTable(Font* font) {
     }
   }
 
+  std::vector<uint16_t> advance_widths(num_proportional);
+  std::vector<uint16_t> proportional_lsbs(num_proportional);
+  for (int i = 0; i < num_proportional; i++) {
+    advance_widths[i] = h_metrics[2 * i];
+    proportional_lsbs[i] = h_metrics[2 * i + 1];
+  }
+
   Font::Table* transformed_hmtx = &font->tables[kHmtxTableTag ^ 0x80808080];
 
   uint8_t flags = 0;
@@ -403,19 +568,14 @@ bool TransformHmtxTable(Font* font) {
   transformed_hmtx->buffer.reserve(transformed_size);
   std::vector<uint8_t>* out = &transformed_hmtx->buffer;
   WriteBytes(out, &flags, 1);
-  for (uint16_t advance_width : advance_widths) {
-    WriteUShort(out, advance_width);
-  }
-
+  WriteUShortArray(out, advance_widths.data(), advance_widths.size());
   if (!remove_proportional_lsb) {
-    for (int16_t lsb : proportional_lsbs) {
-      WriteUShort(out, lsb);
-    }
+    WriteUShortArray(out, proportional_lsbs.data(), proportional_lsbs.size());
   }
   if (!remove_monospace_lsb) {
-    for (int16_t lsb : monospace_lsbs) {
-      WriteUShort(out, lsb);
-    }
+    WriteUShortArray(out,
+                     reinterpret_cast<const uint16_t*>(monospace_lsbs.data()),
+                     monospace_lsbs.size());
   }
 
   transformed_hmtx->tag = kHmtxTableTag ^ 0x80808080;
@@ -427,4 +587,32 @@ bool TransformHmtxTable(Font* font) {
   return true;
 }
 
+bool TransformGvarTable(Font* font) {
+  const Font::Table* gvar_table = font->FindTable(kGvarTableTag);
+  if (gvar_table == NULL || gvar_table->IsReused()) {
+    return true;
+  }
+
+  std::vector<uint8_t> transformed;
+  if (!TransformGvarData(gvar_table->data, gvar_table->length, true,
+                         &transformed) &&
+      !TransformGvarData(gvar_table->data, gvar_table->length, false,
+                         &transformed)) {
+#ifdef FONT_COMPRESSION_BIN
+    fprintf(stderr, "gvar layout not supported by the transform, "
+            "storing it as is.\n");
+#endif
+    return true;
+  }
+
+  Font::Table* transformed_gvar = &font->tables[kGvarTableTag ^ 0x80808080];
+  transformed_gvar->buffer.swap(transformed);
+  transformed_gvar->tag = kGvarTableTag ^ 0x80808080;
+  transformed_gvar->flag_byte = kGvarPrivateTransformVersion << 6;
+  transformed_gvar->length = transformed_gvar->buffer.size();
+  transformed_gvar->data = transformed_gvar->buffer.data();
+
+  return true;
+}
+
 } // namespace woff2
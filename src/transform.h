@@ -9,10 +9,51 @@
 #ifndef WOFF2_TRANSFORM_H_
 #define WOFF2_TRANSFORM_H_
 
+#include <vector>
+
 #include "./font.h"
+#include "./glyph.h"
 
 namespace woff2 {
 
+// Glyf table preprocessing, based on GlyfEncoder.java. Glyphs must be encoded
+// in glyph id order.
+class GlyfEncoder {
+ public:
+  explicit GlyfEncoder(int num_glyphs);
+
+  bool Encode(int glyph_id, const Glyph& glyph);
+
+  // Writes the transformed glyf table to result. Each substream is released
+  // once it has been copied, so the encoder is empty afterwards.
+  void GetTransformedGlyfBytes(std::vector<uint8_t>* result);
+
+ private:
+  void WriteInstructions(const Glyph& glyph);
+  bool ShouldWriteSimpleGlyphBbox(const Glyph& glyph);
+  void WriteSimpleGlyph(int glyph_id, const Glyph& glyph);
+  void WriteCompositeGlyph(int glyph_id, const Glyph& glyph);
+  void WriteBbox(int glyph_id, const Glyph& glyph);
+  void EnsureOverlapBitmap();
+
+  std::vector<uint8_t> n_contour_stream_;
+  std::vector<uint8_t> n_points_stream_;
+  std::vector<uint8_t> flag_byte_stream_;
+  std::vector<uint8_t> composite_stream_;
+  std::vector<uint8_t> bbox_bitmap_;
+  std::vector<uint8_t> bbox_stream_;
+  std::vector<uint8_t> glyph_stream_;
+  std::vector<uint8_t> instruction_stream_;
+  std::vector<uint8_t> overlap_bitmap_;
+  int n_glyphs_;
+};
+
+// Appends the flag byte and data bytes of one point, given relative to the
+// previous one, as in the glyph and flag streams of the transformed glyf.
+void WriteTriplet(bool on_curve, int x, int y,
+                  std::vector<uint8_t>* flag_byte_stream,
+                  std::vector<uint8_t>* glyph_stream);
+
 // Adds the transformed versions of the glyf and loca tables to the font. The
 // transformed loca table has zero length. The tag of the transformed tables is
 // derived from the original tag by flipping the MSBs of every byte.
@@ -21,6 +62,11 @@ bool TransformGlyfAndLocaTables(Font* font);
 // Apply transformation to hmtx table if applicable for this font.
 bool TransformHmtxTable(Font* font);
 
+// Adds the transformed version of the gvar table, using our private,
+// non-standard transform, unless the table's layout doesn't allow it to be
+// rebuilt byte for byte; then the table is left untransformed.
+bool TransformGvarTable(Font* font);
+
 } // namespace woff2
 
 #endif  // WOFF2_TRANSFORM_H_
@@ -83,6 +83,29 @@ bool Read255UShort(Buffer* buf, unsigned int* value) {
   }
 }
 
+size_t Read255UShortsUnchecked(const uint8_t* data, size_t n,
+                               unsigned int* values) {
+  static const int kWordCode = 253;
+  static const int kOneMoreByteCode2 = 254;
+  static const int kOneMoreByteCode1 = 255;
+  static const int kLowestUCode = 253;
+  size_t offset = 0;
+  for (size_t i = 0; i < n; ++i) {
+    const uint8_t code = data[offset++];
+    if (code == kWordCode) {
+      values[i] = (data[offset] << 8) | data[offset + 1];
+      offset += 2;
+    } else if (code == kOneMoreByteCode1) {
+      values[i] = data[offset++] + kLowestUCode;
+    } else if (code == kOneMoreByteCode2) {
+      values[i] = data[offset++] + kLowestUCode * 2;
+    } else {
+      values[i] = code;
+    }
+  }
+  return offset;
+}
+
 bool ReadBase128(Buffer* buf, uint32_t* value) {
   uint32_t result = 0;
   for (size_t i = 0; i < 5; ++i) {
@@ -17,6 +17,11 @@ namespace woff2 {
 
 size_t Size255UShort(uint16_t value);
 bool Read255UShort(Buffer* buf, unsigned int* value);
+// Decodes n 255UInt16 values from data without bounds checks, and returns the
+// number of bytes read. The caller must make 3 * n bytes readable and compare
+// the result against the real data length.
+size_t Read255UShortsUnchecked(const uint8_t* data, size_t n,
+                               unsigned int* values);
 void Write255UShort(std::vector<uint8_t>* out, int value);
 void Store255UShort(int val, size_t* offset, uint8_t* dst);
 
@@ -0,0 +1,413 @@
+/* Copyright 2026 Google Inc. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* A commandline tool for timing conversions and replaying captured ones. */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define WOFF2_HAVE_PERF_EVENTS 1
+#endif
+
+#include "file.h"
+#include <woff2/capture.h>
+#include <woff2/decode.h>
+#include <woff2/encode.h>
+#include <woff2/phase.h>
+
+namespace {
+
+const uint32_t kWoff2Signature = 0x774f4632;  // "wOF2"
+const uint32_t kWoff2MultiStreamSignature = 0x774f464d;  // "wOFM"
+
+enum Counter {
+  kCycles,
+  kInstructions,
+  kBranchMisses,
+  kL1dMisses,
+  kLlcMisses,
+  kNumCounters
+};
+
+// Hardware counters of the calling thread, in user space only. Counters the
+// CPU or kernel doesn't offer (virtual machines often have none, and
+// perf_event_paranoid may forbid them) are left out.
+class PerfCounters {
+ public:
+  PerfCounters() {
+    for (int i = 0; i < kNumCounters; ++i) {
+      fds_[i] = -1;
+    }
+#ifdef WOFF2_HAVE_PERF_EVENTS
+    const uint32_t kL1dReadMiss = PERF_COUNT_HW_CACHE_L1D |
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    const struct {
+      uint32_t type;
+      uint64_t config;
+    } kEvents[kNumCounters] = {
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+      {PERF_TYPE_HW_CACHE, kL1dReadMiss},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    };
+    for (int i = 0; i < kNumCounters; ++i) {
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = kEvents[i].type;
+      attr.config = kEvents[i].config;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      // Counters are multiplexed when there are more than the CPU has; the
+      // times let Read() scale them up.
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+          PERF_FORMAT_TOTAL_TIME_RUNNING;
+      fds_[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1,
+                                         -1, 0));
+      if (fds_[i] < 0 && error_.empty()) {
+        error_ = strerror(errno);
+      }
+    }
+#else
+    error_ = "not supported on this platform";
+#endif
+  }
+
+  ~PerfCounters() {
+#ifdef WOFF2_HAVE_PERF_EVENTS
+    for (int i = 0; i < kNumCounters; ++i) {
+      if (fds_[i] >= 0) {
+        close(fds_[i]);
+      }
+    }
+#endif
+  }
+
+  bool Has(int counter) const { return fds_[counter] >= 0; }
+
+  // Why a counter could not be opened, empty if all were.
+  const std::string& error() const { return error_; }
+
+  // Current values, 0 for counters that aren't available.
+  void Read(double values[kNumCounters]) const {
+    for (int i = 0; i < kNumCounters; ++i) {
+      values[i] = 0;
+#ifdef WOFF2_HAVE_PERF_EVENTS
+      uint64_t data[3];  // value, time enabled, time running
+      if (fds_[i] >= 0 && read(fds_[i], data, sizeof(data)) ==
+          static_cast<ssize_t>(sizeof(data)) && data[2] > 0) {
+        values[i] = static_cast<double>(data[0]) * data[1] / data[2];
+      }
+#endif
+    }
+  }
+
+ private:
+  PerfCounters(const PerfCounters&);
+  void operator=(const PerfCounters&);
+
+  int fds_[kNumCounters];
+  std::string error_;
+};
+
+// Sums the time, work and counter deltas of each phase over many runs.
+class PhaseProfiler : public woff2::WOFF2PhaseObserver {
+ public:
+  explicit PhaseProfiler(const PerfCounters* counters)
+      : counters_(counters), totals_(woff2::kWOFF2NumPhases) {}
+
+  void BeginPhase(woff2::WOFF2Phase) override {
+    start_ = std::chrono::steady_clock::now();
+    counters_->Read(start_values_);
+  }
+
+  void EndPhase(woff2::WOFF2Phase phase, size_t units) override {
+    double values[kNumCounters];
+    counters_->Read(values);
+    Totals& totals = totals_[phase];
+    totals.ms += std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start_).count();
+    totals.units += units;
+    for (int i = 0; i < kNumCounters; ++i) {
+      totals.counters[i] += values[i] - start_values_[i];
+    }
+  }
+
+  void Reset() {
+    totals_.assign(woff2::kWOFF2NumPhases, Totals());
+  }
+
+  // Prints one row per phase that ran, averaged over runs conversions, with
+  // the misses per glyph or per KB.
+  void Print(size_t runs) const {
+    fprintf(stdout, "  %-22s %10s %10s %8s %7s %10s %10s %10s\n", "phase",
+            "ms/run", "units/run", "ns/unit", "IPC", "br-miss", "L1d-miss",
+            "LLC-miss");
+    for (int phase = 0; phase < woff2::kWOFF2NumPhases; ++phase) {
+      const Totals& totals = totals_[phase];
+      if (totals.units == 0) {
+        continue;
+      }
+      const bool glyphs = woff2::WOFF2PhaseCountsGlyphs(
+          static_cast<woff2::WOFF2Phase>(phase));
+      const double units = glyphs ? totals.units : totals.units / 1024;
+      char label[32];
+      snprintf(label, sizeof(label), "%s/%s",
+               woff2::WOFF2PhaseName(static_cast<woff2::WOFF2Phase>(phase)),
+               glyphs ? "glyph" : "KB");
+      fprintf(stdout, "  %-22s %10.3f %10.1f %8.1f", label, totals.ms / runs,
+              units / runs, 1e6 * totals.ms / units);
+      if (counters_->Has(kCycles) && counters_->Has(kInstructions) &&
+          totals.counters[kCycles] > 0) {
+        fprintf(stdout, " %7.2f", totals.counters[kInstructions] /
+                totals.counters[kCycles]);
+      } else {
+        fprintf(stdout, " %7s", "-");
+      }
+      for (int i = kBranchMisses; i <= kLlcMisses; ++i) {
+        if (counters_->Has(i)) {
+          fprintf(stdout, " %10.2f", totals.counters[i] / units);
+        } else {
+          fprintf(stdout, " %10s", "-");
+        }
+      }
+      fprintf(stdout, "\n");
+    }
+  }
+
+ private:
+  struct Totals {
+    Totals() : ms(0), units(0) {
+      for (int i = 0; i < kNumCounters; ++i) {
+        counters[i] = 0;
+      }
+    }
+    double ms;
+    double units;
+    double counters[kNumCounters];
+  };
+
+  const PerfCounters* counters_;
+  std::vector<Totals> totals_;
+  std::chrono::steady_clock::time_point start_;
+  double start_values_[kNumCounters];
+};
+
+void Usage() {
+  fprintf(stderr,
+      "Usage: woff2_bench [-n iterations] [-s seconds] [-c] [-k] [-p] "
+      "[-m streams] [-t threads] input...\n"
+      "  Times each input; .woff2 files are decoded, fonts are encoded and\n"
+      "  .capture files replay the captured conversion with its params.\n"
+      "  -n  run each input at least this many times (default 10)\n"
+      "  -s  keep running each input for at least this many seconds, to\n"
+      "      give a profiler enough samples (default 0)\n"
+      "  -c  decode without computing checksums\n"
+      "  -k  decode into pooled chunks instead of a presized string\n"
+      "  -p  break the timed runs down by phase, with hardware counters\n"
+      "      where perf_event_open allows: IPC, and branch, L1d read and\n"
+      "      last level cache misses per glyph or per KB\n"
+      "  -m  encode fonts in our private multi-stream variant, with up to\n"
+      "      this many Brotli streams, and report the size overhead\n"
+      "  -t  threads to compress or decompress multi-stream files with\n"
+      "      (default 0, one per stream up to the number of cores)\n");
+}
+
+bool IsWoff2(const std::string& data) {
+  if (data.size() < 4) {
+    return false;
+  }
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data.data());
+  const uint32_t signature = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+  return signature == kWoff2Signature ||
+      signature == kWoff2MultiStreamSignature;
+}
+
+bool RunOnce(const std::string& input, bool encode,
+             const woff2::WOFF2Params& params,
+             const woff2::WOFF2DecodeParams& decode_params,
+             woff2::WOFF2ChunkPool* pool, size_t* output_size) {
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(input.data());
+  if (encode) {
+    size_t length = woff2::MaxWOFF2CompressedSize(data, input.size(),
+                                                  params.extended_metadata);
+    std::string output(length, 0);
+    if (!woff2::ConvertTTFToWOFF2(data, input.size(),
+                                  reinterpret_cast<uint8_t*>(&output[0]),
+                                  &length, params)) {
+      return false;
+    }
+    *output_size = length;
+    return true;
+  }
+  if (pool != NULL) {
+    woff2::WOFF2ChunkedOut out(pool);
+    if (!woff2::ConvertWOFF2ToTTF(data, input.size(), &out, decode_params)) {
+      return false;
+    }
+    *output_size = out.Size();
+    return true;
+  }
+  std::string output(std::min(woff2::ComputeWOFF2FinalSize(data, input.size()),
+                               woff2::kDefaultMaxSize), 0);
+  woff2::WOFF2StringOut out(&output);
+  if (!woff2::ConvertWOFF2ToTTF(data, input.size(), &out, decode_params)) {
+    return false;
+  }
+  *output_size = out.Size();
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  int iterations = 10;
+  double min_seconds = 0;
+  int num_streams = 1;
+  woff2::WOFF2DecodeParams decode_params;
+  // The inputs are ours, and may use our private extensions.
+  decode_params.allow_gvar_transform = true;
+  decode_params.allow_multi_stream = true;
+  decode_params.num_threads = 0;
+  std::unique_ptr<woff2::WOFF2ChunkPool> pool;
+  std::unique_ptr<PerfCounters> counters;
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-'; ++arg) {
+    if (strcmp(argv[arg], "-n") == 0 && arg + 1 < argc) {
+      iterations = std::max(1, atoi(argv[++arg]));
+    } else if (strcmp(argv[arg], "-s") == 0 && arg + 1 < argc) {
+      min_seconds = atof(argv[++arg]);
+    } else if (strcmp(argv[arg], "-c") == 0) {
+      decode_params.skip_checksums = true;
+    } else if (strcmp(argv[arg], "-k") == 0) {
+      pool.reset(new woff2::WOFF2ChunkPool());
+    } else if (strcmp(argv[arg], "-p") == 0) {
+      counters.reset(new PerfCounters());
+    } else if (strcmp(argv[arg], "-m") == 0 && arg + 1 < argc) {
+      num_streams = std::max(1, atoi(argv[++arg]));
+    } else if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc) {
+      decode_params.num_threads = std::max(0, atoi(argv[++arg]));
+    } else {
+      Usage();
+      return 1;
+    }
+  }
+  if (arg == argc) {
+    Usage();
+    return 1;
+  }
+  std::unique_ptr<PhaseProfiler> profiler;
+  if (counters) {
+    if (!counters->error().empty()) {
+      fprintf(stderr, "Some hardware counters are unavailable (%s); their "
+              "columns show -.\n", counters->error().c_str());
+    }
+    profiler.reset(new PhaseProfiler(counters.get()));
+  }
+
+  int failures = 0;
+  for (; arg < argc; ++arg) {
+    std::string filename(argv[arg]);
+    woff2::WOFF2Params params;
+    woff2::WOFF2DecodeParams file_decode_params = decode_params;
+    bool encode = false;
+    std::string input_path = filename;
+    const std::string kCaptureSuffix = ".capture";
+    if (filename.size() > kCaptureSuffix.size() &&
+        filename.compare(filename.size() - kCaptureSuffix.size(),
+                         kCaptureSuffix.size(), kCaptureSuffix) == 0) {
+      woff2::WOFF2CaptureRecord record;
+      if (!woff2::ReadWOFF2CaptureRecord(filename, &record)) {
+        fprintf(stderr, "%s: cannot read capture record\n", filename.c_str());
+        ++failures;
+        continue;
+      }
+      encode = record.encode;
+      params = record.params;
+      file_decode_params = record.decode_params;
+      input_path = record.input_path;
+      fprintf(stdout, "%s: captured %s took %.3f ms, +%zu KB peak RSS\n",
+              filename.c_str(), encode ? "encode" : "decode",
+              record.elapsed_ms, record.memory_growth_kb);
+    }
+    std::string input = woff2::GetFileContent(input_path);
+    if (input.empty()) {
+      fprintf(stderr, "%s: cannot read input\n", input_path.c_str());
+      ++failures;
+      continue;
+    }
+    if (input_path == filename) {
+      encode = !IsWoff2(input);
+      params.num_streams = num_streams;
+      params.num_threads = decode_params.num_threads;
+    }
+
+    // One untimed run to warm caches and catch failures.
+    size_t output_size = 0;
+    if (!RunOnce(input, encode, params, file_decode_params, pool.get(),
+                 &output_size)) {
+      fprintf(stderr, "%s: %s failed\n", filename.c_str(),
+              encode ? "encode" : "decode");
+      ++failures;
+      continue;
+    }
+
+    woff2::WOFF2DecodeParams timed_decode_params = file_decode_params;
+    if (profiler) {
+      profiler->Reset();
+      params.phase_observer = profiler.get();
+      timed_decode_params.phase_observer = profiler.get();
+    }
+    std::vector<double> times_ms;
+    double total_ms = 0;
+    while (static_cast<int>(times_ms.size()) < iterations ||
+           total_ms < min_seconds * 1000) {
+      auto start = std::chrono::steady_clock::now();
+      RunOnce(input, encode, params, timed_decode_params, pool.get(),
+              &output_size);
+      double ms = std::chrono::duration<double, std::milli>(
+          std::chrono::steady_clock::now() - start).count();
+      times_ms.push_back(ms);
+      total_ms += ms;
+    }
+    std::sort(times_ms.begin(), times_ms.end());
+    fprintf(stdout, "%s: %s %zu -> %zu bytes, %zu runs, min %.3f ms, "
+            "median %.3f ms, max %.3f ms\n", filename.c_str(),
+            encode ? "encode" : "decode", input.size(), output_size,
+            times_ms.size(), times_ms.front(), times_ms[times_ms.size() / 2],
+            times_ms.back());
+    if (profiler) {
+      profiler->Print(times_ms.size());
+    }
+    if (encode && params.num_streams > 1) {
+      woff2::WOFF2Params one_stream_params = params;
+      one_stream_params.num_streams = 1;
+      one_stream_params.phase_observer = NULL;
+      size_t one_stream_size = 0;
+      if (RunOnce(input, true, one_stream_params, file_decode_params, NULL,
+                  &one_stream_size)) {
+        const double overhead =
+            static_cast<double>(output_size) - one_stream_size;
+        fprintf(stdout, "  up to %d streams: %+.0f bytes (%+.2f%%) against "
+                "one stream\n", params.num_streams, overhead,
+                100 * overhead / one_stream_size);
+      }
+    }
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,228 @@
+/* Copyright 2026 Google Inc. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* A commandline tool for timing the conversion of synthetic font collections
+   of growing size, to check that the cost per face stays flat. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <woff2/decode.h>
+#include <woff2/encode.h>
+#include <woff2/output.h>
+
+namespace {
+
+const int kNumGlyphs = 64;
+const int kTrials = 5;
+
+void Append16(std::string* s, int value) {
+  s->push_back(static_cast<char>(value >> 8));
+  s->push_back(static_cast<char>(value));
+}
+
+void Append32(std::string* s, uint32_t value) {
+  Append16(s, value >> 16);
+  Append16(s, value & 0xffff);
+}
+
+void Put32(std::string* s, size_t offset, uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    (*s)[offset + i] = static_cast<char>(value >> (24 - 8 * i));
+  }
+}
+
+uint32_t Tag(const char* name) {
+  return (name[0] << 24) | (name[1] << 16) | (name[2] << 8) | name[3];
+}
+
+// Tables every face shares: a few triangle glyphs and the tables the encoder
+// needs to go with them.
+std::map<uint32_t, std::string> SharedTables() {
+  std::map<uint32_t, std::string> tables;
+  std::string& glyf = tables[Tag("glyf")];
+  std::string& loca = tables[Tag("loca")];
+  for (int i = 0; i < kNumGlyphs; ++i) {
+    Append32(&loca, glyf.size());
+    const int size = 100 + 10 * i;
+    Append16(&glyf, 1);  // numberOfContours
+    Append16(&glyf, 0);
+    Append16(&glyf, 0);
+    Append16(&glyf, size);
+    Append16(&glyf, size);
+    Append16(&glyf, 2);  // endPtsOfContours
+    Append16(&glyf, 0);  // instructionLength
+    for (int j = 0; j < 3; ++j) {
+      glyf.push_back(1);  // on curve, x and y as words
+    }
+    const int xs[] = {0, size, -size / 2};
+    const int ys[] = {0, 0, size};
+    for (int x : xs) Append16(&glyf, x);
+    for (int y : ys) Append16(&glyf, y);
+    glyf.resize((glyf.size() + 3) & ~3);
+  }
+  Append32(&loca, glyf.size());
+
+  std::string& head = tables[Tag("head")];
+  head.assign(54, 0);
+  Put32(&head, 0, 0x00010000);
+  Put32(&head, 12, 0x5f0f3cf5);
+  head[19] = 4;  // unitsPerEm = 1024
+  head[51] = 1;  // long loca
+  std::string& maxp = tables[Tag("maxp")];
+  Append32(&maxp, 0x00005000);
+  Append16(&maxp, kNumGlyphs);
+  std::string& hhea = tables[Tag("hhea")];
+  hhea.assign(34, 0);
+  Put32(&hhea, 0, 0x00010000);
+  Append16(&hhea, kNumGlyphs);
+  std::string& hmtx = tables[Tag("hmtx")];
+  for (int i = 0; i < kNumGlyphs; ++i) {
+    Append16(&hmtx, 500 + i);
+    Append16(&hmtx, 0);
+  }
+  return tables;
+}
+
+// A collection of num_faces faces that share glyf, loca and the metrics, and
+// each have their own name table and tables_per_face small private ones.
+std::string MakeCollection(int num_faces, int tables_per_face) {
+  const std::map<uint32_t, std::string> shared = SharedTables();
+  std::vector<std::map<uint32_t, std::string> > faces(num_faces);
+  for (int i = 0; i < num_faces; ++i) {
+    std::string& name = faces[i][Tag("name")];
+    Append16(&name, 0);
+    Append16(&name, 0);
+    Append16(&name, 6);
+    name += "Face " + std::to_string(i);
+    for (int j = 0; j < tables_per_face; ++j) {
+      std::string& table = faces[i][Tag("Xa00") + ((j / 10) << 8) + j % 10];
+      for (int k = 0; k < 8 + j; ++k) {
+        Append32(&table, i * 7919 + j * 104729 + k);
+      }
+    }
+  }
+
+  std::string ttc;
+  Append32(&ttc, Tag("ttcf"));
+  Append32(&ttc, 0x00010000);
+  Append32(&ttc, num_faces);
+  const size_t offsets_start = ttc.size();
+  ttc.resize(ttc.size() + 4 * num_faces);
+  std::vector<std::vector<size_t> > entry_offsets(num_faces);
+  for (int i = 0; i < num_faces; ++i) {
+    Put32(&ttc, offsets_start + 4 * i, ttc.size());
+    const size_t num_tables = shared.size() + faces[i].size();
+    Append32(&ttc, 0x00010000);
+    Append16(&ttc, num_tables);
+    Append16(&ttc, 0);
+    Append16(&ttc, 0);
+    Append16(&ttc, 0);
+    // Both maps are sorted by tag; merge them so the directory is too.
+    std::map<uint32_t, const std::string*> tables;
+    for (const auto& entry : shared) tables[entry.first] = &entry.second;
+    for (const auto& entry : faces[i]) tables[entry.first] = &entry.second;
+    for (const auto& entry : tables) {
+      entry_offsets[i].push_back(ttc.size());
+      Append32(&ttc, entry.first);
+      Append32(&ttc, 0);
+      Append32(&ttc, 0);
+      Append32(&ttc, entry.second->size());
+    }
+  }
+  std::map<const std::string*, uint32_t> written;
+  for (int i = 0; i < num_faces; ++i) {
+    std::map<uint32_t, const std::string*> tables;
+    for (const auto& entry : shared) tables[entry.first] = &entry.second;
+    for (const auto& entry : faces[i]) tables[entry.first] = &entry.second;
+    size_t j = 0;
+    for (const auto& entry : tables) {
+      auto it = written.find(entry.second);
+      if (it == written.end()) {
+        it = written.insert(std::make_pair(entry.second, ttc.size())).first;
+        ttc += *entry.second;
+        ttc.resize((ttc.size() + 3) & ~3);
+      }
+      Put32(&ttc, entry_offsets[i][j++] + 8, it->second);
+    }
+  }
+  return ttc;
+}
+
+double MedianMs(std::vector<double> times) {
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  int tables_per_face = 8;
+  int max_faces = 1024;
+  int arg = 1;
+  for (; arg < argc; ++arg) {
+    if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc) {
+      tables_per_face = std::max(0, std::min(atoi(argv[++arg]), 90));
+    } else if (strcmp(argv[arg], "-f") == 0 && arg + 1 < argc) {
+      max_faces = std::max(1, std::min(atoi(argv[++arg]), 0xffff));
+    } else {
+      fprintf(stderr,
+          "Usage: woff2_collection_bench [-t tables_per_face] [-f max_faces]\n"
+          "  Encodes and decodes collections of 1, 4, 16, ... up to max_faces\n"
+          "  faces (default 1024), each with tables_per_face private tables\n"
+          "  (default 8) besides the shared ones.\n");
+      return 1;
+    }
+  }
+
+  woff2::WOFF2Params params;
+  params.brotli_quality = 1;
+  fprintf(stdout, "%8s %10s %12s %12s %14s %14s\n", "faces", "entries",
+          "encode ms", "decode ms", "encode us/face", "decode us/face");
+  for (int faces = 1; faces <= max_faces; faces *= 4) {
+    const std::string ttc = MakeCollection(faces, tables_per_face);
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(ttc.data());
+    std::string woff2(woff2::MaxWOFF2CompressedSize(data, ttc.size()), 0);
+    size_t woff2_length = 0;
+    std::vector<double> encode_ms, decode_ms;
+    for (int t = 0; t < kTrials; ++t) {
+      woff2_length = woff2.size();
+      auto start = std::chrono::steady_clock::now();
+      if (!woff2::ConvertTTFToWOFF2(data, ttc.size(),
+                                    reinterpret_cast<uint8_t*>(&woff2[0]),
+                                    &woff2_length, params)) {
+        fprintf(stderr, "Encoding %d faces failed\n", faces);
+        return 1;
+      }
+      auto middle = std::chrono::steady_clock::now();
+      std::string output;
+      woff2::WOFF2StringOut out(&output);
+      out.SetMaxSize(std::max(woff2::kDefaultMaxSize, 2 * ttc.size()));
+      if (!woff2::ConvertWOFF2ToTTF(reinterpret_cast<uint8_t*>(&woff2[0]),
+                                    woff2_length, &out)) {
+        fprintf(stderr, "Decoding %d faces failed\n", faces);
+        return 1;
+      }
+      auto end = std::chrono::steady_clock::now();
+      encode_ms.push_back(
+          std::chrono::duration<double, std::milli>(middle - start).count());
+      decode_ms.push_back(
+          std::chrono::duration<double, std::milli>(end - middle).count());
+    }
+    const double encode = MedianMs(encode_ms);
+    const double decode = MedianMs(decode_ms);
+    fprintf(stdout, "%8d %10d %12.2f %12.2f %14.1f %14.1f\n", faces,
+            faces * (7 + tables_per_face), encode, decode,
+            1000 * encode / faces, 1000 * decode / faces);
+  }
+  return 0;
+}
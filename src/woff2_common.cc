@@ -10,6 +10,10 @@
 
 #include "./woff2_common.h"
 
+#include <woff2/error.h>
+#include <woff2/phase.h>
+
+#include "./buffer.h"
 #include "./port.h"
 
 namespace woff2 {
@@ -47,4 +51,77 @@ size_t CollectionHeaderSize(uint32_t header_version, uint32_t num_fonts) {
   return size;
 }
 
+bool PackedPointNumbersLength(const uint8_t* data, size_t size,
+                              size_t* length) {
+  Buffer buffer(data, size);
+  uint8_t count_byte;
+  if (!buffer.ReadU8(&count_byte)) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  uint32_t count = count_byte;
+  if (count_byte & 0x80) {
+    uint8_t low_byte;
+    if (!buffer.ReadU8(&low_byte)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    count = ((count_byte & 0x7f) << 8) | low_byte;
+  }
+  // A count of 0 means all points, and no point numbers follow.
+  while (count > 0) {
+    uint8_t control;
+    if (!buffer.ReadU8(&control)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    uint32_t run_count = (control & 0x7f) + 1;
+    if (run_count > count ||
+        !buffer.Skip(run_count * ((control & 0x80) ? 2 : 1))) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    count -= run_count;
+  }
+  *length = buffer.offset();
+  return true;
+}
+
+const char* WOFF2PhaseName(WOFF2Phase phase) {
+  switch (phase) {
+    case kWOFF2PhaseReadFont: return "ReadFont";
+    case kWOFF2PhaseDesubroutinize: return "Desubroutinize";
+    case kWOFF2PhaseNormalize: return "Normalize";
+    case kWOFF2PhaseTransform: return "Transform";
+    case kWOFF2PhaseTransformGvar: return "TransformGvar";
+    case kWOFF2PhaseCompress: return "Compress";
+    case kWOFF2PhaseDecompress: return "Decompress";
+    case kWOFF2PhaseReconstructGlyf: return "ReconstructGlyf";
+    case kWOFF2PhaseReconstructTables: return "ReconstructTables";
+    default: return "Unknown";
+  }
+}
+
+const char* WOFF2ErrorString(WOFF2ErrorCode code) {
+  switch (code) {
+    case kWOFF2ErrorNone: return "no error";
+    case kWOFF2ErrorInvalidInput: return "invalid input";
+    case kWOFF2ErrorOutputTooSmall: return "output too small";
+    case kWOFF2ErrorLimitExceeded: return "limit exceeded";
+    case kWOFF2ErrorInternal: return "internal error";
+    default: return "unknown error";
+  }
+}
+
+bool ReportError(WOFF2Error* error, WOFF2ErrorCode code, uint32_t table_tag,
+                 size_t offset) {
+  if (error != NULL) {
+    error->code = code;
+    error->table_tag = table_tag;
+    error->offset = offset;
+  }
+  return FONT_COMPRESSION_FAILURE();
+}
+
+bool WOFF2PhaseCountsGlyphs(WOFF2Phase phase) {
+  return phase == kWOFF2PhaseNormalize || phase == kWOFF2PhaseTransform ||
+      phase == kWOFF2PhaseReconstructGlyf;
+}
+
 } // namespace woff2
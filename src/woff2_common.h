@@ -13,11 +13,22 @@
 #include <inttypes.h>
 
 #include <string>
+#include <woff2/error.h>
+#include <woff2/phase.h>
 
 namespace woff2 {
 
 static const uint32_t kWoff2Signature = 0x774f4632;  // "wOF2"
 
+// Signature of our private, non-standard multi-stream variant of WOFF2, which
+// decoders that follow the spec reject. It differs from WOFF2 only in the
+// compressed data: a 255UInt16 count of Brotli streams, then the UIntBase128
+// decompressed and compressed length of each, then the streams back to back.
+// They are independent, and decompress to consecutive ranges of the table
+// data.
+static const uint32_t kWoff2MultiStreamSignature = 0x774f464d;  // "wOFM"
+static const size_t kMaxWoff2Streams = 64;
+
 // Leave the first byte open to store flag_byte
 const unsigned int kWoff2FlagsTransform = 1 << 8;
 
@@ -27,6 +38,11 @@ static const uint32_t kTtcFontFlavor = 0x74746366;
 static const size_t kSfntHeaderSize = 12;
 static const size_t kSfntEntrySize = 16;
 
+// Transform version of our private, non-standard gvar transform. Decoders
+// that follow the WOFF2 spec reject fonts that use it.
+static const uint8_t kGvarPrivateTransformVersion = 3;
+static const size_t kGvarHeaderSize = 20;
+
 struct Point {
   int x;
   int y;
@@ -59,6 +75,50 @@ size_t CollectionHeaderSize(uint32_t header_version, uint32_t num_fonts);
 // Compute checksum over size bytes of buf
 uint32_t ComputeULongSum(const uint8_t* buf, size_t size);
 
+// Sets *length to the size of the packed point numbers at the start of data.
+// Ref https://docs.microsoft.com/en-us/typography/opentype/spec/otvarcommonformats
+bool PackedPointNumbersLength(const uint8_t* data, size_t size,
+                              size_t* length);
+
+// Fills in *error, unless error is NULL, and returns false. Only called on
+// the way out of a failed conversion, so successful ones pay nothing.
+bool ReportError(WOFF2Error* error, WOFF2ErrorCode code, uint32_t table_tag,
+                 size_t offset);
+
+// Tells observer, unless it is NULL, about a run of phase: it begins on
+// construction or Begin() and ends on End(), or on destruction, with no
+// units, when an error return skips End().
+class ScopedPhase {
+ public:
+  ScopedPhase(WOFF2PhaseObserver* observer, WOFF2Phase phase)
+      : observer_(observer), phase_(phase), running_(false) {
+    Begin();
+  }
+  ~ScopedPhase() { End(0); }
+
+  void Begin() {
+    if (observer_ && !running_) {
+      observer_->BeginPhase(phase_);
+      running_ = true;
+    }
+  }
+
+  void End(size_t units) {
+    if (running_) {
+      observer_->EndPhase(phase_, units);
+      running_ = false;
+    }
+  }
+
+ private:
+  ScopedPhase(const ScopedPhase&);
+  void operator=(const ScopedPhase&);
+
+  WOFF2PhaseObserver* observer_;
+  WOFF2Phase phase_;
+  bool running_;
+};
+
 } // namespace woff2
 
 #endif  // WOFF2_WOFF2_COMMON_H_
@@ -6,6 +6,7 @@
 
 /* A commandline tool for compressing ttf format files to woff2. */
 
+#include <stdlib.h>
 #include <string>
 
 #include "file.h"
@@ -13,12 +14,20 @@
 
 
 int main(int argc, char **argv) {
-  if (argc != 2) {
-    fprintf(stderr, "One argument, the input filename, must be provided.\n");
+  woff2::WOFF2Params params;
+  int arg = 1;
+  if (argc == 4 && std::string(argv[1]) == "-m") {
+    // Our private multi-stream variant, which only our decoder reads.
+    params.num_streams = atoi(argv[2]);
+    arg += 2;
+  }
+  if (arg != argc - 1) {
+    fprintf(stderr, "One argument, the input filename, must be provided, "
+            "optionally after -m num_streams.\n");
     return 1;
   }
 
-  std::string filename(argv[1]);
+  std::string filename(argv[arg]);
   std::string outfilename = filename.substr(0, filename.find_last_of(".")) + ".woff2";
   fprintf(stdout, "Processing %s => %s\n",
     filename.c_str(), outfilename.c_str());
@@ -29,10 +38,12 @@ int main(int argc, char **argv) {
   std::string output(output_size, 0);
   uint8_t* output_data = reinterpret_cast<uint8_t*>(&output[0]);
 
-  woff2::WOFF2Params params;
+  woff2::WOFF2Error error;
+  params.error = &error;
   if (!woff2::ConvertTTFToWOFF2(input_data, input.size(),
                                 output_data, &output_size, params)) {
-    fprintf(stderr, "Compression failed.\n");
+    fprintf(stderr, "Compression failed: %s.\n",
+            woff2::WOFF2ErrorString(error.code));
     return 1;
   }
   output.resize(output_size);
@@ -21,12 +21,14 @@
 
 #include <brotli/decode.h>
 #include "./buffer.h"
+#include "./parallel.h"
 #include "./port.h"
 #include "./round.h"
 #include "./store_bytes.h"
 #include "./table_tags.h"
 #include "./variable_length.h"
 #include "./woff2_common.h"
+#include "./woff2_dec_kernels.h"
 
 namespace woff2 {
 
@@ -75,6 +77,8 @@ struct TtcFont {
 };
 
 struct WOFF2Header {
+  // Set for our private multi-stream variant, see kWoff2MultiStreamSignature.
+  bool multi_stream;
   uint32_t flavor;
   uint32_t header_version;
   uint16_t num_tables;
@@ -94,16 +98,43 @@ struct WOFF2FontInfo {
   uint16_t index_format;
   uint16_t num_hmetrics;
   std::vector<int16_t> x_mins;
-  std::map<uint32_t, uint32_t> table_entry_by_tag;
+  // Offset of the table directory entry of each table, in the order Tables()
+  // lists them.
+  std::vector<uint32_t> table_entry_offsets;
 };
 
 // Accumulates metadata as we rebuild the font
 struct RebuildMetadata {
+  // If set, no checksums are computed and header_checksum and the values in
+  // checksums are all 0.
+  bool skip_checksums;
+  // See WOFF2DecodeParams::allow_gvar_transform.
+  bool allow_gvar_transform;
+  // Order in which to lay out the tables of each font, see
+  // WOFF2DecodeParams::table_order.
+  const std::vector<uint32_t>* table_order;
+  WOFF2PhaseObserver* phase_observer;
+  // The table being rebuilt, so that a failure can name it.
+  const Table* current_table;
   uint32_t header_checksum;  // set by WriteHeaders
   std::vector<WOFF2FontInfo> font_infos;
-  // checksums for tables that have been written.
-  // (tag, src_offset) => checksum. Need both because 0-length loca.
-  std::map<std::pair<uint32_t, uint32_t>, uint32_t> checksums;
+  // Whether each of WOFF2Header::tables has been written, and its checksum
+  // if so. Fonts in a collection that share a table refer to the same index.
+  std::vector<bool> written;
+  std::vector<uint32_t> checksums;
+  // glyf src_offset => facts, only gathered if asked for. Fonts in a
+  // collection that share glyf take its facts from here.
+  std::map<uint32_t, WOFF2GlyfFacts> glyf_facts;
+};
+
+// Per glyph data ReconstructGlyf gathers to establish WOFF2GlyfFacts.
+struct GlyfFactsBuilder {
+  std::vector<uint32_t> n_points;  // simple glyphs, 0 otherwise
+  std::vector<uint16_t> n_contours;
+  // Components of glyph i are components[component_start[i]] up to
+  // components[component_start[i + 1]], none for simple glyphs.
+  std::vector<uint32_t> component_start;
+  std::vector<uint16_t> components;
 };
 
 int WithSign(int flag, int baseval) {
@@ -121,60 +152,98 @@ bool _SafeIntAddition(int a, int b, int* result) {
   return true;
 }
 
+// Number of data bytes of the triplet with the given flag, without the
+// on-curve bit.
+inline unsigned int TripletDataSize(uint8_t flag) {
+  if (flag < 84) {
+    return 1;
+  } else if (flag < 120) {
+    return 2;
+  } else if (flag < 124) {
+    return 3;
+  }
+  return 4;
+}
+
+// Decodes the deltas of one triplet whose data bytes start at in.
+inline void TripletDeltas(uint8_t flag, const uint8_t* in, int* dx, int* dy) {
+  if (flag < 10) {
+    *dx = 0;
+    *dy = WithSign(flag, ((flag & 14) << 7) + in[0]);
+  } else if (flag < 20) {
+    *dx = WithSign(flag, (((flag - 10) & 14) << 7) + in[0]);
+    *dy = 0;
+  } else if (flag < 84) {
+    int b0 = flag - 20;
+    int b1 = in[0];
+    *dx = WithSign(flag, 1 + (b0 & 0x30) + (b1 >> 4));
+    *dy = WithSign(flag >> 1, 1 + ((b0 & 0x0c) << 2) + (b1 & 0x0f));
+  } else if (flag < 120) {
+    int b0 = flag - 84;
+    *dx = WithSign(flag, 1 + ((b0 / 12) << 8) + in[0]);
+    *dy = WithSign(flag >> 1, 1 + (((b0 % 12) >> 2) << 8) + in[1]);
+  } else if (flag < 124) {
+    int b2 = in[1];
+    *dx = WithSign(flag, (in[0] << 4) + (b2 >> 4));
+    *dy = WithSign(flag >> 1, ((b2 & 0x0f) << 8) + in[2]);
+  } else {
+    *dx = WithSign(flag, (in[0] << 8) + in[1]);
+    *dy = WithSign(flag >> 1, (in[2] << 8) + in[3]);
+  }
+}
+
+}  // namespace
+
 bool TripletDecode(const uint8_t* flags_in, const uint8_t* in, size_t in_size,
-    unsigned int n_points, Point* result, size_t* in_bytes_consumed) {
+    size_t in_slack, unsigned int n_points, Point* result,
+    size_t* in_bytes_consumed) {
   int x = 0;
   int y = 0;
 
   if (PREDICT_FALSE(n_points > in_size)) {
     return FONT_COMPRESSION_FAILURE();
   }
-  unsigned int triplet_index = 0;
+  size_t triplet_index = 0;
+  unsigned int i = 0;
+
+  // A block of kTripletBlock triplets reads at most 4 bytes each and moves a
+  // coordinate by less than 65536 each, so if the slack covers the block's
+  // worst case, one check per block that it starts inside the data and far
+  // from overflow replaces the per triplet checks. A block that ends past
+  // in_size has read slack bytes, and fails below.
+  static const unsigned int kTripletBlock = 8;
+  static const int kMaxBlockStart =
+      std::numeric_limits<int>::max() - static_cast<int>(kTripletBlock) * 65536;
+  if (in_slack >= 4 * kTripletBlock) {
+    while (n_points - i >= kTripletBlock && triplet_index <= in_size &&
+           std::abs(x) <= kMaxBlockStart && std::abs(y) <= kMaxBlockStart) {
+      for (unsigned int k = 0; k < kTripletBlock; ++k, ++i) {
+        uint8_t flag = flags_in[i];
+        bool on_curve = !(flag >> 7);
+        flag &= 0x7f;
+        int dx, dy;
+        TripletDeltas(flag, in + triplet_index, &dx, &dy);
+        triplet_index += TripletDataSize(flag);
+        x += dx;
+        y += dy;
+        *result++ = {x, y, on_curve};
+      }
+    }
+    if (PREDICT_FALSE(triplet_index > in_size)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+  }
 
-  for (unsigned int i = 0; i < n_points; ++i) {
+  for (; i < n_points; ++i) {
     uint8_t flag = flags_in[i];
     bool on_curve = !(flag >> 7);
     flag &= 0x7f;
-    unsigned int n_data_bytes;
-    if (flag < 84) {
-      n_data_bytes = 1;
-    } else if (flag < 120) {
-      n_data_bytes = 2;
-    } else if (flag < 124) {
-      n_data_bytes = 3;
-    } else {
-      n_data_bytes = 4;
-    }
-    if (PREDICT_FALSE(triplet_index + n_data_bytes > in_size ||
-        triplet_index + n_data_bytes < triplet_index)) {
+    unsigned int n_data_bytes = TripletDataSize(flag);
+    if (PREDICT_FALSE(triplet_index + n_data_bytes > in_size)) {
       return FONT_COMPRESSION_FAILURE();
     }
     int dx, dy;
-    if (flag < 10) {
-      dx = 0;
-      dy = WithSign(flag, ((flag & 14) << 7) + in[triplet_index]);
-    } else if (flag < 20) {
-      dx = WithSign(flag, (((flag - 10) & 14) << 7) + in[triplet_index]);
-      dy = 0;
-    } else if (flag < 84) {
-      int b0 = flag - 20;
-      int b1 = in[triplet_index];
-      dx = WithSign(flag, 1 + (b0 & 0x30) + (b1 >> 4));
-      dy = WithSign(flag >> 1, 1 + ((b0 & 0x0c) << 2) + (b1 & 0x0f));
-    } else if (flag < 120) {
-      int b0 = flag - 84;
-      dx = WithSign(flag, 1 + ((b0 / 12) << 8) + in[triplet_index]);
-      dy = WithSign(flag >> 1,
-                    1 + (((b0 % 12) >> 2) << 8) + in[triplet_index + 1]);
-    } else if (flag < 124) {
-      int b2 = in[triplet_index + 1];
-      dx = WithSign(flag, (in[triplet_index] << 4) + (b2 >> 4));
-      dy = WithSign(flag >> 1, ((b2 & 0x0f) << 8) + in[triplet_index + 2]);
-    } else {
-      dx = WithSign(flag, (in[triplet_index] << 8) + in[triplet_index + 1]);
-      dy = WithSign(flag >> 1,
-          (in[triplet_index + 2] << 8) + in[triplet_index + 3]);
-    }
+    TripletDeltas(flag, in + triplet_index, &dx, &dy);
     triplet_index += n_data_bytes;
     if (!_SafeIntAddition(x, dx, &x)) {
       return false;
@@ -325,6 +394,39 @@ void ComputeBbox(unsigned int n_points, const Point* points, uint8_t* dst) {
 }
 
 
+// Build TrueType loca table. checksum may be NULL, then it isn't computed.
+bool StoreLoca(const std::vector<uint32_t>& loca_values, int index_format,
+               uint32_t* checksum, size_t dst_offset, WOFF2Out* out) {
+  // TODO(user) figure out what index format to use based on whether max
+  // offset fits into uint16_t or not
+  const uint64_t loca_size = loca_values.size();
+  const uint64_t offset_size = index_format ? 4 : 2;
+  if (PREDICT_FALSE((loca_size << 2) >> 2 != loca_size)) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  std::vector<uint8_t> loca_content(loca_size * offset_size);
+  uint8_t* dst = &loca_content[0];
+  if (index_format) {
+    StoreU32Array(dst, 0, loca_values.data(), loca_size);
+  } else {
+    std::vector<uint16_t> short_values(loca_size);
+    for (size_t i = 0; i < loca_size; ++i) {
+      short_values[i] = loca_values[i] >> 1;
+    }
+    StoreU16Array(dst, 0, short_values.data(), loca_size);
+  }
+  if (checksum) {
+    *checksum = ComputeULongSum(&loca_content[0], loca_content.size());
+  }
+  if (PREDICT_FALSE(!out->Write(&loca_content[0], dst_offset,
+                                loca_content.size()))) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  return true;
+}
+
+namespace {
+
 bool SizeOfComposite(Buffer composite_stream, size_t* size,
                      bool* have_instructions) {
   size_t start_offset = composite_stream.offset();
@@ -360,6 +462,152 @@ bool SizeOfComposite(Buffer composite_stream, size_t* size,
   return true;
 }
 
+// Appends the glyph ids of the components of a composite glyph; data was
+// already checked by SizeOfComposite.
+void AppendComponentIds(const uint8_t* data, size_t size,
+                        std::vector<uint16_t>* ids) {
+  Buffer composite(data, size);
+  uint16_t flags = FLAG_MORE_COMPONENTS;
+  while (flags & FLAG_MORE_COMPONENTS) {
+    uint16_t glyph_index;
+    if (!composite.ReadU16(&flags) || !composite.ReadU16(&glyph_index)) {
+      return;
+    }
+    ids->push_back(glyph_index);
+    size_t arg_size = (flags & FLAG_ARG_1_AND_2_ARE_WORDS) ? 4 : 2;
+    if (flags & FLAG_WE_HAVE_A_SCALE) {
+      arg_size += 2;
+    } else if (flags & FLAG_WE_HAVE_AN_X_AND_Y_SCALE) {
+      arg_size += 4;
+    } else if (flags & FLAG_WE_HAVE_A_TWO_BY_TWO) {
+      arg_size += 8;
+    }
+    composite.Skip(arg_size);
+  }
+}
+
+uint32_t SaturatingAdd(uint32_t a, uint32_t b) {
+  return a > std::numeric_limits<uint32_t>::max() - b ?
+      std::numeric_limits<uint32_t>::max() : a + b;
+}
+
+// Walks the component graph without recursion, so a hostile font can't blow
+// the stack, and fills in the composite fields of facts.
+void ComputeCompositeFacts(const GlyfFactsBuilder& builder,
+                           WOFF2GlyfFacts* facts) {
+  enum State { kUnvisited, kActive, kDone };
+  const size_t num_glyphs = builder.n_points.size();
+  std::vector<uint8_t> state(num_glyphs, kUnvisited);
+  std::vector<uint16_t> depth(num_glyphs);
+  std::vector<uint32_t> points(num_glyphs);
+  std::vector<uint32_t> contours(num_glyphs);
+  auto is_composite = [&builder](size_t glyph) {
+    return builder.component_start[glyph + 1] > builder.component_start[glyph];
+  };
+
+  // (glyph, next component to visit)
+  std::vector<std::pair<uint16_t, uint32_t> > stack;
+  for (size_t root = 0; root < num_glyphs; ++root) {
+    if (!is_composite(root) || state[root] == kDone) {
+      continue;
+    }
+    state[root] = kActive;
+    stack.push_back(std::make_pair(root, builder.component_start[root]));
+    while (!stack.empty()) {
+      const uint16_t glyph = stack.back().first;
+      const uint32_t end = builder.component_start[glyph + 1];
+      if (stack.back().second < end) {
+        const uint16_t component = builder.components[stack.back().second++];
+        if (component >= num_glyphs) {
+          facts->component_ids_in_range = false;
+        } else if (is_composite(component)) {
+          if (state[component] == kActive) {
+            facts->components_acyclic = false;
+          } else if (state[component] == kUnvisited) {
+            state[component] = kActive;
+            stack.push_back(std::make_pair(component,
+                builder.component_start[component]));
+          }
+        }
+        continue;
+      }
+
+      // All components are done; bad references were reported above and
+      // are left out here.
+      uint16_t glyph_depth = 1;
+      uint32_t glyph_points = 0;
+      uint32_t glyph_contours = 0;
+      for (uint32_t i = builder.component_start[glyph]; i < end; ++i) {
+        const uint16_t component = builder.components[i];
+        if (component >= num_glyphs) {
+          continue;
+        }
+        if (!is_composite(component)) {
+          glyph_points = SaturatingAdd(glyph_points,
+                                       builder.n_points[component]);
+          glyph_contours = SaturatingAdd(glyph_contours,
+                                         builder.n_contours[component]);
+        } else if (state[component] == kDone) {
+          glyph_depth = std::max<uint16_t>(glyph_depth, depth[component] + 1);
+          glyph_points = SaturatingAdd(glyph_points, points[component]);
+          glyph_contours = SaturatingAdd(glyph_contours, contours[component]);
+        }
+      }
+      depth[glyph] = glyph_depth;
+      points[glyph] = glyph_points;
+      contours[glyph] = glyph_contours;
+      state[glyph] = kDone;
+      stack.pop_back();
+
+      facts->max_component_depth =
+          std::max(facts->max_component_depth, glyph_depth);
+      facts->max_composite_points =
+          std::max(facts->max_composite_points, glyph_points);
+      facts->max_composite_contours =
+          std::max(facts->max_composite_contours, glyph_contours);
+      facts->max_component_elements = std::max<uint16_t>(
+          facts->max_component_elements,
+          std::min<uint32_t>(end - builder.component_start[glyph], 0xffff));
+    }
+  }
+}
+
+// Checks facts against maxp, https://www.microsoft.com/typography/otspec/maxp.htm
+bool MaxpConsistent(const uint8_t* data, size_t data_size,
+                    const WOFF2GlyfFacts& facts) {
+  Buffer maxp(data, data_size);
+  uint32_t version;
+  uint16_t num_glyphs;
+  if (!maxp.ReadU32(&version) || !maxp.ReadU16(&num_glyphs) ||
+      num_glyphs != facts.num_glyphs) {
+    return false;
+  }
+  if (version != 0x00010000) {
+    return version == 0x00005000;
+  }
+  uint16_t max_points, max_contours, max_composite_points,
+      max_composite_contours, max_size_of_instructions,
+      max_component_elements, max_component_depth;
+  if (!maxp.ReadU16(&max_points) || !maxp.ReadU16(&max_contours) ||
+      !maxp.ReadU16(&max_composite_points) ||
+      !maxp.ReadU16(&max_composite_contours) ||
+      // maxZones, maxTwilightPoints, maxStorage, maxFunctionDefs,
+      // maxInstructionDefs, maxStackElements
+      !maxp.Skip(12) ||
+      !maxp.ReadU16(&max_size_of_instructions) ||
+      !maxp.ReadU16(&max_component_elements) ||
+      !maxp.ReadU16(&max_component_depth)) {
+    return false;
+  }
+  return facts.max_points <= max_points &&
+         facts.max_contours <= max_contours &&
+         facts.max_composite_points <= max_composite_points &&
+         facts.max_composite_contours <= max_composite_contours &&
+         facts.max_size_of_instructions <= max_size_of_instructions &&
+         facts.max_component_elements <= max_component_elements &&
+         facts.max_component_depth <= max_component_depth;
+}
+
 bool Pad4(WOFF2Out* out) {
   uint8_t zeroes[] = {0, 0, 0};
   if (PREDICT_FALSE(out->Size() + 3 < out->Size())) {
@@ -374,38 +622,13 @@ bool Pad4(WOFF2Out* out) {
   return true;
 }
 
-// Build TrueType loca table
-bool StoreLoca(const std::vector<uint32_t>& loca_values, int index_format,
-               uint32_t* checksum, WOFF2Out* out) {
-  // TODO(user) figure out what index format to use based on whether max
-  // offset fits into uint16_t or not
-  const uint64_t loca_size = loca_values.size();
-  const uint64_t offset_size = index_format ? 4 : 2;
-  if (PREDICT_FALSE((loca_size << 2) >> 2 != loca_size)) {
-    return FONT_COMPRESSION_FAILURE();
-  }
-  std::vector<uint8_t> loca_content(loca_size * offset_size);
-  uint8_t* dst = &loca_content[0];
-  size_t offset = 0;
-  for (size_t i = 0; i < loca_values.size(); ++i) {
-    uint32_t value = loca_values[i];
-    if (index_format) {
-      offset = StoreU32(dst, offset, value);
-    } else {
-      offset = Store16(dst, offset, value >> 1);
-    }
-  }
-  *checksum = ComputeULongSum(&loca_content[0], loca_content.size());
-  if (PREDICT_FALSE(!out->Write(&loca_content[0], loca_content.size()))) {
-    return FONT_COMPRESSION_FAILURE();
-  }
-  return true;
-}
-
 // Reconstruct entire glyf table based on transformed original
+// facts may be NULL, then they aren't gathered. glyf_checksum and
+// loca_checksum may be NULL, then they aren't computed.
 bool ReconstructGlyf(const uint8_t* data, Table* glyf_table,
                      uint32_t* glyf_checksum, Table * loca_table,
-                     uint32_t* loca_checksum, WOFF2FontInfo* info,
+                     uint32_t* loca_checksum, bool loca_reserved,
+                     WOFF2FontInfo* info, WOFF2GlyfFacts* facts,
                      WOFF2Out* out) {
   static const int kNumSubStreams = 7;
   Buffer file(data, glyf_table->transform_length);
@@ -486,6 +709,18 @@ bool ReconstructGlyf(const uint8_t* data, Table* glyf_table,
   size_t glyph_buf_size = kDefaultGlyphBuf;
   std::unique_ptr<uint8_t[]> glyph_buf(new uint8_t[glyph_buf_size]);
 
+  GlyfFactsBuilder facts_builder;
+  if (facts) {
+    *facts = WOFF2GlyfFacts();
+    facts->num_glyphs = info->num_glyphs;
+    facts->component_ids_in_range = true;
+    facts->components_acyclic = true;
+    facts->bboxes_match_points = true;
+    facts_builder.n_points.resize(info->num_glyphs);
+    facts_builder.n_contours.resize(info->num_glyphs);
+    facts_builder.component_start.resize(info->num_glyphs + 1);
+  }
+
   info->x_mins.resize(info->num_glyphs);
   for (unsigned int i = 0; i < info->num_glyphs; ++i) {
     size_t glyph_size = 0;
@@ -534,6 +769,10 @@ bool ReconstructGlyf(const uint8_t* data, Table* glyf_table,
             composite_size))) {
         return FONT_COMPRESSION_FAILURE();
       }
+      if (facts) {
+        AppendComponentIds(glyph_buf.get() + glyph_size, composite_size,
+                           &facts_builder.components);
+      }
       glyph_size += composite_size;
       if (have_instructions) {
         glyph_size = Store16(glyph_buf.get(), glyph_size, instruction_size);
@@ -543,21 +782,36 @@ bool ReconstructGlyf(const uint8_t* data, Table* glyf_table,
         }
         glyph_size += instruction_size;
       }
+      if (facts) {
+        facts->max_size_of_instructions = std::max<uint32_t>(
+            facts->max_size_of_instructions, instruction_size);
+      }
     } else if (n_contours > 0) {
       // simple glyph
-      n_points_vec.clear();
+      n_points_vec.resize(n_contours);
       unsigned int total_n_points = 0;
-      unsigned int n_points_contour;
-      for (unsigned int j = 0; j < n_contours; ++j) {
-        if (PREDICT_FALSE(
-            !Read255UShort(&n_points_stream, &n_points_contour))) {
+      const size_t n_points_left =
+          n_points_stream.length() - n_points_stream.offset();
+      if (3 * n_contours <= n_points_left + kDecodeGuardSize) {
+        // Each count takes at most 3 bytes, so the whole glyph's counts are
+        // readable; check that they were in the stream once at the end.
+        const size_t n_points_bytes = Read255UShortsUnchecked(
+            n_points_stream.buffer() + n_points_stream.offset(), n_contours,
+            &n_points_vec[0]);
+        if (PREDICT_FALSE(!n_points_stream.Skip(n_points_bytes))) {
           return FONT_COMPRESSION_FAILURE();
         }
-        n_points_vec.push_back(n_points_contour);
-        if (PREDICT_FALSE(total_n_points + n_points_contour < total_n_points)) {
-          return FONT_COMPRESSION_FAILURE();
+      } else {
+        for (unsigned int j = 0; j < n_contours; ++j) {
+          if (PREDICT_FALSE(
+              !Read255UShort(&n_points_stream, &n_points_vec[j]))) {
+            return FONT_COMPRESSION_FAILURE();
+          }
         }
-        total_n_points += n_points_contour;
+      }
+      for (unsigned int j = 0; j < n_contours; ++j) {
+        // Counts are below 65536 and there are fewer than 65536 of them.
+        total_n_points += n_points_vec[j];
       }
       unsigned int flag_size = total_n_points;
       if (PREDICT_FALSE(
@@ -574,7 +828,8 @@ bool ReconstructGlyf(const uint8_t* data, Table* glyf_table,
         points.reset(new Point[points_size]);
       }
       if (PREDICT_FALSE(!TripletDecode(flags_buf, triplet_buf, triplet_size,
-          total_n_points, points.get(), &triplet_bytes_consumed))) {
+          kDecodeGuardSize, total_n_points, points.get(),
+          &triplet_bytes_consumed))) {
         return FONT_COMPRESSION_FAILURE();
       }
       if (PREDICT_FALSE(!flag_stream.Skip(flag_size))) {
@@ -607,15 +862,19 @@ bool ReconstructGlyf(const uint8_t* data, Table* glyf_table,
       } else {
         ComputeBbox(total_n_points, points.get(), glyph_buf.get());
       }
-      glyph_size = kEndPtsOfContoursOffset;
+      // Gather the end points in host order, then swap them all at once.
+      uint8_t* end_points = glyph_buf.get() + kEndPtsOfContoursOffset;
       int end_point = -1;
       for (unsigned int contour_ix = 0; contour_ix < n_contours; ++contour_ix) {
         end_point += n_points_vec[contour_ix];
         if (PREDICT_FALSE(end_point >= 65536)) {
           return FONT_COMPRESSION_FAILURE();
         }
-        glyph_size = Store16(glyph_buf.get(), glyph_size, end_point);
+        uint16_t value = end_point;
+        memcpy(end_points + 2 * contour_ix, &value, 2);
       }
+      ByteSwapU16Array(end_points, n_contours);
+      glyph_size = kEndPtsOfContoursOffset + 2 * n_contours;
 
       glyph_size = Store16(glyph_buf.get(), glyph_size, instruction_size);
       if (PREDICT_FALSE(!instruction_stream.Read(glyph_buf.get() + glyph_size,
@@ -632,6 +891,25 @@ bool ReconstructGlyf(const uint8_t* data, Table* glyf_table,
               has_overlap_bit, glyph_buf.get(), glyph_buf_size, &glyph_size))) {
         return FONT_COMPRESSION_FAILURE();
       }
+
+      if (facts) {
+        facts_builder.n_points[i] = total_n_points;
+        facts_builder.n_contours[i] = n_contours;
+        // Up to 65536 points and any instruction length get here; compare
+        // unclamped so MaxpConsistent rejects what maxp cannot describe.
+        facts->max_points = std::max<uint32_t>(facts->max_points,
+                                               total_n_points);
+        facts->max_contours = std::max(facts->max_contours, n_contours);
+        facts->max_size_of_instructions = std::max<uint32_t>(
+            facts->max_size_of_instructions, instruction_size);
+        if (have_bbox) {
+          uint8_t bbox[kEndPtsOfContoursOffset];
+          ComputeBbox(total_n_points, points.get(), bbox);
+          if (memcmp(bbox + 2, glyph_buf.get() + 2, 8) != 0) {
+            facts->bboxes_match_points = false;
+          }
+        }
+      }
     } else {
       // n_contours == 0; empty glyph. Must NOT have a bbox.
       if (PREDICT_FALSE(have_bbox)) {
@@ -642,6 +920,10 @@ bool ReconstructGlyf(const uint8_t* data, Table* glyf_table,
       }
     }
 
+    if (facts) {
+      facts_builder.component_start[i + 1] = facts_builder.components.size();
+    }
+
     loca_values[i] = out->Size() - glyf_start;
     if (PREDICT_FALSE(!out->Write(glyph_buf.get(), glyph_size))) {
       return FONT_COMPRESSION_FAILURE();
@@ -652,7 +934,9 @@ bool ReconstructGlyf(const uint8_t* data, Table* glyf_table,
       return FONT_COMPRESSION_FAILURE();
     }
 
-    *glyf_checksum += ComputeULongSum(glyph_buf.get(), glyph_size);
+    if (glyf_checksum) {
+      *glyf_checksum += ComputeULongSum(glyph_buf.get(), glyph_size);
+    }
 
     // We may need x_min to reconstruct 'hmtx'
     if (n_contours > 0) {
@@ -665,25 +949,28 @@ bool ReconstructGlyf(const uint8_t* data, Table* glyf_table,
 
   // glyf_table dst_offset was set by ReconstructFont
   glyf_table->dst_length = out->Size() - glyf_table->dst_offset;
-  loca_table->dst_offset = out->Size();
+  // Unless ReconstructFont set aside room for loca, it follows glyf. Its
+  // length is dst_length either way, as checked above.
+  if (!loca_reserved) {
+    loca_table->dst_offset = out->Size();
+  }
   // loca[n] will be equal the length of the glyph data ('glyf') table
   loca_values[info->num_glyphs] = glyf_table->dst_length;
   if (PREDICT_FALSE(!StoreLoca(loca_values, info->index_format, loca_checksum,
-      out))) {
+      loca_table->dst_offset, out))) {
     return FONT_COMPRESSION_FAILURE();
   }
-  loca_table->dst_length = out->Size() - loca_table->dst_offset;
-
-  return true;
-}
 
-Table* FindTable(std::vector<Table*>* tables, uint32_t tag) {
-  for (Table* table : *tables) {
-    if (table->tag == tag) {
-      return table;
-    }
+  if (facts) {
+    ComputeCompositeFacts(facts_builder, facts);
+    // Glyphs are written in order, so offsets only grow; the short format
+    // stores them halved in 16 bits.
+    facts->loca_monotonic =
+        info->index_format || glyf_table->dst_length <= 2 * 0xffff;
+    facts->verified = true;
   }
-  return NULL;
+
+  return true;
 }
 
 // Get numberOfHMetrics, https://www.microsoft.com/typography/otspec/hhea.htm
@@ -698,12 +985,14 @@ bool ReadNumHMetrics(const uint8_t* data, size_t data_size,
 }
 
 // http://dev.w3.org/webfonts/WOFF2/spec/Overview.html#hmtx_table_format
+// checksum may be NULL, then it isn't computed.
 bool ReconstructTransformedHmtx(const uint8_t* transformed_buf,
                                 size_t transformed_size,
                                 uint16_t num_glyphs,
                                 uint16_t num_hmetrics,
                                 const std::vector<int16_t>& x_mins,
                                 uint32_t* checksum,
+                                size_t dst_offset,
                                 WOFF2Out* out) {
   Buffer hmtx_buff_in(transformed_buf, transformed_size);
 
@@ -743,58 +1032,227 @@ bool ReconstructTransformedHmtx(const uint8_t* transformed_buf,
     return FONT_COMPRESSION_FAILURE();
   }
 
-  for (uint16_t i = 0; i < num_hmetrics; i++) {
-    uint16_t advance_width;
-    if (PREDICT_FALSE(!hmtx_buff_in.ReadU16(&advance_width))) {
-      return FONT_COMPRESSION_FAILURE();
-    }
-    advance_widths.push_back(advance_width);
+  advance_widths.resize(num_hmetrics);
+  if (PREDICT_FALSE(!hmtx_buff_in.ReadU16Array(&advance_widths[0],
+                                               num_hmetrics))) {
+    return FONT_COMPRESSION_FAILURE();
   }
 
-  for (uint16_t i = 0; i < num_hmetrics; i++) {
-    int16_t lsb;
-    if (has_proportional_lsbs) {
-      if (PREDICT_FALSE(!hmtx_buff_in.ReadS16(&lsb))) {
-        return FONT_COMPRESSION_FAILURE();
-      }
-    } else {
-      lsb = x_mins[i];
+  lsbs.resize(num_glyphs);
+  if (has_proportional_lsbs) {
+    if (PREDICT_FALSE(!hmtx_buff_in.ReadS16Array(&lsbs[0], num_hmetrics))) {
+      return FONT_COMPRESSION_FAILURE();
     }
-    lsbs.push_back(lsb);
+  } else {
+    std::copy(x_mins.begin(), x_mins.begin() + num_hmetrics, lsbs.begin());
   }
 
-  for (uint16_t i = num_hmetrics; i < num_glyphs; i++) {
-    int16_t lsb;
-    if (has_monospace_lsbs) {
-      if (PREDICT_FALSE(!hmtx_buff_in.ReadS16(&lsb))) {
-        return FONT_COMPRESSION_FAILURE();
-      }
-    } else {
-      lsb = x_mins[i];
+  if (has_monospace_lsbs) {
+    if (PREDICT_FALSE(!hmtx_buff_in.ReadS16Array(lsbs.data() + num_hmetrics,
+                                                 num_glyphs - num_hmetrics))) {
+      return FONT_COMPRESSION_FAILURE();
     }
-    lsbs.push_back(lsb);
+  } else {
+    std::copy(x_mins.begin() + num_hmetrics, x_mins.end(),
+              lsbs.begin() + num_hmetrics);
   }
 
   // bake me a shiny new hmtx table
   uint32_t hmtx_output_size = 2 * num_glyphs + 2 * num_hmetrics;
-  std::vector<uint8_t> hmtx_table(hmtx_output_size);
-  uint8_t* dst = &hmtx_table[0];
-  size_t dst_offset = 0;
+  std::vector<uint16_t> hmtx_values;
+  hmtx_values.reserve(num_glyphs + num_hmetrics);
   for (uint32_t i = 0; i < num_glyphs; i++) {
     if (i < num_hmetrics) {
-      Store16(advance_widths[i], &dst_offset, dst);
+      hmtx_values.push_back(advance_widths[i]);
     }
-    Store16(lsbs[i], &dst_offset, dst);
+    hmtx_values.push_back(lsbs[i]);
   }
+  std::vector<uint8_t> hmtx_table(hmtx_output_size);
+  StoreU16Array(&hmtx_table[0], 0, hmtx_values.data(), hmtx_values.size());
 
-  *checksum = ComputeULongSum(&hmtx_table[0], hmtx_output_size);
-  if (PREDICT_FALSE(!out->Write(&hmtx_table[0], hmtx_output_size))) {
+  if (checksum) {
+    *checksum = ComputeULongSum(&hmtx_table[0], hmtx_output_size);
+  }
+  if (PREDICT_FALSE(!out->Write(&hmtx_table[0], dst_offset,
+                                hmtx_output_size))) {
     return FONT_COMPRESSION_FAILURE();
   }
 
   return true;
 }
 
+// Copies n bytes from stream to dst at *offset, checking both ends.
+bool CopyFromStream(Buffer* stream, size_t n, std::vector<uint8_t>* dst,
+                    size_t* offset) {
+  if (PREDICT_FALSE(dst->size() - *offset < n ||
+                    !stream->Read(dst->data() + *offset, n))) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  *offset += n;
+  return true;
+}
+
+// Sets *length to the size of the packed point numbers next in stream.
+bool PeekPackedPointNumbers(const Buffer& stream, size_t* length) {
+  return PackedPointNumbersLength(stream.buffer() + stream.offset(),
+                                  stream.length() - stream.offset(), length);
+}
+
+// Rebuilds gvar from our private, non-standard transform; see
+// TransformGvarData in transform.cc for the layout. checksum may be NULL, then
+// it isn't computed.
+bool ReconstructTransformedGvar(const uint8_t* transformed_buf,
+                                size_t transformed_size,
+                                uint32_t dst_length,
+                                uint32_t* checksum,
+                                WOFF2Out* out) {
+  Buffer file(transformed_buf, transformed_size);
+  uint16_t axis_count, shared_tuple_count, glyph_count, flags;
+  uint32_t shared_tuples_offset, glyph_data_offset;
+  uint16_t transform_flags;
+  uint32_t header_stream_size, point_stream_size, delta_stream_size;
+  if (PREDICT_FALSE(!file.Skip(4) ||  // majorVersion, minorVersion
+      !file.ReadU16(&axis_count) || !file.ReadU16(&shared_tuple_count) ||
+      !file.ReadU32(&shared_tuples_offset) || !file.ReadU16(&glyph_count) ||
+      !file.ReadU16(&flags) || !file.ReadU32(&glyph_data_offset) ||
+      !file.ReadU16(&transform_flags) ||
+      !file.ReadU32(&header_stream_size) ||
+      !file.ReadU32(&point_stream_size) ||
+      !file.ReadU32(&delta_stream_size))) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  const bool long_offsets = (flags & 1) != 0;
+  const bool padded = (transform_flags & 1) != 0;
+  if (PREDICT_FALSE((transform_flags & ~1) != 0 ||
+                    (!long_offsets && !padded))) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  const uint64_t offsets_size =
+      (static_cast<uint64_t>(glyph_count) + 1) * (long_offsets ? 4 : 2);
+  const uint64_t shared_tuples_size =
+      static_cast<uint64_t>(shared_tuple_count) * axis_count * 2;
+  const uint64_t bitmap_size = ((glyph_count + 31) >> 5) << 2;
+  if (PREDICT_FALSE(shared_tuples_offset != kGvarHeaderSize + offsets_size ||
+      glyph_data_offset != shared_tuples_offset + shared_tuples_size ||
+      glyph_data_offset > dst_length)) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  if (PREDICT_FALSE(file.offset() + shared_tuples_size + bitmap_size +
+      header_stream_size + point_stream_size + delta_stream_size !=
+      transformed_size)) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+
+  std::vector<uint8_t> gvar(dst_length);
+  memcpy(gvar.data(), transformed_buf, kGvarHeaderSize);
+  size_t dst_offset = shared_tuples_offset;
+  if (PREDICT_FALSE(!CopyFromStream(&file, shared_tuples_size, &gvar,
+                                    &dst_offset))) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  const uint8_t* bitmap = transformed_buf + file.offset();
+  size_t stream_offset = file.offset() + bitmap_size;
+  Buffer header_stream(transformed_buf + stream_offset, header_stream_size);
+  stream_offset += header_stream_size;
+  Buffer point_stream(transformed_buf + stream_offset, point_stream_size);
+  stream_offset += point_stream_size;
+  Buffer delta_stream(transformed_buf + stream_offset, delta_stream_size);
+
+  size_t offsets_offset = kGvarHeaderSize;
+  std::vector<uint16_t> data_sizes;
+  std::vector<bool> private_points;
+  for (uint32_t i = 0; i <= glyph_count; ++i) {
+    const size_t glyph_offset = dst_offset - glyph_data_offset;
+    if (long_offsets) {
+      offsets_offset = StoreU32(gvar.data(), offsets_offset, glyph_offset);
+    } else {
+      if (PREDICT_FALSE(glyph_offset > 0x1fffe)) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      offsets_offset = Store16(gvar.data(), offsets_offset, glyph_offset >> 1);
+    }
+    if (i == glyph_count || (bitmap[i >> 3] & (0x80 >> (i & 7))) == 0) {
+      continue;
+    }
+
+    const size_t glyph_start = dst_offset;
+    uint16_t tuple_variation_count;
+    if (PREDICT_FALSE(!header_stream.ReadU16(&tuple_variation_count) ||
+                      gvar.size() - dst_offset < 4)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    dst_offset = Store16(gvar.data(), dst_offset, tuple_variation_count);
+    dst_offset += 2;  // dataOffset, filled in below
+    const int num_tuples = tuple_variation_count & 0x0fff;
+    data_sizes.resize(num_tuples);
+    private_points.resize(num_tuples);
+    for (int j = 0; j < num_tuples; ++j) {
+      uint16_t tuple_index;
+      if (PREDICT_FALSE(!header_stream.ReadU16(&data_sizes[j]) ||
+                        !header_stream.ReadU16(&tuple_index) ||
+                        gvar.size() - dst_offset < 4)) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      dst_offset = Store16(gvar.data(), dst_offset, data_sizes[j]);
+      dst_offset = Store16(gvar.data(), dst_offset, tuple_index);
+      size_t num_coordinates = 0;
+      if (tuple_index & 0x8000) num_coordinates += axis_count;
+      if (tuple_index & 0x4000) num_coordinates += 2 * axis_count;
+      private_points[j] = (tuple_index & 0x2000) != 0;
+      if (PREDICT_FALSE(!CopyFromStream(&header_stream, 2 * num_coordinates,
+                                        &gvar, &dst_offset))) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+    }
+    if (PREDICT_FALSE(dst_offset - glyph_start > 0xffff)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    Store16(gvar.data(), glyph_start + 2, dst_offset - glyph_start);
+
+    size_t points_length;
+    if (tuple_variation_count & 0x8000) {
+      if (PREDICT_FALSE(!PeekPackedPointNumbers(point_stream, &points_length) ||
+          !CopyFromStream(&point_stream, points_length, &gvar, &dst_offset))) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+    }
+    for (int j = 0; j < num_tuples; ++j) {
+      points_length = 0;
+      if (private_points[j] &&
+          PREDICT_FALSE(!PeekPackedPointNumbers(point_stream,
+                                                &points_length))) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      if (PREDICT_FALSE(points_length > data_sizes[j] ||
+          !CopyFromStream(&point_stream, points_length, &gvar, &dst_offset) ||
+          !CopyFromStream(&delta_stream, data_sizes[j] - points_length, &gvar,
+                          &dst_offset))) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+    }
+    if (padded && ((dst_offset - glyph_start) & 1) != 0) {
+      if (PREDICT_FALSE(dst_offset == gvar.size())) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      gvar[dst_offset++] = 0;
+    }
+  }
+  if (PREDICT_FALSE(dst_offset != gvar.size() ||
+      header_stream.offset() != header_stream.length() ||
+      point_stream.offset() != point_stream.length() ||
+      delta_stream.offset() != delta_stream.length())) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+
+  if (checksum) {
+    *checksum = ComputeULongSum(gvar.data(), gvar.size());
+  }
+  if (PREDICT_FALSE(!out->Write(gvar.data(), gvar.size()))) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  return true;
+}
+
 bool Woff2Uncompress(uint8_t* dst_buf, size_t dst_size,
   const uint8_t* src_buf, size_t src_size) {
   size_t uncompressed_size = dst_size;
@@ -807,6 +1265,58 @@ bool Woff2Uncompress(uint8_t* dst_buf, size_t dst_size,
   return true;
 }
 
+// Decompresses the table data of a multi-stream file, whose compressed data
+// starts with the stream index, each stream into its range of dst_buf, on up
+// to num_threads threads. On failure, *error_offset is the offset in src_buf
+// of the index or of the first stream that failed.
+bool Woff2UncompressStreams(uint8_t* dst_buf, size_t dst_size,
+                            const uint8_t* src_buf, size_t src_size,
+                            int num_threads, size_t* error_offset) {
+  *error_offset = 0;
+  Buffer index(src_buf, src_size);
+  unsigned int num_streams;
+  if (PREDICT_FALSE(!Read255UShort(&index, &num_streams) ||
+                    num_streams == 0 || num_streams > kMaxWoff2Streams)) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  std::vector<uint32_t> dst_lengths(num_streams);
+  std::vector<uint32_t> src_lengths(num_streams);
+  uint64_t dst_total = 0;
+  uint64_t src_total = 0;
+  for (unsigned int i = 0; i < num_streams; ++i) {
+    if (PREDICT_FALSE(!ReadBase128(&index, &dst_lengths[i]) ||
+                      !ReadBase128(&index, &src_lengths[i]))) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    dst_total += dst_lengths[i];
+    src_total += src_lengths[i];
+  }
+  if (PREDICT_FALSE(dst_total != dst_size ||
+                    src_total != src_size - index.offset())) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+
+  std::vector<size_t> dst_offsets(num_streams, 0);
+  std::vector<size_t> src_offsets(num_streams, index.offset());
+  for (unsigned int i = 1; i < num_streams; ++i) {
+    dst_offsets[i] = dst_offsets[i - 1] + dst_lengths[i - 1];
+    src_offsets[i] = src_offsets[i - 1] + src_lengths[i - 1];
+  }
+  std::vector<char> uncompressed(num_streams, 0);
+  RunParallel(num_streams, std::max(num_threads, 0), [&](size_t i) {
+    uncompressed[i] = Woff2Uncompress(dst_buf + dst_offsets[i],
+                                      dst_lengths[i], src_buf + src_offsets[i],
+                                      src_lengths[i]);
+  });
+  for (unsigned int i = 0; i < num_streams; ++i) {
+    if (PREDICT_FALSE(!uncompressed[i])) {
+      *error_offset = src_offsets[i];
+      return FONT_COMPRESSION_FAILURE();
+    }
+  }
+  return true;
+}
+
 bool ReadTableDirectory(Buffer* file, std::vector<Table>* tables,
     size_t num_tables) {
   uint32_t src_offset = 0;
@@ -920,20 +1430,34 @@ std::vector<Table*> Tables(WOFF2Header* hdr, size_t font_index) {
 
 // Offset tables assumed to have been written in with 0's initially.
 // WOFF2Header isn't const so we can use [] instead of at() (which upsets FF)
+// glyf_facts may be NULL, then they aren't gathered.
 bool ReconstructFont(uint8_t* transformed_buf,
                      const uint32_t transformed_buf_size,
                      RebuildMetadata* metadata,
                      WOFF2Header* hdr,
                      size_t font_index,
+                     WOFF2GlyfFacts* glyf_facts,
                      WOFF2Out* out) {
   size_t dest_offset = out->Size();
   uint8_t table_entry[12];
   WOFF2FontInfo* info = &metadata->font_infos[font_index];
   std::vector<Table*> tables = Tables(hdr, font_index);
+  Table* glyf_table = NULL;
+  Table* loca_table = NULL;
+  Table* head_table = NULL;
+  const Table* maxp_table = NULL;
+  const Table* hhea_table = NULL;
+  for (Table* table : tables) {
+    switch (table->tag) {
+      case kGlyfTableTag: glyf_table = table; break;
+      case kLocaTableTag: loca_table = table; break;
+      case kHeadTableTag: head_table = table; break;
+      case kMaxpTableTag: maxp_table = table; break;
+      case kHheaTableTag: hhea_table = table; break;
+    }
+  }
 
   // 'glyf' without 'loca' doesn't make sense
-  const Table* glyf_table = FindTable(&tables, kGlyfTableTag);
-  const Table* loca_table = FindTable(&tables, kLocaTableTag);
   if (PREDICT_FALSE(static_cast<bool>(glyf_table) !=
                     static_cast<bool>(loca_table))) {
 #ifdef FONT_COMPRESSION_BIN
@@ -952,18 +1476,77 @@ bool ReconstructFont(uint8_t* transformed_buf,
     }
   }
 
+  // hmtx needs numberOfHMetrics, wherever hhea is laid out.
+  if (hhea_table != NULL) {
+    if (PREDICT_FALSE(static_cast<uint64_t>(hhea_table->src_offset) +
+        hhea_table->src_length > transformed_buf_size)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    if (!ReadNumHMetrics(transformed_buf + hhea_table->src_offset,
+        hhea_table->src_length, &info->num_hmetrics)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+  }
+
+  // Indices into tables in the order to lay the tables out.
+  std::vector<size_t> order(tables.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  if (metadata->table_order != NULL && !metadata->table_order->empty()) {
+    const std::vector<uint32_t>& table_order = *metadata->table_order;
+    std::vector<size_t> ranks(tables.size());
+    for (size_t i = 0; i < tables.size(); ++i) {
+      ranks[i] = std::find(table_order.begin(), table_order.end(),
+                           tables[i]->tag) - table_order.begin();
+    }
+    std::stable_sort(order.begin(), order.end(), [&ranks](size_t a, size_t b) {
+      return ranks[a] < ranks[b];
+    });
+  }
+
   uint32_t font_checksum = metadata->header_checksum;
   if (hdr->header_version) {
     font_checksum = hdr->ttc_fonts[font_index].header_checksum;
   }
 
+  const bool checksums = !metadata->skip_checksums;
+  // Fills in the directory entry of tables[i] once its data is written.
+  auto write_entry = [&](size_t i, uint32_t checksum) {
+    const Table& table = *tables[i];
+    font_checksum += checksum;
+
+    // update the table entry with real values.
+    StoreU32(table_entry, 0, checksum);
+    StoreU32(table_entry, 4, table.dst_offset);
+    StoreU32(table_entry, 8, table.dst_length);
+    if (PREDICT_FALSE(!out->Write(table_entry,
+        info->table_entry_offsets[i] + 4, 12))) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+
+    // We replaced 0's. Update overall checksum.
+    if (checksums) {
+      font_checksum += ComputeULongSum(table_entry, 12);
+    }
+    return true;
+  };
+
+  size_t phase_start = out->Size();
+  ScopedPhase tables_phase(metadata->phase_observer,
+                           kWOFF2PhaseReconstructTables);
+
   uint32_t loca_checksum = 0;
-  for (size_t i = 0; i < tables.size(); i++) {
+  // A transformed loca or hmtx laid out before glyf can only be rebuilt once
+  // glyf is; until then its room is set aside, and it is listed here.
+  bool loca_reserved = false;
+  std::vector<size_t> deferred;
+  for (size_t i : order) {
     Table& table = *tables[i];
+    metadata->current_table = &table;
 
-    std::pair<uint32_t, uint32_t> checksum_key = {table.tag, table.src_offset};
-    bool reused = metadata->checksums.find(checksum_key)
-               != metadata->checksums.end();
+    const size_t table_index = tables[i] - &hdr->tables[0];
+    bool reused = metadata->written[table_index];
     if (PREDICT_FALSE(font_index == 0 && reused)) {
       return FONT_COMPRESSION_FAILURE();
     }
@@ -975,14 +1558,8 @@ bool ReconstructFont(uint8_t* transformed_buf,
       return FONT_COMPRESSION_FAILURE();
     }
 
-    if (table.tag == kHheaTableTag) {
-      if (!ReadNumHMetrics(transformed_buf + table.src_offset,
-          table.src_length, &info->num_hmetrics)) {
-        return FONT_COMPRESSION_FAILURE();
-      }
-    }
-
     uint32_t checksum = 0;
+    bool defer = false;
     if (!reused) {
       if ((table.flags & kWoff2FlagsTransform) != kWoff2FlagsTransform) {
         if (table.tag == kHeadTableTag) {
@@ -993,55 +1570,87 @@ bool ReconstructFont(uint8_t* transformed_buf,
           StoreU32(transformed_buf + table.src_offset, 8, 0);
         }
         table.dst_offset = dest_offset;
-        checksum = ComputeULongSum(transformed_buf + table.src_offset,
-                                   table.src_length);
+        if (checksums) {
+          checksum = ComputeULongSum(transformed_buf + table.src_offset,
+                                     table.src_length);
+        }
         if (PREDICT_FALSE(!out->Write(transformed_buf + table.src_offset,
             table.src_length))) {
           return FONT_COMPRESSION_FAILURE();
         }
       } else {
+        const bool glyf_pending = glyf_table != NULL &&
+            !metadata->written[glyf_table - &hdr->tables[0]];
         if (table.tag == kGlyfTableTag) {
           table.dst_offset = dest_offset;
 
-          Table* loca_table = FindTable(&tables, kLocaTableTag);
+          WOFF2GlyfFacts* facts = NULL;
+          if (glyf_facts) {
+            facts = &metadata->glyf_facts[table.src_offset];
+          }
+          tables_phase.End(out->Size() - phase_start);
+          ScopedPhase glyf_phase(metadata->phase_observer,
+                                 kWOFF2PhaseReconstructGlyf);
           if (PREDICT_FALSE(!ReconstructGlyf(transformed_buf + table.src_offset,
-              &table, &checksum, loca_table, &loca_checksum, info, out))) {
+              &table, checksums ? &checksum : NULL, loca_table,
+              checksums ? &loca_checksum : NULL, loca_reserved, info, facts,
+              out))) {
             return FONT_COMPRESSION_FAILURE();
           }
+          glyf_phase.End(info->num_glyphs);
+          tables_phase.Begin();
+          phase_start = out->Size();
         } else if (table.tag == kLocaTableTag) {
+          if (glyf_pending) {
+            defer = true;
+            loca_reserved = true;
+          }
           // All the work was done by ReconstructGlyf. We already know checksum.
           checksum = loca_checksum;
         } else if (table.tag == kHmtxTableTag) {
           table.dst_offset = dest_offset;
-          // Tables are sorted so all the info we need has been gathered.
-          if (PREDICT_FALSE(!ReconstructTransformedHmtx(
+          // Rebuilding hmtx takes the x_mins gathered from glyf.
+          if (glyf_pending) {
+            defer = true;
+          } else if (PREDICT_FALSE(!ReconstructTransformedHmtx(
               transformed_buf + table.src_offset, table.src_length,
-              info->num_glyphs, info->num_hmetrics, info->x_mins, &checksum,
-              out))) {
+              info->num_glyphs, info->num_hmetrics, info->x_mins,
+              checksums ? &checksum : NULL, table.dst_offset, out))) {
+            return FONT_COMPRESSION_FAILURE();
+          }
+        } else if (table.tag == kGvarTableTag &&
+                   (table.flags & 3) == kGvarPrivateTransformVersion &&
+                   metadata->allow_gvar_transform) {
+          table.dst_offset = dest_offset;
+          if (PREDICT_FALSE(!ReconstructTransformedGvar(
+              transformed_buf + table.src_offset, table.src_length,
+              table.dst_length, checksums ? &checksum : NULL, out))) {
             return FONT_COMPRESSION_FAILURE();
           }
         } else {
           return FONT_COMPRESSION_FAILURE();  // transform unknown
         }
       }
-      metadata->checksums[checksum_key] = checksum;
+      if (defer) {
+        // Extend the output over the table so that what follows goes after.
+        table.dst_offset = dest_offset;
+        const uint8_t zero = 0;
+        if (PREDICT_FALSE(table.dst_length > 0 && !out->Write(&zero,
+            dest_offset + table.dst_length - 1, 1))) {
+          return FONT_COMPRESSION_FAILURE();
+        }
+        deferred.push_back(i);
+      } else {
+        metadata->written[table_index] = true;
+        metadata->checksums[table_index] = checksum;
+      }
     } else {
-      checksum = metadata->checksums[checksum_key];
+      checksum = metadata->checksums[table_index];
     }
-    font_checksum += checksum;
-
-    // update the table entry with real values.
-    StoreU32(table_entry, 0, checksum);
-    StoreU32(table_entry, 4, table.dst_offset);
-    StoreU32(table_entry, 8, table.dst_length);
-    if (PREDICT_FALSE(!out->Write(table_entry,
-        info->table_entry_by_tag[table.tag] + 4, 12))) {
+    if (!defer && !write_entry(i, checksum)) {
       return FONT_COMPRESSION_FAILURE();
     }
 
-    // We replaced 0's. Update overall checksum.
-    font_checksum += ComputeULongSum(table_entry, 12);
-
     if (PREDICT_FALSE(!Pad4(out))) {
       return FONT_COMPRESSION_FAILURE();
     }
@@ -1053,63 +1662,109 @@ bool ReconstructFont(uint8_t* transformed_buf,
     dest_offset = out->Size();
   }
 
+  for (size_t i : deferred) {
+    Table& table = *tables[i];
+    metadata->current_table = &table;
+    uint32_t checksum = 0;
+    if (table.tag == kLocaTableTag) {
+      checksum = loca_checksum;
+    } else {
+      // Rebuilt hmtx has to fit the room set aside for it exactly.
+      if (PREDICT_FALSE(2 * static_cast<uint32_t>(info->num_glyphs) +
+          2 * info->num_hmetrics != table.dst_length)) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      if (PREDICT_FALSE(!ReconstructTransformedHmtx(
+          transformed_buf + table.src_offset, table.src_length,
+          info->num_glyphs, info->num_hmetrics, info->x_mins,
+          checksums ? &checksum : NULL, table.dst_offset, out))) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+    }
+    const size_t table_index = tables[i] - &hdr->tables[0];
+    metadata->written[table_index] = true;
+    metadata->checksums[table_index] = checksum;
+    if (!write_entry(i, checksum)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+  }
+  metadata->current_table = NULL;
+
+  if (glyf_facts) {
+    *glyf_facts = WOFF2GlyfFacts();
+    if (glyf_table != NULL &&
+        (glyf_table->flags & kWoff2FlagsTransform) != 0) {
+      *glyf_facts = metadata->glyf_facts[glyf_table->src_offset];
+      glyf_facts->maxp_consistent = maxp_table != NULL &&
+          (maxp_table->flags & kWoff2FlagsTransform) == 0 &&
+          MaxpConsistent(transformed_buf + maxp_table->src_offset,
+                         maxp_table->src_length, *glyf_facts);
+    }
+  }
+
   // Update 'head' checkSumAdjustment. We already set it to 0 and summed font.
-  Table* head_table = FindTable(&tables, kHeadTableTag);
   if (head_table) {
     if (PREDICT_FALSE(head_table->dst_length < 12)) {
       return FONT_COMPRESSION_FAILURE();
     }
     uint8_t checksum_adjustment[4];
     StoreU32(checksum_adjustment, 0, 0xB1B0AFBA - font_checksum);
-    if (PREDICT_FALSE(!out->Write(checksum_adjustment,
-                                  head_table->dst_offset + 8, 4))) {
+    if (checksums && PREDICT_FALSE(!out->Write(
+        checksum_adjustment, head_table->dst_offset + 8, 4))) {
       return FONT_COMPRESSION_FAILURE();
     }
   }
 
+  tables_phase.End(out->Size() - phase_start);
   return true;
 }
 
-bool ReadWOFF2Header(const uint8_t* data, size_t length, WOFF2Header* hdr) {
-  Buffer file(data, length);
+// Reads the header and directories from file, which holds the whole input.
+// On failure, file is left where the bad data is. Our private multi-stream
+// variant is accepted only if allow_multi_stream.
+bool ReadWOFF2Header(size_t length, bool allow_multi_stream, Buffer* file,
+                     WOFF2Header* hdr) {
 
   uint32_t signature;
-  if (PREDICT_FALSE(!file.ReadU32(&signature) || signature != kWoff2Signature ||
-      !file.ReadU32(&hdr->flavor))) {
+  if (PREDICT_FALSE(!file->ReadU32(&signature) ||
+      (signature != kWoff2Signature &&
+       (signature != kWoff2MultiStreamSignature || !allow_multi_stream)) ||
+      !file->ReadU32(&hdr->flavor))) {
     return FONT_COMPRESSION_FAILURE();
   }
+  hdr->multi_stream = signature == kWoff2MultiStreamSignature;
 
   // TODO(user): Should call IsValidVersionTag() here.
 
   uint32_t reported_length;
   if (PREDICT_FALSE(
-      !file.ReadU32(&reported_length) || length != reported_length)) {
+      !file->ReadU32(&reported_length) || length != reported_length)) {
     return FONT_COMPRESSION_FAILURE();
   }
-  if (PREDICT_FALSE(!file.ReadU16(&hdr->num_tables) || !hdr->num_tables)) {
+  if (PREDICT_FALSE(!file->ReadU16(&hdr->num_tables) || !hdr->num_tables)) {
     return FONT_COMPRESSION_FAILURE();
   }
 
   // We don't care about these fields of the header:
   //   uint16_t reserved
   //   uint32_t total_sfnt_size, we don't believe this, will compute later
-  if (PREDICT_FALSE(!file.Skip(6))) {
+  if (PREDICT_FALSE(!file->Skip(6))) {
     return FONT_COMPRESSION_FAILURE();
   }
-  if (PREDICT_FALSE(!file.ReadU32(&hdr->compressed_length))) {
+  if (PREDICT_FALSE(!file->ReadU32(&hdr->compressed_length))) {
     return FONT_COMPRESSION_FAILURE();
   }
   // We don't care about these fields of the header:
   //   uint16_t major_version, minor_version
-  if (PREDICT_FALSE(!file.Skip(2 * 2))) {
+  if (PREDICT_FALSE(!file->Skip(2 * 2))) {
     return FONT_COMPRESSION_FAILURE();
   }
   uint32_t meta_offset;
   uint32_t meta_length;
   uint32_t meta_length_orig;
-  if (PREDICT_FALSE(!file.ReadU32(&meta_offset) ||
-      !file.ReadU32(&meta_length) ||
-      !file.ReadU32(&meta_length_orig))) {
+  if (PREDICT_FALSE(!file->ReadU32(&meta_offset) ||
+      !file->ReadU32(&meta_length) ||
+      !file->ReadU32(&meta_length_orig))) {
     return FONT_COMPRESSION_FAILURE();
   }
   if (meta_offset) {
@@ -1120,8 +1775,8 @@ bool ReadWOFF2Header(const uint8_t* data, size_t length, WOFF2Header* hdr) {
   }
   uint32_t priv_offset;
   uint32_t priv_length;
-  if (PREDICT_FALSE(!file.ReadU32(&priv_offset) ||
-      !file.ReadU32(&priv_length))) {
+  if (PREDICT_FALSE(!file->ReadU32(&priv_offset) ||
+      !file->ReadU32(&priv_length))) {
     return FONT_COMPRESSION_FAILURE();
   }
   if (priv_offset) {
@@ -1132,7 +1787,7 @@ bool ReadWOFF2Header(const uint8_t* data, size_t length, WOFF2Header* hdr) {
   }
   hdr->tables.resize(hdr->num_tables);
   if (PREDICT_FALSE(!ReadTableDirectory(
-          &file, &hdr->tables, hdr->num_tables))) {
+          file, &hdr->tables, hdr->num_tables))) {
     return FONT_COMPRESSION_FAILURE();
   }
 
@@ -1146,7 +1801,7 @@ bool ReadWOFF2Header(const uint8_t* data, size_t length, WOFF2Header* hdr) {
   hdr->header_version = 0;
 
   if (hdr->flavor == kTtcFontFlavor) {
-    if (PREDICT_FALSE(!file.ReadU32(&hdr->header_version))) {
+    if (PREDICT_FALSE(!file->ReadU32(&hdr->header_version))) {
       return FONT_COMPRESSION_FAILURE();
     }
     if (PREDICT_FALSE(hdr->header_version != 0x00010000
@@ -1154,7 +1809,7 @@ bool ReadWOFF2Header(const uint8_t* data, size_t length, WOFF2Header* hdr) {
       return FONT_COMPRESSION_FAILURE();
     }
     uint32_t num_fonts;
-    if (PREDICT_FALSE(!Read255UShort(&file, &num_fonts) || !num_fonts)) {
+    if (PREDICT_FALSE(!Read255UShort(file, &num_fonts) || !num_fonts)) {
       return FONT_COMPRESSION_FAILURE();
     }
     hdr->ttc_fonts.resize(num_fonts);
@@ -1162,10 +1817,10 @@ bool ReadWOFF2Header(const uint8_t* data, size_t length, WOFF2Header* hdr) {
     for (uint32_t i = 0; i < num_fonts; i++) {
       TtcFont& ttc_font = hdr->ttc_fonts[i];
       uint32_t num_tables;
-      if (PREDICT_FALSE(!Read255UShort(&file, &num_tables) || !num_tables)) {
+      if (PREDICT_FALSE(!Read255UShort(file, &num_tables) || !num_tables)) {
         return FONT_COMPRESSION_FAILURE();
       }
-      if (PREDICT_FALSE(!file.ReadU32(&ttc_font.flavor))) {
+      if (PREDICT_FALSE(!file->ReadU32(&ttc_font.flavor))) {
         return FONT_COMPRESSION_FAILURE();
       }
 
@@ -1177,7 +1832,7 @@ bool ReadWOFF2Header(const uint8_t* data, size_t length, WOFF2Header* hdr) {
 
       for (uint32_t j = 0; j < num_tables; j++) {
         unsigned int table_idx;
-        if (PREDICT_FALSE(!Read255UShort(&file, &table_idx)) ||
+        if (PREDICT_FALSE(!Read255UShort(file, &table_idx)) ||
             table_idx >= hdr->tables.size()) {
           return FONT_COMPRESSION_FAILURE();
         }
@@ -1208,7 +1863,7 @@ bool ReadWOFF2Header(const uint8_t* data, size_t length, WOFF2Header* hdr) {
 
   const uint64_t first_table_offset = ComputeOffsetToFirstTable(*hdr);
 
-  hdr->compressed_offset = file.offset();
+  hdr->compressed_offset = file->offset();
   if (PREDICT_FALSE(hdr->compressed_offset >
                     std::numeric_limits<uint32_t>::max())) {
     return FONT_COMPRESSION_FAILURE();
@@ -1257,24 +1912,41 @@ bool WriteHeaders(const uint8_t* data, size_t length, RebuildMetadata* metadata,
                   WOFF2Header* hdr, WOFF2Out* out) {
   std::vector<uint8_t> output(ComputeOffsetToFirstTable(*hdr), 0);
 
-  // Re-order tables in output (OTSpec) order
-  std::vector<Table> sorted_tables(hdr->tables);
+  // Re-order tables in output (OTSpec) order. A collection font's tables
+  // are reconstructed in that order too, so sort its table indices; a plain
+  // font's tables are reconstructed in file order, so sort a permutation.
+  auto by_tag = [hdr](uint16_t a, uint16_t b) {
+    return hdr->tables[a].tag < hdr->tables[b].tag;
+  };
+  auto same_tag = [hdr](uint16_t a, uint16_t b) {
+    return hdr->tables[a].tag == hdr->tables[b].tag;
+  };
+  std::vector<uint16_t> sorted_indices;
   if (hdr->header_version) {
-    // collection; we have to sort the table offset vector in each font
     for (auto& ttc_font : hdr->ttc_fonts) {
-      std::map<uint32_t, uint16_t> sorted_index_by_tag;
-      for (auto table_index : ttc_font.table_indices) {
-        sorted_index_by_tag[hdr->tables[table_index].tag] = table_index;
-      }
-      uint16_t index = 0;
-      for (auto& i : sorted_index_by_tag) {
-        ttc_font.table_indices[index++] = i.second;
+      std::sort(ttc_font.table_indices.begin(), ttc_font.table_indices.end(),
+                by_tag);
+      if (PREDICT_FALSE(std::adjacent_find(ttc_font.table_indices.begin(),
+                                           ttc_font.table_indices.end(),
+                                           same_tag) !=
+                        ttc_font.table_indices.end())) {
+        return FONT_COMPRESSION_FAILURE();
       }
     }
   } else {
-    // non-collection; we can just sort the tables
-    std::sort(sorted_tables.begin(), sorted_tables.end());
+    sorted_indices.resize(hdr->num_tables);
+    for (uint16_t i = 0; i < hdr->num_tables; ++i) {
+      sorted_indices[i] = i;
+    }
+    std::sort(sorted_indices.begin(), sorted_indices.end(), by_tag);
+    if (PREDICT_FALSE(std::adjacent_find(sorted_indices.begin(),
+                                         sorted_indices.end(), same_tag) !=
+                      sorted_indices.end())) {
+      return FONT_COMPRESSION_FAILURE();
+    }
   }
+  metadata->written.assign(hdr->tables.size(), false);
+  metadata->checksums.assign(hdr->tables.size(), 0);
 
   // Start building the font
   uint8_t* result = &output[0];
@@ -1310,27 +1982,33 @@ bool WriteHeaders(const uint8_t* data, size_t length, RebuildMetadata* metadata,
                                 ttc_font.table_indices.size());
 
       for (const auto table_index : ttc_font.table_indices) {
-        uint32_t tag = hdr->tables[table_index].tag;
-        metadata->font_infos[i].table_entry_by_tag[tag] = offset;
-        offset = StoreTableEntry(result, offset, tag);
+        metadata->font_infos[i].table_entry_offsets.push_back(offset);
+        offset = StoreTableEntry(result, offset, hdr->tables[table_index].tag);
       }
 
-      ttc_font.header_checksum = ComputeULongSum(&output[ttc_font.dst_offset],
-                                                 offset - ttc_font.dst_offset);
+      ttc_font.header_checksum = 0;
+      if (!metadata->skip_checksums) {
+        ttc_font.header_checksum = ComputeULongSum(
+            &output[ttc_font.dst_offset], offset - ttc_font.dst_offset);
+      }
     }
   } else {
     metadata->font_infos.resize(1);
     offset = StoreOffsetTable(result, offset, hdr->flavor, hdr->num_tables);
-    for (uint16_t i = 0; i < hdr->num_tables; ++i) {
-      metadata->font_infos[0].table_entry_by_tag[sorted_tables[i].tag] = offset;
-      offset = StoreTableEntry(result, offset, sorted_tables[i].tag);
+    metadata->font_infos[0].table_entry_offsets.resize(hdr->num_tables);
+    for (const auto table_index : sorted_indices) {
+      metadata->font_infos[0].table_entry_offsets[table_index] = offset;
+      offset = StoreTableEntry(result, offset, hdr->tables[table_index].tag);
     }
   }
 
   if (PREDICT_FALSE(!out->Write(&output[0], output.size()))) {
     return FONT_COMPRESSION_FAILURE();
   }
-  metadata->header_checksum = ComputeULongSum(&output[0], output.size());
+  metadata->header_checksum = 0;
+  if (!metadata->skip_checksums) {
+    metadata->header_checksum = ComputeULongSum(&output[0], output.size());
+  }
   return true;
 }
 
@@ -1353,16 +2031,79 @@ bool ConvertWOFF2ToTTF(uint8_t *result, size_t result_length,
   return ConvertWOFF2ToTTF(data, length, &out);
 }
 
+std::vector<uint32_t> LoadOrderTableTags() {
+  static const char* const kTags[] = {
+    "head", "hhea", "maxp", "OS/2", "hmtx", "cmap", "post", "vhea", "vmtx",
+    "fvar", "avar", "STAT", "HVAR", "VVAR", "MVAR", "GDEF", "GSUB", "GPOS",
+    "kern", "gasp", "cvt ", "fpgm", "prep", "cvar", "CPAL", "COLR", "VORG",
+    "name", "loca", "glyf", "CFF ", "CFF2", "gvar",
+  };
+  std::vector<uint32_t> tags;
+  for (const char* tag : kTags) {
+    tags.push_back((tag[0] << 24) | (tag[1] << 16) | (tag[2] << 8) | tag[3]);
+  }
+  return tags;
+}
+
 bool ConvertWOFF2ToTTF(const uint8_t* data, size_t length,
                        WOFF2Out* out) {
+  WOFF2DecodeParams params;
+  return ConvertWOFF2ToTTF(data, length, out, params);
+}
+
+namespace {
+
+// Passes writes on to another WOFF2Out, noting whether any of them failed,
+// and whether one did for lack of room.
+class WriteWatchingOut : public WOFF2Out {
+ public:
+  explicit WriteWatchingOut(WOFF2Out* out)
+      : out_(out), failed_(false), out_of_room_(false) {}
+
+  bool Write(const void *buf, size_t n) override {
+    const size_t offset = out_->Size();
+    return Watch(out_->Write(buf, n), offset, n);
+  }
+  bool Write(const void *buf, size_t offset, size_t n) override {
+    return Watch(out_->Write(buf, offset, n), offset, n);
+  }
+  size_t Size() override { return out_->Size(); }
+  size_t MaxSize() override { return out_->MaxSize(); }
+
+  bool failed() const { return failed_; }
+  bool out_of_room() const { return out_of_room_; }
+
+ private:
+  bool Watch(bool ok, size_t offset, size_t n) {
+    if (PREDICT_FALSE(!ok)) {
+      const size_t max_size = out_->MaxSize();
+      failed_ = true;
+      out_of_room_ |= offset > max_size || n > max_size - offset;
+    }
+    return ok;
+  }
+
+  WOFF2Out* out_;
+  bool failed_;
+  bool out_of_room_;
+};
+
+bool DecodeWOFF2(const uint8_t* data, size_t length, WOFF2Out* out,
+                 const WOFF2DecodeParams& params, WOFF2Error* error) {
   RebuildMetadata metadata;
+  metadata.skip_checksums = params.skip_checksums;
+  metadata.allow_gvar_transform = params.allow_gvar_transform;
+  metadata.table_order = &params.table_order;
+  metadata.phase_observer = params.phase_observer;
+  metadata.current_table = NULL;
   WOFF2Header hdr;
-  if (!ReadWOFF2Header(data, length, &hdr)) {
-    return FONT_COMPRESSION_FAILURE();
+  Buffer file(data, length);
+  if (!ReadWOFF2Header(length, params.allow_multi_stream, &file, &hdr)) {
+    return ReportError(error, kWOFF2ErrorInvalidInput, 0, file.offset());
   }
 
   if (!WriteHeaders(data, length, &metadata, &hdr, out)) {
-    return FONT_COMPRESSION_FAILURE();
+    return ReportError(error, kWOFF2ErrorInvalidInput, 0, 0);
   }
 
   const float compression_ratio = (float) hdr.uncompressed_size / length;
@@ -1370,29 +2111,76 @@ bool ConvertWOFF2ToTTF(const uint8_t* data, size_t length,
 #ifdef FONT_COMPRESSION_BIN
     fprintf(stderr, "Implausible compression ratio %.01f\n", compression_ratio);
 #endif
-    return FONT_COMPRESSION_FAILURE();
+    return ReportError(error, kWOFF2ErrorLimitExceeded, 0, 0);
   }
 
   const uint8_t* src_buf = data + hdr.compressed_offset;
-  std::vector<uint8_t> uncompressed_buf(hdr.uncompressed_size);
+  // The zeroed guard lets the glyf kernels read past the end of a stream and
+  // check the bounds once per block instead of once per value.
+  std::vector<uint8_t> uncompressed_buf(hdr.uncompressed_size +
+                                        kDecodeGuardSize);
   if (PREDICT_FALSE(hdr.uncompressed_size < 1)) {
-    return FONT_COMPRESSION_FAILURE();
+    return ReportError(error, kWOFF2ErrorInvalidInput, 0,
+                       hdr.compressed_offset);
+  }
+  ScopedPhase decompress_phase(params.phase_observer, kWOFF2PhaseDecompress);
+  if (hdr.multi_stream) {
+    size_t error_offset;
+    if (PREDICT_FALSE(!Woff2UncompressStreams(&uncompressed_buf[0],
+                                              hdr.uncompressed_size, src_buf,
+                                              hdr.compressed_length,
+                                              params.num_threads,
+                                              &error_offset))) {
+      return ReportError(error, kWOFF2ErrorInvalidInput, 0,
+                         hdr.compressed_offset + error_offset);
+    }
+  } else if (PREDICT_FALSE(!Woff2Uncompress(&uncompressed_buf[0],
+                                            hdr.uncompressed_size, src_buf,
+                                            hdr.compressed_length))) {
+    return ReportError(error, kWOFF2ErrorInvalidInput, 0,
+                       hdr.compressed_offset);
+  }
+  decompress_phase.End(hdr.uncompressed_size);
+
+  if (params.glyf_facts) {
+    params.glyf_facts->resize(metadata.font_infos.size());
   }
-  if (PREDICT_FALSE(!Woff2Uncompress(&uncompressed_buf[0],
-                                     hdr.uncompressed_size, src_buf,
-                                     hdr.compressed_length))) {
-    return FONT_COMPRESSION_FAILURE();
-  }
-
   for (size_t i = 0; i < metadata.font_infos.size(); i++) {
+    WOFF2GlyfFacts* glyf_facts = NULL;
+    if (params.glyf_facts) {
+      glyf_facts = &(*params.glyf_facts)[i];
+    }
     if (PREDICT_FALSE(!ReconstructFont(&uncompressed_buf[0],
                                        hdr.uncompressed_size,
-                                       &metadata, &hdr, i, out))) {
-      return FONT_COMPRESSION_FAILURE();
+                                       &metadata, &hdr, i, glyf_facts, out))) {
+      const Table* table = metadata.current_table;
+      return ReportError(error, kWOFF2ErrorInvalidInput,
+                         table ? table->tag : 0, table ? table->src_offset : 0);
     }
   }
 
   return true;
 }
 
+}  // namespace
+
+bool ConvertWOFF2ToTTF(const uint8_t* data, size_t length,
+                       WOFF2Out* out, const WOFF2DecodeParams& params) {
+  if (params.error == NULL) {
+    return DecodeWOFF2(data, length, out, params, NULL);
+  }
+  WriteWatchingOut watched_out(out);
+  if (DecodeWOFF2(data, length, &watched_out, params, params.error)) {
+    return true;
+  }
+  // Whatever gave up first, a failed write is the reason: a write that
+  // didn't fit, or one the output refused although it had room.
+  if (watched_out.out_of_room()) {
+    params.error->code = kWOFF2ErrorOutputTooSmall;
+  } else if (watched_out.failed()) {
+    params.error->code = kWOFF2ErrorInternal;
+  }
+  return false;
+}
+
 } // namespace woff2
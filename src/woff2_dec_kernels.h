@@ -0,0 +1,53 @@
+/* Copyright 2026 Google Inc. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Inner loops of the glyf/loca reconstruction. Not part of the public API;
+   declared here so woff2_microbench can time them in isolation. */
+
+#ifndef WOFF2_WOFF2_DEC_KERNELS_H_
+#define WOFF2_WOFF2_DEC_KERNELS_H_
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <vector>
+#include <woff2/output.h>
+
+#include "./woff2_common.h"
+
+namespace woff2 {
+
+// Number of readable bytes the decoder keeps after the decompressed tables,
+// so that the glyf kernels may read past the end of a stream.
+const size_t kDecodeGuardSize = 32;
+
+// Decodes n_points triplets, using one flag byte each from flags_in and
+// their data bytes from in, into absolute points. in_slack is the number of
+// readable bytes after in + in_size; with at least 32 the bounds are checked
+// once per block of points rather than once per point.
+bool TripletDecode(const uint8_t* flags_in, const uint8_t* in, size_t in_size,
+    size_t in_slack, unsigned int n_points, Point* result,
+    size_t* in_bytes_consumed);
+
+// Stores the flags and coordinates of a simple glyph. dst points to the
+// beginning of the glyph, of which the caller has already written the header,
+// the n_contours end points and the instruction_length bytes of instructions;
+// the flags follow those, and nothing is written at or past dst_size. Only
+// writes *glyph_size, setting it to the total length of the glyph.
+bool StorePoints(unsigned int n_points, const Point* points,
+                 unsigned int n_contours, unsigned int instruction_length,
+                 bool has_overlap_bit, uint8_t* dst, size_t dst_size,
+                 size_t* glyph_size);
+
+// Stores the bounding box of points at offset 2 of dst.
+void ComputeBbox(unsigned int n_points, const Point* points, uint8_t* dst);
+
+// Writes the loca table for the given glyph offsets to out at dst_offset.
+bool StoreLoca(const std::vector<uint32_t>& loca_values, int index_format,
+               uint32_t* checksum, size_t dst_offset, WOFF2Out* out);
+
+} // namespace woff2
+
+#endif  // WOFF2_WOFF2_DEC_KERNELS_H_
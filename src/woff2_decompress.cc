@@ -14,12 +14,27 @@
 
 
 int main(int argc, char **argv) {
-  if (argc != 2) {
-    fprintf(stderr, "One argument, the input filename, must be provided.\n");
+  woff2::WOFF2DecodeParams params;
+  int arg = 1;
+  for (; arg < argc - 1; ++arg) {
+    if (std::string(argv[arg]) == "-l") {
+      // Lay the tables out in the order they're read on load.
+      params.table_order = woff2::LoadOrderTableTags();
+    } else if (std::string(argv[arg]) == "-x") {
+      // Accept our private, non-standard extensions.
+      params.allow_gvar_transform = true;
+      params.allow_multi_stream = true;
+    } else {
+      break;
+    }
+  }
+  if (arg != argc - 1) {
+    fprintf(stderr, "One argument, the input filename, must be provided, "
+            "optionally after -l and -x.\n");
     return 1;
   }
 
-  std::string filename(argv[1]);
+  std::string filename(argv[arg]);
   std::string outfilename = filename.substr(0, filename.find_last_of(".")) + ".ttf";
 
   // Note: update woff2_dec_fuzzer_new_entry.cc if this pattern changes.
@@ -31,11 +46,22 @@ int main(int argc, char **argv) {
       0);
   woff2::WOFF2StringOut out(&output);
 
-  const bool ok = woff2::ConvertWOFF2ToTTF(raw_input, input.size(), &out);
+  woff2::WOFF2Error error;
+  params.error = &error;
+  const bool ok = woff2::ConvertWOFF2ToTTF(raw_input, input.size(), &out,
+                                           params);
 
   if (ok) {
     woff2::SetFileContents(outfilename, output.begin(),
         output.begin() + out.Size());
+  } else if (error.table_tag != 0) {
+    fprintf(stderr, "Decompression failed: %s in table '%c%c%c%c' at %zu.\n",
+            woff2::WOFF2ErrorString(error.code), error.table_tag >> 24,
+            (error.table_tag >> 16) & 0xff, (error.table_tag >> 8) & 0xff,
+            error.table_tag & 0xff, error.offset);
+  } else {
+    fprintf(stderr, "Decompression failed: %s at offset %zu.\n",
+            woff2::WOFF2ErrorString(error.code), error.offset);
   }
   return ok ? 0 : 1;
 }
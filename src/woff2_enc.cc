@@ -9,16 +9,23 @@
 #include <woff2/encode.h>
 
 #include <stdlib.h>
+#include <algorithm>
+#include <cmath>
 #include <complex>
 #include <cstring>
 #include <limits>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <brotli/encode.h>
+#include <woff2/decode.h>
+#include <woff2/output.h>
 #include "./buffer.h"
+#include "./cff.h"
 #include "./font.h"
 #include "./normalize.h"
+#include "./parallel.h"
 #include "./round.h"
 #include "./store_bytes.h"
 #include "./table_tags.h"
@@ -34,10 +41,30 @@ namespace {
 const size_t kWoff2HeaderSize = 48;
 const size_t kWoff2EntrySize = 20;
 
+// Smallest window the memory limit is allowed to push the compressor down to.
+const int kMinBoundedWindow = 16;
+
+// Content policy: tables are sampled in blocks of kEntropySampleSize bytes,
+// at most kMaxEntropySamples per table. A block whose order-0 entropy is above
+// kIncompressibleEntropy bits per byte is taken to be already compressed.
+const size_t kEntropySampleSize = 4096;
+const size_t kMaxEntropySamples = 32;
+const double kIncompressibleEntropy = 7.5;
+// If less than this fraction of the data looks compressible, the quality is
+// capped at kIncompressibleQuality.
+const double kNegligibleCompressibleFraction = 0.1;
+const int kIncompressibleQuality = 5;
+const int kMinContentWindow = 18;
+
+// Streams of a multi-stream file are no shorter than this, give or take the
+// move to a table boundary, so that each is worth a thread.
+const size_t kMinStreamLength = 64 << 10;
+
 bool Compress(const uint8_t* data, const size_t len, uint8_t* result,
-              uint32_t* result_len, BrotliEncoderMode mode, int quality) {
+              uint32_t* result_len, BrotliEncoderMode mode, int quality,
+              int lgwin) {
   size_t compressed_len = *result_len;
-  if (BrotliEncoderCompress(quality, BROTLI_DEFAULT_WINDOW, mode, len, data,
+  if (BrotliEncoderCompress(quality, lgwin, mode, len, data,
                             &compressed_len, result) == 0) {
     return false;
   }
@@ -47,16 +74,129 @@ bool Compress(const uint8_t* data, const size_t len, uint8_t* result,
 
 bool Woff2Compress(const uint8_t* data, const size_t len,
                    uint8_t* result, uint32_t* result_len,
-                   int quality) {
+                   int quality, int lgwin) {
   return Compress(data, len, result, result_len,
-                  BROTLI_MODE_FONT, quality);
+                  BROTLI_MODE_FONT, quality, lgwin);
 }
 
 bool TextCompress(const uint8_t* data, const size_t len,
                   uint8_t* result, uint32_t* result_len,
                   int quality) {
   return Compress(data, len, result, result_len,
-                  BROTLI_MODE_TEXT, quality);
+                  BROTLI_MODE_TEXT, quality, BROTLI_DEFAULT_WINDOW);
+}
+
+// Rough upper bound on the memory a Brotli encoder allocates for the given
+// quality and window, fitted to measurements of libbrotlienc 1.0.
+size_t EstimateBrotliMemory(int quality, int lgwin) {
+  const size_t kMegabyte = 1 << 20;
+  size_t window = static_cast<size_t>(1) << lgwin;
+  size_t block = static_cast<size_t>(1) << std::min(lgwin, 18);
+  if (quality >= 10) {
+    // Zopfli state plus a binary tree hasher over the whole window.
+    return 8 * kMegabyte + 14 * window + 64 * block;
+  }
+  if (quality >= 5) {
+    if (lgwin <= 16) {
+      return 4 * kMegabyte;
+    }
+    int bucket_bits = quality < 7 ? 14 : 15;
+    size_t hasher = static_cast<size_t>(4) << (bucket_bits + quality - 1);
+    return hasher + 6 * window + 4 * kMegabyte;
+  }
+  if (quality >= 2) {
+    return 14 * kMegabyte + 2 * window;
+  }
+  return 2 * kMegabyte;
+}
+
+// Picks the highest quality, and for it the largest window, whose estimated
+// footprint fits in budget. Never goes above the requested settings. Returns
+// false if not even quality 1 with the smallest window allowed fits.
+bool ChooseBoundedBrotliParams(size_t budget, int* quality, int* lgwin) {
+  for (int q = *quality; q >= 1; --q) {
+    for (int w = *lgwin; w >= kMinBoundedWindow; --w) {
+      if (EstimateBrotliMemory(q, w) <= budget) {
+        *quality = q;
+        *lgwin = w;
+        return true;
+      }
+    }
+  }
+  return FONT_COMPRESSION_FAILURE();
+}
+
+// Allocator handed to Brotli in bounded mode so we can report what it used.
+struct BrotliMemoryTracker {
+  size_t current;
+  size_t peak;
+};
+
+void* TrackedAlloc(void* opaque, size_t size) {
+  BrotliMemoryTracker* tracker = static_cast<BrotliMemoryTracker*>(opaque);
+  size_t* block = static_cast<size_t*>(malloc(size + sizeof(size_t)));
+  if (block == NULL) {
+    return NULL;
+  }
+  *block = size;
+  tracker->current += size;
+  tracker->peak = std::max(tracker->peak, tracker->current);
+  return block + 1;
+}
+
+void TrackedFree(void* opaque, void* address) {
+  if (address == NULL) {
+    return;
+  }
+  BrotliMemoryTracker* tracker = static_cast<BrotliMemoryTracker*>(opaque);
+  size_t* block = static_cast<size_t*>(address) - 1;
+  tracker->current -= *block;
+  free(block);
+}
+
+// Compresses the concatenation of chunks as one Brotli stream, writing the
+// output directly to result without buffering the input.
+bool StreamCompress(
+    const std::vector<std::pair<const uint8_t*, size_t> >& chunks,
+    size_t total_length, uint8_t* result, uint32_t* result_len,
+    int quality, int lgwin, BrotliMemoryTracker* tracker) {
+  BrotliEncoderState* enc =
+      BrotliEncoderCreateInstance(TrackedAlloc, TrackedFree, tracker);
+  if (enc == NULL) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  BrotliEncoderSetParameter(enc, BROTLI_PARAM_MODE, BROTLI_MODE_FONT);
+  BrotliEncoderSetParameter(enc, BROTLI_PARAM_QUALITY, quality);
+  BrotliEncoderSetParameter(enc, BROTLI_PARAM_LGWIN, lgwin);
+  BrotliEncoderSetParameter(enc, BROTLI_PARAM_SIZE_HINT,
+      std::min<size_t>(total_length, std::numeric_limits<uint32_t>::max()));
+
+  size_t available_out = *result_len;
+  uint8_t* next_out = result;
+  bool ok = true;
+  for (size_t i = 0; ok && i <= chunks.size(); ++i) {
+    const bool finish = i == chunks.size();
+    size_t available_in = finish ? 0 : chunks[i].second;
+    const uint8_t* next_in = finish ? NULL : chunks[i].first;
+    while (ok) {
+      if (!BrotliEncoderCompressStream(enc,
+              finish ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_PROCESS,
+              &available_in, &next_in, &available_out, &next_out, NULL)) {
+        ok = false;
+      } else if (finish ? BrotliEncoderIsFinished(enc)
+                        : available_in == 0 && !BrotliEncoderHasMoreOutput(enc)) {
+        break;
+      } else if (available_out == 0) {
+        ok = false;  // result is full
+      }
+    }
+  }
+  BrotliEncoderDestroyInstance(enc);
+  if (!ok) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  *result_len = *result_len - available_out;
+  return true;
 }
 
 int KnownTableIndex(uint32_t tag) {
@@ -91,12 +231,42 @@ size_t TableEntrySize(const Table& table) {
   return size;
 }
 
-size_t ComputeWoff2Length(const FontCollection& font_collection,
-                          const std::vector<Table>& tables,
-                          std::map<std::pair<uint32_t, uint32_t>, uint16_t>
-                            index_by_tag_offset,
-                          size_t compressed_data_length,
-                          size_t extended_metadata_length) {
+// For each font of a collection, looks up the table directory index of each
+// of its tables, in tag order, as the collection directory lists them.
+bool CollectionTableIndices(
+    const FontCollection& font_collection,
+    const std::map<std::pair<uint32_t, uint32_t>, uint16_t>&
+        index_by_tag_offset,
+    std::vector<std::vector<uint16_t> >* indices) {
+  indices->resize(font_collection.fonts.size());
+  for (size_t i = 0; i < font_collection.fonts.size(); ++i) {
+    for (const auto& entry : font_collection.fonts[i].tables) {
+      const Font::Table& table = entry.second;
+      if (table.tag & 0x80808080) continue;  // don't write xform tables
+
+      // for reused tables, only the original has an updated offset
+      uint32_t table_offset =
+        table.IsReused() ? table.reuse_of->offset : table.offset;
+      auto it = index_by_tag_offset.find(std::make_pair(table.tag,
+                                                        table_offset));
+      if (it == index_by_tag_offset.end()) {
+#ifdef FONT_COMPRESSION_BIN
+        fprintf(stderr, "Missing table index for offset 0x%08x\n",
+                table_offset);
+#endif
+        return FONT_COMPRESSION_FAILURE();
+      }
+      (*indices)[i].push_back(it->second);
+    }
+  }
+  return true;
+}
+
+// Size of everything that precedes the compressed data: header, table
+// directory and, for collections, the collection directory.
+size_t ComputeDirectoryLength(
+    const FontCollection& font_collection, const std::vector<Table>& tables,
+    const std::vector<std::vector<uint16_t> >& collection_indices) {
   size_t size = kWoff2HeaderSize;
 
   for (const auto& table : tables) {
@@ -110,19 +280,22 @@ size_t ComputeWoff2Length(const FontCollection& font_collection,
 
     size += 4 * font_collection.fonts.size();  // UInt32 flavor for each
 
-    for (const auto& font : font_collection.fonts) {
-      size += Size255UShort(font.tables.size());  // 255UInt16 numTables
-      for (const auto& entry : font.tables) {
-        const Font::Table& table = entry.second;
-        // no collection entry for xform table
-        if (table.tag & 0x80808080) continue;
-
-        std::pair<uint32_t, uint32_t> tag_offset(table.tag, table.offset);
-        uint16_t table_index = index_by_tag_offset[tag_offset];
+    for (const auto& font_indices : collection_indices) {
+      size += Size255UShort(font_indices.size());  // 255UInt16 numTables
+      for (uint16_t table_index : font_indices) {
         size += Size255UShort(table_index);  // 255UInt16 index entry
       }
     }
   }
+  return size;
+}
+
+size_t ComputeWoff2Length(
+    const FontCollection& font_collection, const std::vector<Table>& tables,
+    const std::vector<std::vector<uint16_t> >& collection_indices,
+    size_t compressed_data_length, size_t extended_metadata_length) {
+  size_t size = ComputeDirectoryLength(font_collection, tables,
+                                       collection_indices);
 
   // compressed data
   size += compressed_data_length;
@@ -172,147 +345,630 @@ size_t ComputeTotalTransformLength(const Font& font) {
   return total;
 }
 
-}  // namespace
-
-size_t MaxWOFF2CompressedSize(const uint8_t* data, size_t length) {
-  return MaxWOFF2CompressedSize(data, length, "");
+// Returns the table data that goes into the compressed stream, in order.
+std::vector<std::pair<const uint8_t*, size_t> > StoredTableData(
+    const FontCollection& font_collection) {
+  std::vector<std::pair<const uint8_t*, size_t> > stored;
+  for (const auto& font : font_collection.fonts) {
+    for (const auto tag : font.OutputOrderedTags()) {
+      const Font::Table& original = font.tables.at(tag);
+      if (original.IsReused()) continue;
+      if (tag & 0x80808080) continue;
+      const Font::Table* table_to_store = font.FindTable(tag ^ 0x80808080);
+      if (table_to_store == NULL) table_to_store = &original;
+      stored.push_back(std::make_pair(table_to_store->data,
+                                      table_to_store->length));
+    }
+  }
+  return stored;
 }
 
-size_t MaxWOFF2CompressedSize(const uint8_t* data, size_t length,
-                              const std::string& extended_metadata) {
-  // Except for the header size, which is 32 bytes larger in woff2 format,
-  // all other parts should be smaller (table header in short format,
-  // transformations and compression). Just to be sure, we will give some
-  // headroom anyway.
-  return length + 1024 + extended_metadata.length();
+// Offsets in the stored table data where a stream of a multi-stream file can
+// start without splitting data that compresses well together: the ends of the
+// tables and, in transformed glyf tables, the starts of the substreams.
+std::vector<size_t> StreamBoundaries(const FontCollection& font_collection) {
+  std::vector<size_t> boundaries;
+  size_t offset = 0;
+  for (const auto& font : font_collection.fonts) {
+    for (const auto tag : font.OutputOrderedTags()) {
+      const Font::Table& original = font.tables.at(tag);
+      if (original.IsReused()) continue;
+      if (tag & 0x80808080) continue;
+      const Font::Table* table_to_store = font.FindTable(tag ^ 0x80808080);
+      if (table_to_store == NULL) {
+        table_to_store = &original;
+      } else if (tag == kGlyfTableTag) {
+        // The 36 byte header ends with the lengths of seven substreams.
+        Buffer header(table_to_store->data, table_to_store->length);
+        size_t substream_start = offset + 36;
+        uint32_t substream_length;
+        if (header.Skip(8)) {
+          for (int i = 0; i < 7 && header.ReadU32(&substream_length); ++i) {
+            boundaries.push_back(substream_start);
+            substream_start += substream_length;
+          }
+        }
+      }
+      offset += table_to_store->length;
+      boundaries.push_back(offset);
+    }
+  }
+  return boundaries;
 }
 
-uint32_t CompressedBufferSize(uint32_t original_size) {
-  return 1.2 * original_size + 10240;
+// Splits total_length bytes of table data into ranges of about equal length,
+// at most num_streams of them and few enough that each has kMinStreamLength
+// bytes, and returns where each range ends. A cut moves to the nearest of the
+// sorted boundaries if one is within a quarter of a range.
+std::vector<size_t> ChooseStreamEnds(const std::vector<size_t>& boundaries,
+                                     size_t total_length, int num_streams) {
+  size_t count = std::min<size_t>(std::max(num_streams, 1), kMaxWoff2Streams);
+  count = std::max<size_t>(1, std::min(count,
+                                       total_length / kMinStreamLength));
+  const size_t reach = total_length / count / 4;
+  std::vector<size_t> ends;
+  for (size_t i = 1; i < count; ++i) {
+    const size_t target = total_length / count * i;
+    size_t cut = target;
+    size_t distance = reach + 1;
+    auto next = std::lower_bound(boundaries.begin(), boundaries.end(), target);
+    if (next != boundaries.end() && *next - target < distance) {
+      cut = *next;
+      distance = *next - target;
+    }
+    if (next != boundaries.begin() && target - next[-1] < distance) {
+      cut = next[-1];
+    }
+    if (cut > (ends.empty() ? 0 : ends.back()) && cut < total_length) {
+      ends.push_back(cut);
+    }
+  }
+  ends.push_back(total_length);
+  return ends;
 }
 
-bool TransformFontCollection(FontCollection* font_collection) {
-  for (auto& font : font_collection->fonts) {
-    if (!TransformGlyfAndLocaTables(&font)) {
-#ifdef FONT_COMPRESSION_BIN
-      fprintf(stderr, "glyf/loca transformation failed.\n");
-#endif
-      return FONT_COMPRESSION_FAILURE();
+// Estimate, from the input table sizes alone, of the table memory that
+// normalizing and transforming the collection holds at once: the normalized
+// glyf buffer NormalizeGlyphs() sizes, the GlyfEncoder streams and the
+// transformed glyf, taken to be as large, loca, and the transformed hmtx and
+// gvar. Lets memory_limit fail a conversion before any of it is allocated.
+size_t EstimateTransformMemory(const FontCollection& font_collection,
+                               const WOFF2Params& params) {
+  size_t estimate = 0;
+  for (const auto& font : font_collection.fonts) {
+    const size_t num_glyphs = NumGlyphs(font);
+    for (const auto& entry : font.tables) {
+      const Font::Table& table = entry.second;
+      if (table.IsReused()) {
+        continue;
+      }
+      if (table.tag == kGlyfTableTag) {
+        const size_t normalized = 1.1 * table.length + 2 * num_glyphs;
+        estimate += params.allow_transforms ? 3 * normalized : normalized;
+      } else if (table.tag == kLocaTableTag) {
+        estimate += 4 * Round4(num_glyphs + 1);
+      } else if (table.tag == kHeadTableTag) {
+        estimate += Round4(table.length);
+      } else if (table.tag == kHmtxTableTag && params.allow_transforms) {
+        estimate += table.length;
+      } else if (table.tag == kGvarTableTag && params.allow_transforms &&
+                 params.transform_gvar) {
+        estimate += 2 * table.length;
+      }
     }
   }
+  return estimate;
+}
 
-  return true;
+// Estimated peak of the table memory held while the tables were transformed:
+// everything held now, plus the GlyfEncoder streams each transformed glyf
+// table was copied from.
+size_t TransformPeakMemory(const FontCollection& font_collection) {
+  size_t peak = 0;
+  for (const auto& font : font_collection.fonts) {
+    for (const auto& entry : font.tables) {
+      const Font::Table& table = entry.second;
+      peak += table.buffer.capacity();
+      if (table.tag == (kGlyfTableTag ^ 0x80808080)) {
+        peak += table.length;
+      }
+    }
+  }
+  return peak;
 }
 
-bool ConvertTTFToWOFF2(const uint8_t *data, size_t length,
-                       uint8_t *result, size_t *result_length) {
-  WOFF2Params params;
-  return ConvertTTFToWOFF2(data, length, result, result_length,
-                           params);
+// Frees the normalized data of tables that have a transformed version; only
+// the transformed data is stored. Returns the table memory still held.
+size_t ReleaseTransformedSources(FontCollection* font_collection) {
+  size_t held = 0;
+  for (auto& font : font_collection->fonts) {
+    for (auto& entry : font.tables) {
+      Font::Table& table = entry.second;
+      if (!(table.tag & 0x80808080) && !table.IsReused() &&
+          font.FindTable(table.tag ^ 0x80808080) != NULL) {
+        std::vector<uint8_t>().swap(table.buffer);
+        table.data = NULL;
+      }
+      held += table.buffer.capacity();
+    }
+  }
+  return held;
 }
 
-bool ConvertTTFToWOFF2(const uint8_t *data, size_t length,
-                       uint8_t *result, size_t *result_length,
-                       const WOFF2Params& params) {
-  FontCollection font_collection;
-  if (!ReadFontCollection(data, length, &font_collection)) {
-#ifdef FONT_COMPRESSION_BIN
-    fprintf(stderr, "Parsing of the input font failed.\n");
-#endif
-    return FONT_COMPRESSION_FAILURE();
+// Returns the length of the PNG stream at data + offset, or 0 if there isn't
+// a complete one. The chunks walked are marked in *visited, and a walk that
+// reaches a marked chunk gives up: an earlier walk either failed from there
+// or ended past the current offset. That keeps scanning a table linear.
+size_t PngLength(const uint8_t* data, size_t length, size_t offset,
+                 std::vector<bool>* visited) {
+  static const uint8_t kPngSignature[8] = {
+    0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'
+  };
+  if (length - offset < sizeof(kPngSignature) ||
+      memcmp(data + offset, kPngSignature, sizeof(kPngSignature)) != 0) {
+    return 0;
   }
+  Buffer buffer(data, length);
+  buffer.Skip(offset + sizeof(kPngSignature));
+  uint32_t chunk_length, chunk_type;
+  do {
+    if (buffer.offset() < length) {
+      if ((*visited)[buffer.offset()]) {
+        return 0;
+      }
+      (*visited)[buffer.offset()] = true;
+    }
+    if (!buffer.ReadU32(&chunk_length) || !buffer.ReadU32(&chunk_type) ||
+        !buffer.Skip(static_cast<size_t>(chunk_length) + 4)) {  // + crc
+      return 0;
+    }
+  } while (chunk_type != 0x49454e44);  // IEND
+  return buffer.offset() - offset;
+}
 
-  if (!NormalizeFontCollection(&font_collection)) {
-    return FONT_COMPRESSION_FAILURE();
+// Bytes of table taken up by embedded PNG images; these are found by
+// signature, which covers both CBDT and sbix.
+size_t EmbeddedPngBytes(const uint8_t* data, size_t length) {
+  std::vector<bool> visited(length);
+  size_t total = 0;
+  size_t offset = 0;
+  while (offset < length) {
+    const uint8_t* next = static_cast<const uint8_t*>(
+        memchr(data + offset, 0x89, length - offset));
+    if (next == NULL) {
+      break;
+    }
+    offset = next - data;
+    size_t png_length = PngLength(data, length, offset, &visited);
+    if (png_length > 0) {
+      total += png_length;
+      offset += png_length;
+    } else {
+      ++offset;
+    }
   }
+  return total;
+}
 
-  if (params.allow_transforms && !TransformFontCollection(&font_collection)) {
-    return FONT_COMPRESSION_FAILURE();
-  } else {
-    // glyf/loca use 11 to flag "not transformed"
-    for (auto& font : font_collection.fonts) {
-      Font::Table* glyf_table = font.FindTable(kGlyfTableTag);
-      Font::Table* loca_table = font.FindTable(kLocaTableTag);
-      if (glyf_table) {
-        glyf_table->flag_byte |= 0xc0;
-      }
-      if (loca_table) {
-        loca_table->flag_byte |= 0xc0;
-      }
+// Bytes of an SVG table taken up by gzip compressed documents. Records may
+// share a document, which counts once.
+size_t EmbeddedGzipSvgBytes(const uint8_t* data, size_t length) {
+  Buffer table(data, length);
+  uint16_t version, num_entries;
+  uint32_t document_list_offset;
+  if (!table.ReadU16(&version) || !table.ReadU32(&document_list_offset) ||
+      document_list_offset >= length) {
+    return 0;
+  }
+  Buffer list(data + document_list_offset, length - document_list_offset);
+  if (!list.ReadU16(&num_entries)) {
+    return 0;
+  }
+  std::vector<std::pair<size_t, size_t> > documents;
+  for (uint16_t i = 0; i < num_entries; ++i) {
+    uint32_t document_offset, document_length;
+    if (!list.Skip(4) ||  // startGlyphID, endGlyphID
+        !list.ReadU32(&document_offset) || !list.ReadU32(&document_length)) {
+      break;
+    }
+    size_t start = document_list_offset + static_cast<size_t>(document_offset);
+    if (document_length < 3 || start > length ||
+        length - start < document_length) {
+      continue;
+    }
+    if (data[start] == 0x1f && data[start + 1] == 0x8b &&
+        data[start + 2] == 0x08) {
+      documents.push_back(std::make_pair(start, document_length));
     }
   }
+  std::sort(documents.begin(), documents.end());
+  size_t total = 0;
+  for (size_t i = 0; i < documents.size(); ++i) {
+    if (i == 0 || documents[i].first != documents[i - 1].first) {
+      total += documents[i].second;
+    }
+  }
+  return std::min(total, length);
+}
 
-  // Although the compressed size of each table in the final woff2 file won't
-  // be larger than its transform_length, we have to allocate a large enough
-  // buffer for the compressor, since the compressor can potentially increase
-  // the size. If the compressor overflows this, it should return false and
-  // then this function will also return false.
+// Order-0 entropy of data in bits per byte.
+double ByteEntropy(const uint8_t* data, size_t length) {
+  size_t histogram[256] = {0};
+  for (size_t i = 0; i < length; ++i) {
+    ++histogram[data[i]];
+  }
+  double entropy = 0;
+  for (size_t count : histogram) {
+    if (count > 0) {
+      double p = static_cast<double>(count) / length;
+      entropy -= p * std::log2(p);
+    }
+  }
+  return entropy;
+}
 
-  size_t total_transform_length = 0;
-  for (const auto& font : font_collection.fonts) {
-    total_transform_length += ComputeTotalTransformLength(font);
+// Estimates the bytes of data that won't compress from the entropy of evenly
+// spaced samples.
+size_t SampledIncompressibleBytes(const uint8_t* data, size_t length) {
+  if (length < kEntropySampleSize) {
+    return 0;  // too short to tell, assume it compresses
   }
-  size_t compression_buffer_size = CompressedBufferSize(total_transform_length);
-  std::vector<uint8_t> compression_buf(compression_buffer_size);
-  uint32_t total_compressed_length = compression_buffer_size;
+  size_t num_samples = std::min(kMaxEntropySamples,
+                                length / kEntropySampleSize);
+  size_t stride = length / num_samples;
+  size_t incompressible_samples = 0;
+  for (size_t i = 0; i < num_samples; ++i) {
+    if (ByteEntropy(data + i * stride, kEntropySampleSize) >
+        kIncompressibleEntropy) {
+      ++incompressible_samples;
+    }
+  }
+  return length / num_samples * incompressible_samples;
+}
 
-  // Collect all transformed data into one place in output order.
-  std::vector<uint8_t> transform_buf(total_transform_length);
-  size_t transform_offset = 0;
+// Estimates how much of the data to be stored can still be compressed and,
+// if that is a negligible part of it, lowers quality and window since the
+// slow settings gain next to nothing on PNG or gzip payloads. Records the
+// estimate and the decision in info.
+void ChooseContentBrotliParams(const FontCollection& font_collection,
+                               int* quality, int* lgwin,
+                               WOFF2EncodeInfo* info) {
+  size_t total = 0;
+  size_t compressible = 0;
+  size_t largest_compressible = 0;
   for (const auto& font : font_collection.fonts) {
     for (const auto tag : font.OutputOrderedTags()) {
       const Font::Table& original = font.tables.at(tag);
       if (original.IsReused()) continue;
       if (tag & 0x80808080) continue;
-      const Font::Table* table_to_store = font.FindTable(tag ^ 0x80808080);
-      if (table_to_store == NULL) table_to_store = &original;
+      const Font::Table* table = font.FindTable(tag ^ 0x80808080);
+      if (table == NULL) table = &original;
+
+      size_t embedded = 0;
+      if (tag == kCbdtTableTag || tag == kSbixTableTag) {
+        embedded = EmbeddedPngBytes(table->data, table->length);
+      } else if (tag == kSvgTableTag) {
+        embedded = EmbeddedGzipSvgBytes(table->data, table->length);
+      }
+      size_t incompressible = std::min<size_t>(table->length,
+          std::max(embedded,
+                   SampledIncompressibleBytes(table->data, table->length)));
+      size_t table_compressible = table->length - incompressible;
+      total += table->length;
+      compressible += table_compressible;
+      largest_compressible = std::max(largest_compressible,
+                                      table_compressible);
+    }
+  }
+
+  info->content_total_bytes = total;
+  info->content_compressible_bytes = compressible;
+  info->content_lowered = false;
+  if (total == 0 ||
+      compressible >= total * kNegligibleCompressibleFraction) {
+    return;
+  }
+  info->content_lowered = true;
+
+  *quality = std::min(*quality, kIncompressibleQuality);
+  // Matches that are left are mostly within a compressible table or an
+  // image, a window spanning the largest table finds nearly all of them.
+  int window = kMinContentWindow;
+  while (window < *lgwin &&
+         (static_cast<size_t>(1) << window) - 16 < largest_compressible) {
+    ++window;
+  }
+  *lgwin = std::min(*lgwin, window);
+}
+
+// Discards the decoded font except for the headers and table directories,
+// which the decoder writes all at once before any table and then patches.
+// Having nothing else to hold, it takes fonts of any size.
+class DirectorySink : public WOFF2Out {
+ public:
+  DirectorySink() : size_(0) {}
 
-      StoreBytes(table_to_store->data, table_to_store->length,
-                 &transform_offset, &transform_buf[0]);
+  bool Write(const void *buf, size_t n) override {
+    return Write(buf, size_, n);
+  }
+
+  bool Write(const void *buf, size_t offset, size_t n) override {
+    if (n > std::numeric_limits<size_t>::max() - offset) {
+      return false;
+    }
+    if (size_ == 0) {
+      headers_.assign(static_cast<const uint8_t*>(buf),
+                      static_cast<const uint8_t*>(buf) + n);
+    } else if (offset < headers_.size()) {
+      const size_t kept = std::min(n, headers_.size() - offset);
+      std::memcpy(&headers_[offset], buf, kept);
     }
+    size_ = std::max(size_, offset + n);
+    return true;
   }
 
-  // Compress all transformed data in one stream.
-  if (!Woff2Compress(transform_buf.data(), total_transform_length,
-                     &compression_buf[0],
-                     &total_compressed_length,
-                     params.brotli_quality)) {
+  size_t Size() override { return size_; }
+
+  const std::vector<uint8_t>& headers() const { return headers_; }
+
+ private:
+  std::vector<uint8_t> headers_;
+  size_t size_;
+};
+
+// Decodes the woff2 file without keeping the tables and checks that the
+// table directory the decoder builds, with the checksums it computed, agrees
+// with the lengths and checksums of the normalized font collection. Checksums
+// of glyf and loca are compared only if glyf_checksums is set.
+bool VerifyWoff2(const FontCollection& font_collection,
+                 const uint8_t* woff2, size_t woff2_length,
+                 bool glyf_checksums) {
+  DirectorySink sink;
+  WOFF2DecodeParams params;
+  params.allow_gvar_transform = true;
+  params.allow_multi_stream = true;
+  if (!ConvertWOFF2ToTTF(woff2, woff2_length, &sink, params)) {
 #ifdef FONT_COMPRESSION_BIN
-    fprintf(stderr, "Compression of combined table failed.\n");
+    fprintf(stderr, "Verification: the result doesn't decode.\n");
 #endif
     return FONT_COMPRESSION_FAILURE();
   }
 
+  const std::vector<uint8_t>& headers = sink.headers();
+  Buffer file(headers.data(), headers.size());
+  std::vector<uint32_t> font_offsets(1, 0);
+  if (font_collection.flavor == kTtcFontFlavor) {
+    uint32_t num_fonts;
+    if (!file.Skip(8) || !file.ReadU32(&num_fonts) ||
+        num_fonts != font_collection.fonts.size()) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    font_offsets.resize(num_fonts);
+    for (uint32_t& font_offset : font_offsets) {
+      if (!file.ReadU32(&font_offset)) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+    }
+  }
+
+  for (size_t i = 0; i < font_offsets.size(); ++i) {
+    const Font& font = font_collection.fonts[i];
+    Buffer directory(headers.data(), headers.size());
+    uint16_t num_tables;
+    if (!directory.Skip(font_offsets[i] + 4) ||
+        !directory.ReadU16(&num_tables) || num_tables != font.num_tables ||
+        !directory.Skip(6)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    for (uint16_t j = 0; j < num_tables; ++j) {
+      uint32_t tag, checksum, offset, length;
+      if (!directory.ReadU32(&tag) || !directory.ReadU32(&checksum) ||
+          !directory.ReadU32(&offset) || !directory.ReadU32(&length)) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      const Font::Table* table = font.FindTable(tag);
+      if (table == NULL || (tag & 0x80808080)) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      if (table->IsReused()) {
+        table = table->reuse_of;
+      }
+      const bool check_checksum = glyf_checksums ||
+          (tag != kGlyfTableTag && tag != kLocaTableTag);
+      if (length != table->length ||
+          (check_checksum && checksum != table->checksum)) {
 #ifdef FONT_COMPRESSION_BIN
-  fprintf(stderr, "Compressed %zu to %u.\n", total_transform_length,
-          total_compressed_length);
+        fprintf(stderr, "Verification: table %c%c%c%c decodes to %u bytes "
+                "with checksum 0x%08x, expected %u bytes with checksum "
+                "0x%08x.\n", tag >> 24, (tag >> 16) & 0xff, (tag >> 8) & 0xff,
+                tag & 0xff, length, checksum, table->length, table->checksum);
 #endif
+        return FONT_COMPRESSION_FAILURE();
+      }
+    }
+  }
+  return true;
+}
 
-  // Compress the extended metadata
-  // TODO(user): how does this apply to collections
-  uint32_t compressed_metadata_buf_length =
-    CompressedBufferSize(params.extended_metadata.length());
-  std::vector<uint8_t> compressed_metadata_buf(compressed_metadata_buf_length);
+}  // namespace
 
-  if (params.extended_metadata.length() > 0) {
-    if (!TextCompress((const uint8_t*)params.extended_metadata.data(),
-                      params.extended_metadata.length(),
-                      compressed_metadata_buf.data(),
-                      &compressed_metadata_buf_length,
-                      params.brotli_quality)) {
+size_t MaxWOFF2CompressedSize(const uint8_t* data, size_t length) {
+  return MaxWOFF2CompressedSize(data, length, "");
+}
+
+size_t MaxWOFF2CompressedSize(const uint8_t* data, size_t length,
+                              const std::string& extended_metadata) {
+  // Except for the header size, which is 32 bytes larger in woff2 format,
+  // all other parts should be smaller (table header in short format,
+  // transformations and compression). Just to be sure, we will give some
+  // headroom anyway.
+  return length + 1024 + extended_metadata.length();
+}
+
+uint32_t CompressedBufferSize(uint32_t original_size) {
+  return 1.2 * original_size + 10240;
+}
+
+// Compresses each range of data, as ChooseStreamEnds() returned them, as a
+// Brotli stream of its own on up to num_threads threads, and sets result to
+// the compressed data of a multi-stream file: the stream index, then the
+// streams.
+bool CompressStreams(const std::vector<uint8_t>& data,
+                     const std::vector<size_t>& ends, int quality, int lgwin,
+                     int num_threads, std::vector<uint8_t>* result) {
+  std::vector<std::vector<uint8_t> > streams(ends.size());
+  std::vector<char> compressed(ends.size(), 0);
+  RunParallel(ends.size(), std::max(num_threads, 0), [&](size_t i) {
+    const size_t start = i == 0 ? 0 : ends[i - 1];
+    std::vector<uint8_t>& stream = streams[i];
+    stream.resize(CompressedBufferSize(ends[i] - start));
+    uint32_t stream_length = stream.size();
+    compressed[i] = Woff2Compress(data.data() + start, ends[i] - start,
+                                  &stream[0], &stream_length, quality, lgwin);
+    stream.resize(stream_length);
+  });
+
+  size_t length = Size255UShort(ends.size());
+  for (size_t i = 0; i < ends.size(); ++i) {
+    if (!compressed[i]) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    length += Base128Size(ends[i] - (i == 0 ? 0 : ends[i - 1])) +
+        Base128Size(streams[i].size()) + streams[i].size();
+  }
+  if (length > std::numeric_limits<uint32_t>::max()) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  result->resize(length);
+  size_t offset = 0;
+  Store255UShort(ends.size(), &offset, result->data());
+  for (size_t i = 0; i < ends.size(); ++i) {
+    StoreBase128(ends[i] - (i == 0 ? 0 : ends[i - 1]), &offset,
+                 result->data());
+    StoreBase128(streams[i].size(), &offset, result->data());
+  }
+  for (const auto& stream : streams) {
+    StoreBytes(stream.data(), stream.size(), &offset, result->data());
+  }
+  return true;
+}
+
+// Glyphs in the glyf tables of the collection, counting shared ones once.
+size_t CollectionGlyphCount(const FontCollection& font_collection) {
+  size_t count = 0;
+  for (const auto& font : font_collection.fonts) {
+    const Font::Table* glyf_table = font.FindTable(kGlyfTableTag);
+    if (glyf_table != NULL && !glyf_table->IsReused()) {
+      count += NumGlyphs(font);
+    }
+  }
+  return count;
+}
+
+bool TransformFontCollection(FontCollection* font_collection) {
+  for (auto& font : font_collection->fonts) {
+    if (!TransformGlyfAndLocaTables(&font)) {
 #ifdef FONT_COMPRESSION_BIN
-      fprintf(stderr, "Compression of extended metadata failed.\n");
+      fprintf(stderr, "glyf/loca transformation failed.\n");
 #endif
       return FONT_COMPRESSION_FAILURE();
     }
-  } else {
-    compressed_metadata_buf_length = 0;
+  }
+
+  return true;
+}
+
+// Desubroutinizes the CFF and CFF2 tables for which that makes the table on
+// its own compress to fewer bytes. Returns the length of the tables looked
+// at.
+size_t DesubroutinizeCffTables(FontCollection* font_collection, int quality) {
+  size_t cff_length = 0;
+  for (auto& font : font_collection->fonts) {
+    for (uint32_t tag : {kCffTableTag, kCff2TableTag}) {
+      Font::Table* table = font.FindTable(tag);
+      if (table == NULL || table->IsReused()) {
+        continue;
+      }
+      cff_length += table->length;
+      std::vector<uint8_t> desubroutinized;
+      if (!DesubroutinizeCff(table->data, table->length, &desubroutinized)) {
+        continue;
+      }
+      std::vector<uint8_t> compressed(BrotliEncoderMaxCompressedSize(
+          std::max<size_t>(table->length, desubroutinized.size())));
+      uint32_t original_size = compressed.size();
+      uint32_t desubroutinized_size = compressed.size();
+      if (!Woff2Compress(table->data, table->length, &compressed[0],
+                         &original_size, quality, BROTLI_DEFAULT_WINDOW) ||
+          !Woff2Compress(desubroutinized.data(), desubroutinized.size(),
+                         &compressed[0], &desubroutinized_size, quality,
+                         BROTLI_DEFAULT_WINDOW)) {
+        continue;
+      }
+#ifdef FONT_COMPRESSION_BIN
+      fprintf(stderr, "%c%c%c%c: %u bytes compressed, %u desubroutinized.\n",
+              tag >> 24, (tag >> 16) & 0xff, (tag >> 8) & 0xff, tag & 0xff,
+              original_size, desubroutinized_size);
+#endif
+      if (desubroutinized_size < original_size) {
+        table->buffer.swap(desubroutinized);
+        table->data = table->buffer.data();
+        table->length = table->buffer.size();
+      }
+    }
+  }
+  // Other fonts of a collection share the rewritten tables.
+  for (auto& font : font_collection->fonts) {
+    for (auto& entry : font.tables) {
+      Font::Table& table = entry.second;
+      if (table.IsReused()) {
+        table.data = table.reuse_of->data;
+        table.length = table.reuse_of->length;
+      }
+    }
+  }
+  return cff_length;
+}
+
+// Encodes the normalized font collection, whose glyf and loca tables have
+// been transformed or flagged as untransformed already.
+bool EncodeFontCollection(FontCollection* font_collection,
+                          uint8_t *result, size_t *result_length,
+                          const WOFF2Params& params) {
+  if (params.allow_transforms && params.transform_gvar) {
+    ScopedPhase phase(params.phase_observer, kWOFF2PhaseTransformGvar);
+    size_t gvar_length = 0;
+    for (auto& font : font_collection->fonts) {
+      const Font::Table* gvar_table = font.FindTable(kGvarTableTag);
+      if (gvar_table != NULL && !gvar_table->IsReused()) {
+        gvar_length += gvar_table->length;
+      }
+      if (!TransformGvarTable(&font)) {
+        return ReportError(params.error, kWOFF2ErrorInvalidInput,
+                           kGvarTableTag, 0);
+      }
+    }
+    phase.End(gvar_length);
+  }
+
+  const bool bounded = params.memory_limit > 0;
+  size_t held_table_memory = 0;
+  if (bounded) {
+    if (TransformPeakMemory(*font_collection) > params.memory_limit) {
+      return ReportError(params.error, kWOFF2ErrorLimitExceeded, 0, 0);
+    }
+    held_table_memory = ReleaseTransformedSources(font_collection);
+  }
+
+  size_t total_transform_length = 0;
+  for (const auto& font : font_collection->fonts) {
+    total_transform_length += ComputeTotalTransformLength(font);
   }
 
   std::vector<Table> tables;
   std::map<std::pair<uint32_t, uint32_t>, uint16_t> index_by_tag_offset;
 
-  for (const auto& font : font_collection.fonts) {
+  for (const auto& font : font_collection->fonts) {
 
     for (const auto tag : font.OutputOrderedTags()) {
       const Font::Table& src_table = font.tables.at(tag);
@@ -324,7 +980,8 @@ bool ConvertTTFToWOFF2(const uint8_t *data, size_t length,
       if (index_by_tag_offset.find(tag_offset) == index_by_tag_offset.end()) {
         index_by_tag_offset[tag_offset] = tables.size();
       } else {
-        return false;
+        return ReportError(params.error, kWOFF2ErrorInvalidInput,
+                           src_table.tag, 0);
       }
 
       Table table;
@@ -346,24 +1003,152 @@ bool ConvertTTFToWOFF2(const uint8_t *data, size_t length,
     }
   }
 
-  size_t woff2_length = ComputeWoff2Length(font_collection, tables,
-      index_by_tag_offset, total_compressed_length,
+  std::vector<std::vector<uint16_t> > collection_indices;
+  if (font_collection->flavor == kTtcFontFlavor &&
+      !CollectionTableIndices(*font_collection, index_by_tag_offset,
+                              &collection_indices)) {
+    return ReportError(params.error, kWOFF2ErrorInvalidInput, 0, 0);
+  }
+
+  const size_t directory_length = ComputeDirectoryLength(*font_collection,
+      tables, collection_indices);
+  if (directory_length > *result_length) {
+    return ReportError(params.error, kWOFF2ErrorOutputTooSmall, 0, 0);
+  }
+
+  int quality = params.brotli_quality;
+  int lgwin = BROTLI_DEFAULT_WINDOW;
+  WOFF2EncodeInfo info;
+  if (params.adapt_to_content) {
+    ChooseContentBrotliParams(*font_collection, &quality, &lgwin, &info);
+  }
+
+  std::vector<uint8_t> compression_buf;
+  uint32_t total_compressed_length = 0;
+  bool multi_stream = false;
+  size_t brotli_peak_memory = 0;
+  ScopedPhase compress_phase(params.phase_observer, kWOFF2PhaseCompress);
+  if (bounded) {
+    // Stream the tables straight into the result, right after the directory.
+    size_t budget = params.memory_limit > held_table_memory
+        ? params.memory_limit - held_table_memory : 0;
+    if (!ChooseBoundedBrotliParams(budget, &quality, &lgwin)) {
+      return ReportError(params.error, kWOFF2ErrorLimitExceeded, 0, 0);
+    }
+    BrotliMemoryTracker tracker = {0, 0};
+    total_compressed_length = static_cast<uint32_t>(std::min<size_t>(
+        *result_length - directory_length,
+        std::numeric_limits<uint32_t>::max()));
+    if (!StreamCompress(StoredTableData(*font_collection),
+                        total_transform_length, result + directory_length,
+                        &total_compressed_length, quality, lgwin, &tracker)) {
+#ifdef FONT_COMPRESSION_BIN
+      fprintf(stderr, "Compression of combined table failed.\n");
+#endif
+      // Running out of result space is what makes streaming fail.
+      return ReportError(params.error, kWOFF2ErrorOutputTooSmall, 0, 0);
+    }
+    brotli_peak_memory = tracker.peak;
+  } else {
+    // Collect all transformed data into one place in output order.
+    std::vector<uint8_t> transform_buf(total_transform_length);
+    size_t transform_offset = 0;
+    for (const auto& chunk : StoredTableData(*font_collection)) {
+      StoreBytes(chunk.first, chunk.second, &transform_offset,
+                 &transform_buf[0]);
+    }
+
+    std::vector<size_t> stream_ends(1, total_transform_length);
+    if (params.num_streams > 1) {
+      stream_ends = ChooseStreamEnds(StreamBoundaries(*font_collection),
+                                     total_transform_length,
+                                     params.num_streams);
+    }
+    multi_stream = stream_ends.size() > 1;
+    if (multi_stream) {
+      // Compress each range of the transformed data in a stream of its own.
+      if (!CompressStreams(transform_buf, stream_ends, quality, lgwin,
+                           params.num_threads, &compression_buf)) {
+#ifdef FONT_COMPRESSION_BIN
+        fprintf(stderr, "Compression of table data streams failed.\n");
+#endif
+        return ReportError(params.error, kWOFF2ErrorInternal, 0, 0);
+      }
+      total_compressed_length = compression_buf.size();
+#ifdef FONT_COMPRESSION_BIN
+      fprintf(stderr, "Compressed in %zu streams.\n", stream_ends.size());
+#endif
+    } else {
+      // Although the compressed size of each table in the final woff2 file
+      // won't be larger than its transform_length, we have to allocate a large
+      // enough buffer for the compressor, since the compressor can potentially
+      // increase the size. If the compressor overflows this, it should return
+      // false and then this function will also return false.
+      size_t compression_buffer_size =
+          CompressedBufferSize(total_transform_length);
+      compression_buf.resize(compression_buffer_size);
+      total_compressed_length = compression_buffer_size;
+
+      // Compress all transformed data in one stream.
+      if (!Woff2Compress(transform_buf.data(), total_transform_length,
+                         &compression_buf[0],
+                         &total_compressed_length,
+                         quality, lgwin)) {
+#ifdef FONT_COMPRESSION_BIN
+        fprintf(stderr, "Compression of combined table failed.\n");
+#endif
+        return ReportError(params.error, kWOFF2ErrorInternal, 0, 0);
+      }
+    }
+  }
+
+  compress_phase.End(total_transform_length);
+
+#ifdef FONT_COMPRESSION_BIN
+  fprintf(stderr, "Compressed %zu to %u.\n", total_transform_length,
+          total_compressed_length);
+#endif
+
+  // Compress the extended metadata
+  // TODO(user): how does this apply to collections
+  uint32_t compressed_metadata_buf_length =
+    CompressedBufferSize(params.extended_metadata.length());
+  std::vector<uint8_t> compressed_metadata_buf(compressed_metadata_buf_length);
+
+  if (params.extended_metadata.length() > 0) {
+    if (!TextCompress((const uint8_t*)params.extended_metadata.data(),
+                      params.extended_metadata.length(),
+                      compressed_metadata_buf.data(),
+                      &compressed_metadata_buf_length,
+                      params.brotli_quality)) {
+#ifdef FONT_COMPRESSION_BIN
+      fprintf(stderr, "Compression of extended metadata failed.\n");
+#endif
+      return ReportError(params.error, kWOFF2ErrorInternal, 0, 0);
+    }
+  } else {
+    compressed_metadata_buf_length = 0;
+  }
+
+  size_t woff2_length = ComputeWoff2Length(*font_collection, tables,
+      collection_indices, total_compressed_length,
       compressed_metadata_buf_length);
   if (woff2_length > *result_length) {
 #ifdef FONT_COMPRESSION_BIN
     fprintf(stderr, "Result allocation was too small (%zd vs %zd bytes).\n",
            *result_length, woff2_length);
 #endif
-    return FONT_COMPRESSION_FAILURE();
+    return ReportError(params.error, kWOFF2ErrorOutputTooSmall, 0, 0);
   }
   *result_length = woff2_length;
 
   size_t offset = 0;
 
   // start of woff2 header (http://www.w3.org/TR/WOFF2/#woff20Header)
-  StoreU32(kWoff2Signature, &offset, result);
-  if (font_collection.flavor != kTtcFontFlavor) {
-    StoreU32(font_collection.fonts[0].flavor, &offset, result);
+  StoreU32(multi_stream ? kWoff2MultiStreamSignature : kWoff2Signature,
+           &offset, result);
+  if (font_collection->flavor != kTtcFontFlavor) {
+    StoreU32(font_collection->fonts[0].flavor, &offset, result);
   } else {
     StoreU32(kTtcFontFlavor, &offset, result);
   }
@@ -371,7 +1156,7 @@ bool ConvertTTFToWOFF2(const uint8_t *data, size_t length,
   Store16(tables.size(), &offset, result);
   Store16(0, &offset, result);  // reserved
   // totalSfntSize
-  StoreU32(ComputeUncompressedLength(font_collection), &offset, result);
+  StoreU32(ComputeUncompressedLength(*font_collection), &offset, result);
   StoreU32(total_compressed_length, &offset, result);  // totalCompressedSize
 
   // Let's just all be v1.0
@@ -398,48 +1183,26 @@ bool ConvertTTFToWOFF2(const uint8_t *data, size_t length,
   }
 
   // for collections only, collection table directory
-  if (font_collection.flavor == kTtcFontFlavor) {
-    StoreU32(font_collection.header_version, &offset, result);
-    Store255UShort(font_collection.fonts.size(), &offset, result);
-    for (const Font& font : font_collection.fonts) {
-
-      uint16_t num_tables = 0;
-      for (const auto& entry : font.tables) {
-        const Font::Table& table = entry.second;
-        if (table.tag & 0x80808080) continue;  // don't write xform tables
-        num_tables++;
-      }
-      Store255UShort(num_tables, &offset, result);
-
-      StoreU32(font.flavor, &offset, result);
-      for (const auto& entry : font.tables) {
-        const Font::Table& table = entry.second;
-        if (table.tag & 0x80808080) continue;  // don't write xform tables
-
-        // for reused tables, only the original has an updated offset
-        uint32_t table_offset =
-          table.IsReused() ? table.reuse_of->offset : table.offset;
-        uint32_t table_length =
-          table.IsReused() ? table.reuse_of->length : table.length;
-        std::pair<uint32_t, uint32_t> tag_offset(table.tag, table_offset);
-        if (index_by_tag_offset.find(tag_offset) == index_by_tag_offset.end()) {
-#ifdef FONT_COMPRESSION_BIN
-fprintf(stderr, "Missing table index for offset 0x%08x\n",
-                  table_offset);
-#endif
-          return FONT_COMPRESSION_FAILURE();
-        }
-        uint16_t index = index_by_tag_offset[tag_offset];
+  if (font_collection->flavor == kTtcFontFlavor) {
+    StoreU32(font_collection->header_version, &offset, result);
+    Store255UShort(font_collection->fonts.size(), &offset, result);
+    for (size_t i = 0; i < font_collection->fonts.size(); ++i) {
+      Store255UShort(collection_indices[i].size(), &offset, result);
+      StoreU32(font_collection->fonts[i].flavor, &offset, result);
+      for (uint16_t index : collection_indices[i]) {
         Store255UShort(index, &offset, result);
-
       }
-
     }
   }
 
   // compressed data format (http://www.w3.org/TR/WOFF2/#table_format)
 
-  StoreBytes(&compression_buf[0], total_compressed_length, &offset, result);
+  if (bounded) {
+    // Already compressed in place.
+    offset += total_compressed_length;
+  } else {
+    StoreBytes(&compression_buf[0], total_compressed_length, &offset, result);
+  }
   offset = Round4(offset);
 
   StoreBytes(compressed_metadata_buf.data(), compressed_metadata_buf_length,
@@ -450,8 +1213,380 @@ fprintf(stderr, "Missing table index for offset 0x%08x\n",
     fprintf(stderr, "Mismatch between computed and actual length "
             "(%zd vs %zd)\n", *result_length, offset);
 #endif
+    return ReportError(params.error, kWOFF2ErrorInternal, 0, 0);
+  }
+
+  if (params.verify &&
+      !VerifyWoff2(*font_collection, result, *result_length, true)) {
+    return ReportError(params.error, kWOFF2ErrorInternal, 0, 0);
+  }
+  if (params.info) {
+    info.brotli_quality = quality;
+    info.brotli_window = lgwin;
+    info.brotli_peak_memory = brotli_peak_memory;
+    *params.info = info;
+  }
+  return true;
+}
+
+bool ConvertTTFToWOFF2(const uint8_t *data, size_t length,
+                       uint8_t *result, size_t *result_length) {
+  WOFF2Params params;
+  return ConvertTTFToWOFF2(data, length, result, result_length,
+                           params);
+}
+
+bool ConvertTTFToWOFF2(const uint8_t *data, size_t length,
+                       uint8_t *result, size_t *result_length,
+                       const WOFF2Params& params) {
+  WOFF2PhaseObserver* observer = params.phase_observer;
+  FontCollection font_collection;
+  ScopedPhase read_phase(observer, kWOFF2PhaseReadFont);
+  if (!ReadFontCollection(data, length, &font_collection)) {
+#ifdef FONT_COMPRESSION_BIN
+    fprintf(stderr, "Parsing of the input font failed.\n");
+#endif
+    return ReportError(params.error, kWOFF2ErrorInvalidInput, 0, 0);
+  }
+  read_phase.End(length);
+
+  if (params.memory_limit > 0) {
+    // Desubroutinizing can grow CFF by far more than can be told up front.
+    if (params.desubroutinize_cff) {
+#ifdef FONT_COMPRESSION_BIN
+      fprintf(stderr, "desubroutinize_cff can't be bounded by memory_limit.\n");
+#endif
+      return ReportError(params.error, kWOFF2ErrorInvalidInput, 0, 0);
+    }
+    if (EstimateTransformMemory(font_collection, params) >
+        params.memory_limit) {
+      return ReportError(params.error, kWOFF2ErrorLimitExceeded, 0, 0);
+    }
+  }
+
+  if (params.desubroutinize_cff) {
+    ScopedPhase phase(observer, kWOFF2PhaseDesubroutinize);
+    phase.End(DesubroutinizeCffTables(&font_collection,
+                                      params.brotli_quality));
+  }
+
+  ScopedPhase normalize_phase(observer, kWOFF2PhaseNormalize);
+  if (!NormalizeFontCollection(&font_collection)) {
+    return ReportError(params.error, kWOFF2ErrorInvalidInput, 0, 0);
+  }
+  normalize_phase.End(CollectionGlyphCount(font_collection));
+
+  if (params.allow_transforms) {
+    ScopedPhase phase(observer, kWOFF2PhaseTransform);
+    if (!TransformFontCollection(&font_collection)) {
+      return ReportError(params.error, kWOFF2ErrorInvalidInput,
+                         kGlyfTableTag, 0);
+    }
+    phase.End(CollectionGlyphCount(font_collection));
+  }
+  // glyf/loca use 11 to flag "not transformed"; transformed tables take
+  // their flags from the transformed versions.
+  for (auto& font : font_collection.fonts) {
+    Font::Table* glyf_table = font.FindTable(kGlyfTableTag);
+    Font::Table* loca_table = font.FindTable(kLocaTableTag);
+    if (glyf_table) {
+      glyf_table->flag_byte |= 0xc0;
+    }
+    if (loca_table) {
+      loca_table->flag_byte |= 0xc0;
+    }
+  }
+
+  return EncodeFontCollection(&font_collection, result, result_length,
+                              params);
+}
+
+
+namespace {
+
+const int kFlagArg1And2AreWords = 1 << 0;
+const int kFlagArgsAreXyValues = 1 << 1;
+const int kFlagWeHaveAScale = 1 << 3;
+const int kFlagMoreComponents = 1 << 5;
+const int kFlagWeHaveAnXAndYScale = 1 << 6;
+const int kFlagWeHaveATwoByTwo = 1 << 7;
+const int kFlagWeHaveInstructions = 1 << 8;
+
+bool IsInt16(int value) {
+  return value >= -32768 && value <= 32767;
+}
+
+// Appends the component records of a composite glyph, as stored in the glyf
+// table.
+bool WriteComponents(const WOFF2OutlineGlyph& glyph,
+                     std::vector<uint8_t>* dst) {
+  for (size_t i = 0; i < glyph.components.size(); ++i) {
+    const WOFF2OutlineComponent& component = glyph.components[i];
+    uint16_t flags =
+        component.flags & ~(kFlagMoreComponents | kFlagWeHaveInstructions);
+    if (i + 1 < glyph.components.size()) {
+      flags |= kFlagMoreComponents;
+    } else if (!glyph.instructions.empty()) {
+      flags |= kFlagWeHaveInstructions;
+    }
+    // Arguments are x/y offsets or point numbers, in bytes or words.
+    const bool words = flags & kFlagArg1And2AreWords;
+    const int min = (flags & kFlagArgsAreXyValues) ? (words ? -32768 : -128) : 0;
+    const int max = (flags & kFlagArgsAreXyValues) ? (words ? 32767 : 127)
+                                                   : (words ? 65535 : 255);
+    if (component.argument1 < min || component.argument1 > max ||
+        component.argument2 < min || component.argument2 > max) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    size_t offset = dst->size();
+    dst->resize(offset + 4 + (words ? 4 : 2));
+    Store16(flags, &offset, dst->data());
+    Store16(component.glyph_index, &offset, dst->data());
+    if (words) {
+      Store16(component.argument1, &offset, dst->data());
+      Store16(component.argument2, &offset, dst->data());
+    } else {
+      (*dst)[offset++] = component.argument1;
+      (*dst)[offset++] = component.argument2;
+    }
+    int num_transform = 0;
+    if (flags & kFlagWeHaveAScale) {
+      num_transform = 1;
+    } else if (flags & kFlagWeHaveAnXAndYScale) {
+      num_transform = 2;
+    } else if (flags & kFlagWeHaveATwoByTwo) {
+      num_transform = 4;
+    }
+    dst->resize(offset + 2 * num_transform);
+    for (int j = 0; j < num_transform; ++j) {
+      Store16(component.transform[j], &offset, dst->data());
+    }
+  }
+  return true;
+}
+
+Font::Table* AddEmptyTable(Font* font, uint32_t tag, size_t length) {
+  Font::Table* table = &font->tables[tag];
+  table->tag = tag;
+  table->checksum = 0;
+  table->offset = 0;
+  table->length = length;
+  table->data = NULL;
+  table->reuse_of = NULL;
+  table->flag_byte = 0;
+  return table;
+}
+
+}  // namespace
+
+struct WOFF2OutlineEncoder::State {
+  explicit State(int num_glyphs)
+      : num_glyphs(num_glyphs),
+        encoder(std::min(std::max(num_glyphs, 0), 0xffff)),
+        num_added(0),
+        glyf_length(0),
+        tables_length(0),
+        finished(false) {
+    font_collection.fonts.resize(1);
+  }
+
+  int num_glyphs;
+  GlyfEncoder encoder;
+  int num_added;
+  // Size of the glyf table that decoding gives, and of the other tables
+  // padded as in the sfnt.
+  uint64_t glyf_length;
+  uint64_t tables_length;
+  bool finished;
+  FontCollection font_collection;
+  // Reused for every glyph.
+  Glyph glyph;
+  std::vector<uint8_t> composite_data;
+};
+
+WOFF2OutlineEncoder::WOFF2OutlineEncoder(int num_glyphs)
+    : state_(new State(num_glyphs)) {}
+
+WOFF2OutlineEncoder::~WOFF2OutlineEncoder() {}
+
+bool WOFF2OutlineEncoder::AddTable(uint32_t tag, const uint8_t* data,
+                                   size_t length) {
+  Font* font = &state_->font_collection.fonts[0];
+  if (state_->finished || tag == kGlyfTableTag || tag == kLocaTableTag ||
+      (tag & 0x80808080) || font->FindTable(tag) != NULL ||
+      length > std::numeric_limits<uint32_t>::max()) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  if (tag == kDsigTableTag) {
+    return true;
+  }
+  Font::Table* table = AddEmptyTable(font, tag, length);
+  table->buffer.assign(data, data + length);
+  table->data = table->buffer.data();
+  state_->tables_length += Round4(length);
+  return true;
+}
+
+bool WOFF2OutlineEncoder::AddGlyph(const WOFF2OutlineGlyph& outline) {
+  State* state = state_.get();
+  if (state->finished || state->num_added >= state->num_glyphs ||
+      state->num_added > 0xffff ||
+      (!outline.contours.empty() && !outline.components.empty()) ||
+      outline.contours.size() > 0x7fff || outline.instructions.size() > 0xffff) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+
+  Glyph* glyph = &state->glyph;
+  glyph->x_min = outline.x_min;
+  glyph->y_min = outline.y_min;
+  glyph->x_max = outline.x_max;
+  glyph->y_max = outline.y_max;
+  glyph->instructions_size = outline.instructions.size();
+  glyph->instructions_data = outline.instructions.data();
+  glyph->overlap_simple_flag_set = outline.overlap_simple;
+  glyph->contours.resize(outline.contours.size());
+  glyph->composite_data = NULL;
+  glyph->composite_data_size = 0;
+  glyph->have_instructions = false;
+
+  // Coordinates are stored as int16 deltas from the previous point.
+  size_t num_points = 0;
+  int last_x = 0;
+  int last_y = 0;
+  for (size_t i = 0; i < outline.contours.size(); ++i) {
+    const std::vector<WOFF2OutlinePoint>& contour = outline.contours[i];
+    num_points += contour.size();
+    if (num_points > 0xffff) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    glyph->contours[i].resize(contour.size());
+    for (size_t j = 0; j < contour.size(); ++j) {
+      const WOFF2OutlinePoint& point = contour[j];
+      if (!IsInt16(point.x) || !IsInt16(point.y) ||
+          !IsInt16(point.x - last_x) || !IsInt16(point.y - last_y)) {
+        return FONT_COMPRESSION_FAILURE();
+      }
+      glyph->contours[i][j].x = point.x;
+      glyph->contours[i][j].y = point.y;
+      glyph->contours[i][j].on_curve = point.on_curve;
+      last_x = point.x;
+      last_y = point.y;
+    }
+  }
+
+  if (!outline.components.empty()) {
+    state->composite_data.clear();
+    if (!WriteComponents(outline, &state->composite_data)) {
+      return FONT_COMPRESSION_FAILURE();
+    }
+    glyph->composite_data = state->composite_data.data();
+    glyph->composite_data_size = state->composite_data.size();
+    glyph->have_instructions = !outline.instructions.empty();
+  }
+
+  if (!state->encoder.Encode(state->num_added, *glyph)) {
+    return FONT_COMPRESSION_FAILURE();
+  }
+  state->glyf_length += Round4(StoredGlyphSize(*glyph));
+  ++state->num_added;
+  return true;
+}
+
+size_t WOFF2OutlineEncoder::MaxCompressedSize(
+    const std::string& extended_metadata) const {
+  // The same bound as MaxWOFF2CompressedSize(), for the normalized font.
+  const size_t num_tables = state_->font_collection.fonts[0].tables.size() + 2;
+  const uint64_t loca_length = 4 * (static_cast<uint64_t>(state_->num_added) + 1);
+  return 12 + 16 * num_tables + state_->tables_length + state_->glyf_length +
+      loca_length + 1024 + extended_metadata.length();
+}
+
+bool WOFF2OutlineEncoder::Finish(uint8_t* result, size_t* result_length,
+                                 const WOFF2Params& params) {
+  State* state = state_.get();
+  if (state->finished || state->num_added != state->num_glyphs) {
+    return ReportError(params.error, kWOFF2ErrorInvalidInput, 0, 0);
+  }
+  // The glyphs only exist in transformed form.
+  if (!params.allow_transforms) {
+#ifdef FONT_COMPRESSION_BIN
+    fprintf(stderr, "The outline encoder can't leave glyf untransformed.\n");
+#endif
+    return ReportError(params.error, kWOFF2ErrorInvalidInput, kGlyfTableTag,
+                       0);
+  }
+  state->finished = true;
+
+  FontCollection* font_collection = &state->font_collection;
+  Font* font = &font_collection->fonts[0];
+  Font::Table* head_table = font->FindTable(kHeadTableTag);
+  const Font::Table* maxp_table = font->FindTable(kMaxpTableTag);
+  if (head_table == NULL || head_table->length < 54 || maxp_table == NULL ||
+      maxp_table->length < 6 || font->FindTable(kHheaTableTag) == NULL ||
+      font->FindTable(kHmtxTableTag) == NULL ||
+      ((maxp_table->data[4] << 8) | maxp_table->data[5]) !=
+          state->num_glyphs) {
+#ifdef FONT_COMPRESSION_BIN
+    fprintf(stderr, "Missing or inconsistent head, hhea, hmtx or maxp.\n");
+#endif
+    return ReportError(params.error, kWOFF2ErrorInvalidInput, 0, 0);
+  }
+
+  // Switch to the long loca format if the short one can't address the glyf
+  // table, as NormalizeGlyphs() does.
+  // indexToLocFormat is the int16 at offset 50; anything but 0 or 1 is bad.
+  int index_fmt = (head_table->buffer[50] << 8) | head_table->buffer[51];
+  if (index_fmt > 1 || state->glyf_length > 0xffffffffUL) {
+    return ReportError(params.error, kWOFF2ErrorInvalidInput,
+                       index_fmt > 1 ? kHeadTableTag : kGlyfTableTag, 0);
+  }
+  if (index_fmt == 0 && state->glyf_length >= (1UL << 17)) {
+    index_fmt = 1;
+    head_table->buffer[51] = 1;
+  }
+  // Set bit 11 of head.flags, as MarkTransformed() does. checkSumAdjustment
+  // is recomputed by the decoder.
+  head_table->buffer[16] |= 0x08;
+  std::fill(&head_table->buffer[8], &head_table->buffer[12], 0);
+
+  AddEmptyTable(font, kGlyfTableTag, state->glyf_length);
+  AddEmptyTable(font, kLocaTableTag,
+                (state->num_glyphs + 1) * (index_fmt ? 4 : 2));
+  Font::Table* transformed_glyf =
+      AddEmptyTable(font, kGlyfTableTag ^ 0x80808080, 0);
+  state->encoder.GetTransformedGlyfBytes(&transformed_glyf->buffer);
+  transformed_glyf->buffer[7] = index_fmt;
+  transformed_glyf->data = transformed_glyf->buffer.data();
+  transformed_glyf->length = transformed_glyf->buffer.size();
+  AddEmptyTable(font, kLocaTableTag ^ 0x80808080, 0);
+
+  font->flavor = 0x00010000;
+  font->num_tables = font->tables.size() - 2;
+  if (!NormalizeOffsets(font)) {
+    return ReportError(params.error, kWOFF2ErrorInvalidInput, 0, 0);
+  }
+  font_collection->flavor = font->flavor;
+  font_collection->header_version = 0;
+
+  // Without the serialized glyphs, only glyf and loca lengths can be verified.
+  WOFF2Params encode_params = params;
+  encode_params.verify = false;
+  if (params.verify) {
+    for (auto& entry : font->tables) {
+      Font::Table& table = entry.second;
+      if (table.data != NULL) {
+        table.checksum = ComputeULongSum(table.data, table.length);
+      }
+    }
+  }
+  if (!EncodeFontCollection(font_collection, result, result_length,
+                            encode_params)) {
     return FONT_COMPRESSION_FAILURE();
   }
+  if (params.verify &&
+      !VerifyWoff2(*font_collection, result, *result_length, false)) {
+    return ReportError(params.error, kWOFF2ErrorInternal, 0, 0);
+  }
   return true;
 }
 
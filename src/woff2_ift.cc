@@ -0,0 +1,127 @@
+/* Copyright 2026 Google Inc. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* A commandline tool for splitting a font into a base font and glyph-keyed
+   patches, and for applying such patches. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "file.h"
+#include <woff2/ift.h>
+#include "./font.h"
+
+namespace {
+
+void Usage() {
+  fprintf(stderr,
+      "Usage: woff2_ift split [-q quality] [-u uri_template] font.ttf "
+      "base_glyphs glyphs_per_patch\n"
+      "  Keeps glyphs [0, base_glyphs) in font.base.ttf and cuts the rest into\n"
+      "  patches font.1.ifgk, font.2.ifgk, ... of glyphs_per_patch glyphs.\n"
+      "Usage: woff2_ift apply base.ttf output.ttf entry:patch...\n"
+      "  Applies each patch as the given patch map entry, in order.\n");
+}
+
+int Split(int argc, char **argv) {
+  woff2::IFTGlyphKeyedParams params;
+  int arg = 0;
+  for (; arg < argc && argv[arg][0] == '-'; ++arg) {
+    if (strcmp(argv[arg], "-q") == 0 && arg + 1 < argc) {
+      params.brotli_quality = atoi(argv[++arg]);
+    } else if (strcmp(argv[arg], "-u") == 0 && arg + 1 < argc) {
+      params.uri_template = argv[++arg];
+    } else {
+      Usage();
+      return 1;
+    }
+  }
+  if (argc - arg != 3) {
+    Usage();
+    return 1;
+  }
+  std::string filename(argv[arg]);
+  int base_glyphs = atoi(argv[arg + 1]);
+  int glyphs_per_patch = atoi(argv[arg + 2]);
+  std::string input = woff2::GetFileContent(filename);
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(input.data());
+  woff2::Font font;
+  if (!woff2::ReadFont(data, input.size(), &font) || base_glyphs < 1 ||
+      glyphs_per_patch < 1) {
+    Usage();
+    return 1;
+  }
+  const int num_glyphs = woff2::NumGlyphs(font);
+  for (int start = base_glyphs; start < num_glyphs;
+       start += glyphs_per_patch) {
+    params.patch_glyphs.push_back(std::vector<uint16_t>());
+    for (int i = start; i < num_glyphs && i < start + glyphs_per_patch; ++i) {
+      params.patch_glyphs.back().push_back(i);
+    }
+  }
+
+  woff2::IFTGlyphKeyedFont result;
+  if (!woff2::CreateGlyphKeyedPatches(data, input.size(), params, &result)) {
+    fprintf(stderr, "Splitting failed.\n");
+    return 1;
+  }
+  const std::string stem = filename.substr(0, filename.find_last_of("."));
+  woff2::SetFileContents(stem + ".base.ttf", result.base_font.begin(),
+                         result.base_font.end());
+  size_t patch_bytes = 0;
+  for (size_t i = 0; i < result.patches.size(); ++i) {
+    woff2::SetFileContents(stem + "." + std::to_string(i + 1) + ".ifgk",
+                           result.patches[i].begin(), result.patches[i].end());
+    patch_bytes += result.patches[i].size();
+  }
+  fprintf(stdout, "%s: base font %zu bytes, %zu patches %zu bytes\n",
+          filename.c_str(), result.base_font.size(), result.patches.size(),
+          patch_bytes);
+  return 0;
+}
+
+int Apply(int argc, char **argv) {
+  if (argc < 3) {
+    Usage();
+    return 1;
+  }
+  std::string font = woff2::GetFileContent(argv[0]);
+  for (int arg = 2; arg < argc; ++arg) {
+    const char* colon = strchr(argv[arg], ':');
+    if (colon == NULL) {
+      Usage();
+      return 1;
+    }
+    int entry_index = atoi(argv[arg]);
+    std::string patch = woff2::GetFileContent(colon + 1);
+    std::string patched;
+    if (entry_index < 1 || entry_index > 0xffff ||
+        !woff2::ApplyGlyphKeyedPatch(
+            reinterpret_cast<const uint8_t*>(font.data()), font.size(),
+            reinterpret_cast<const uint8_t*>(patch.data()), patch.size(),
+            entry_index, &patched)) {
+      fprintf(stderr, "Applying %s failed.\n", argv[arg]);
+      return 1;
+    }
+    font.swap(patched);
+  }
+  woff2::SetFileContents(argv[1], font.begin(), font.end());
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc > 1 && strcmp(argv[1], "split") == 0) {
+    return Split(argc - 2, argv + 2);
+  }
+  if (argc > 1 && strcmp(argv[1], "apply") == 0) {
+    return Apply(argc - 2, argv + 2);
+  }
+  Usage();
+  return 1;
+}
@@ -62,7 +62,8 @@ int main(int argc, char **argv) {
   if (!file.ReadU32(&privOffset)) return 1;
   if (!file.ReadU32(&privLength)) return 1;
 
-  if (signature != 0x774F4632) {
+  const bool multi_stream = signature == woff2::kWoff2MultiStreamSignature;
+  if (signature != woff2::kWoff2Signature && !multi_stream) {
     printf("Invalid signature: %08x\n", signature);
     return 1;
   }
@@ -138,5 +139,19 @@ int main(int argc, char **argv) {
 
   printf("TableDirectory ends at +%zu\n", file.offset());
 
+  // Stream index of our private multi-stream variant
+  if (multi_stream) {
+    uint32_t numStreams;
+    if (!woff2::Read255UShort(&file, &numStreams)) return 1;
+    printf("StreamIndex %u streams\n", numStreams);
+    printf("Stream origLength compLength\n");
+    for (uint32_t i = 0; i < numStreams; i++) {
+      uint32_t origLength, compLength;
+      if (!ReadBase128(&file, &origLength)) return 1;
+      if (!ReadBase128(&file, &compLength)) return 1;
+      printf("%6u %10u %10u\n", i, origLength, compLength);
+    }
+  }
+
   return 0;
 }
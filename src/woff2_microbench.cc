@@ -0,0 +1,441 @@
+/* Copyright 2026 Google Inc. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* A commandline tool for timing the library's inner loops in isolation, on
+   fixed synthetic inputs. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define WOFF2_HAVE_RDTSC 1
+#endif
+
+#include <woff2/output.h>
+
+#include "./buffer.h"
+#include "./glyph.h"
+#include "./transform.h"
+#include "./variable_length.h"
+#include "./woff2_common.h"
+#include "./woff2_dec_kernels.h"
+
+namespace {
+
+using woff2::Point;
+
+const int kTrials = 11;
+// Each trial runs the kernel in a loop for at least this long.
+const double kMinTrialNs = 2e6;
+const size_t kNumPoints = 4096;
+const size_t kNumValues = 4096;
+const size_t kNumGlyphs = 4096;
+const size_t kBufferSize = 64 * 1024;
+const size_t kWriteChunk = 64;
+
+// Keeps results alive so the compiler can't drop the work.
+volatile uint32_t g_sink;
+
+struct Kernel {
+  std::string name;
+  size_t bytes_per_op;
+  std::function<bool()> run;
+};
+
+struct Result {
+  double ns_per_op;
+  double cycles_per_op;  // 0 if unknown
+};
+
+// Deterministic, so runs on different builds see the same inputs.
+class Random {
+ public:
+  explicit Random(uint32_t seed) : state_(seed) {}
+  uint32_t Next() {
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 17;
+    state_ ^= state_ << 5;
+    return state_;
+  }
+  int Range(int lo, int hi) {
+    return lo + static_cast<int>(Next() % static_cast<uint32_t>(hi - lo + 1));
+  }
+ private:
+  uint32_t state_;
+};
+
+inline uint64_t Cycles() {
+#ifdef WOFF2_HAVE_RDTSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+double NowNs() {
+  return std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Grows the batch until one takes kMinTrialNs, then reports the median of
+// kTrials batches.
+bool Measure(const Kernel& kernel, Result* result) {
+  if (!kernel.run()) {
+    return false;
+  }
+  size_t batch = 1;
+  for (;;) {
+    double start = NowNs();
+    for (size_t i = 0; i < batch; ++i) {
+      kernel.run();
+    }
+    if (NowNs() - start >= kMinTrialNs) {
+      break;
+    }
+    batch *= 2;
+  }
+  std::vector<Result> trials(kTrials);
+  for (int t = 0; t < kTrials; ++t) {
+    double start = NowNs();
+    uint64_t start_cycles = Cycles();
+    for (size_t i = 0; i < batch; ++i) {
+      kernel.run();
+    }
+    trials[t].cycles_per_op =
+        static_cast<double>(Cycles() - start_cycles) / batch;
+    trials[t].ns_per_op = (NowNs() - start) / batch;
+  }
+  std::sort(trials.begin(), trials.end(),
+            [](const Result& a, const Result& b) {
+              return a.ns_per_op < b.ns_per_op;
+            });
+  *result = trials[kTrials / 2];
+  return true;
+}
+
+// A glyph-like sequence of mostly short deltas with some long ones, so every
+// triplet encoding gets used.
+std::vector<Point> MakePoints(Random* random) {
+  std::vector<Point> points(kNumPoints);
+  int x = 0;
+  int y = 0;
+  for (size_t i = 0; i < kNumPoints; ++i) {
+    uint32_t kind = random->Next() % 16;
+    int range = kind < 10 ? 60 : kind < 14 ? 700 : 4000;
+    x += random->Range(-range, range);
+    y += random->Range(-range, range);
+    points[i].x = x;
+    points[i].y = y;
+    points[i].on_curve = (random->Next() & 3) != 0;
+  }
+  return points;
+}
+
+woff2::Glyph MakeGlyph(const std::vector<Point>& points, size_t n_points) {
+  woff2::Glyph glyph;
+  const size_t kPointsPerContour = 16;
+  for (size_t i = 0; i < n_points; ++i) {
+    if (i % kPointsPerContour == 0) {
+      glyph.contours.push_back(std::vector<woff2::Glyph::Point>());
+    }
+    woff2::Glyph::Point point;
+    point.x = points[i].x;
+    point.y = points[i].y;
+    point.on_curve = points[i].on_curve;
+    glyph.contours.back().push_back(point);
+  }
+  glyph.x_min = glyph.y_min = -32768;
+  glyph.x_max = glyph.y_max = 32767;
+  glyph.instructions_size = 0;
+  glyph.instructions_data = NULL;
+  return glyph;
+}
+
+std::vector<Kernel> MakeKernels() {
+  std::vector<Kernel> kernels;
+  Random random(0x5eed);
+
+  // Table checksums.
+  auto table = std::make_shared<std::vector<uint8_t> >(kBufferSize);
+  for (size_t i = 0; i < table->size(); ++i) {
+    (*table)[i] = random.Next();
+  }
+  kernels.push_back({"ComputeULongSum", table->size(), [table]() {
+    g_sink = woff2::ComputeULongSum(table->data(), table->size());
+    return true;
+  }});
+
+  // Triplets, in both directions.
+  auto points = std::make_shared<std::vector<Point> >(MakePoints(&random));
+  auto flags = std::make_shared<std::vector<uint8_t> >();
+  auto triplets = std::make_shared<std::vector<uint8_t> >();
+  int last_x = 0;
+  int last_y = 0;
+  for (const Point& point : *points) {
+    woff2::WriteTriplet(point.on_curve, point.x - last_x, point.y - last_y,
+                        flags.get(), triplets.get());
+    last_x = point.x;
+    last_y = point.y;
+  }
+  const size_t triplet_bytes = flags->size() + triplets->size();
+  auto encoded_flags = std::make_shared<std::vector<uint8_t> >();
+  auto encoded_triplets = std::make_shared<std::vector<uint8_t> >();
+  kernels.push_back({"WriteTriplet", triplet_bytes,
+                     [points, encoded_flags, encoded_triplets]() {
+    encoded_flags->clear();
+    encoded_triplets->clear();
+    int x = 0;
+    int y = 0;
+    for (const Point& point : *points) {
+      woff2::WriteTriplet(point.on_curve, point.x - x, point.y - y,
+                          encoded_flags.get(), encoded_triplets.get());
+      x = point.x;
+      y = point.y;
+    }
+    g_sink = encoded_triplets->size();
+    return true;
+  }});
+  auto decoded = std::make_shared<std::vector<Point> >(kNumPoints);
+  kernels.push_back({"TripletDecode", triplet_bytes,
+                     [flags, triplets, decoded]() {
+    size_t consumed = 0;
+    if (!woff2::TripletDecode(flags->data(), triplets->data(),
+                              triplets->size(), 0, kNumPoints, decoded->data(),
+                              &consumed)) {
+      return false;
+    }
+    g_sink = consumed;
+    return true;
+  }});
+  // The same, with the guard the decoder puts after its buffer.
+  auto guarded_triplets = std::make_shared<std::vector<uint8_t> >(*triplets);
+  guarded_triplets->resize(triplets->size() + woff2::kDecodeGuardSize);
+  kernels.push_back({"TripletDecodeGuarded", triplet_bytes,
+                     [flags, guarded_triplets, decoded]() {
+    size_t consumed = 0;
+    if (!woff2::TripletDecode(flags->data(), guarded_triplets->data(),
+                              guarded_triplets->size() -
+                                  woff2::kDecodeGuardSize,
+                              woff2::kDecodeGuardSize, kNumPoints,
+                              decoded->data(), &consumed)) {
+      return false;
+    }
+    g_sink = consumed;
+    return true;
+  }});
+
+  // Simple glyph reconstruction, as one glyph with a single contour.
+  auto glyph_buffer = std::make_shared<std::vector<uint8_t> >(
+      12 + 5 * kNumPoints + 2);
+  const size_t flags_offset = 10 + 2 + 2;
+  size_t stored_size = flags_offset;
+  woff2::StorePoints(kNumPoints, points->data(), 1, 0, false,
+                     glyph_buffer->data(), glyph_buffer->size(), &stored_size);
+  kernels.push_back({"StorePoints", stored_size - flags_offset,
+                     [points, glyph_buffer, flags_offset]() {
+    size_t glyph_size = flags_offset;
+    if (!woff2::StorePoints(kNumPoints, points->data(), 1, 0, false,
+                            glyph_buffer->data(), glyph_buffer->size(),
+                            &glyph_size)) {
+      return false;
+    }
+    g_sink = glyph_size;
+    return true;
+  }});
+  kernels.push_back({"ComputeBbox", kNumPoints * sizeof(Point),
+                     [points, glyph_buffer]() {
+    woff2::ComputeBbox(kNumPoints, points->data(), glyph_buffer->data());
+    g_sink = (*glyph_buffer)[2];
+    return true;
+  }});
+
+  // Glyph parsing and serialization, of one typical 64-point glyph.
+  const size_t kGlyphPoints = 64;
+  auto glyph = std::make_shared<woff2::Glyph>(
+      MakeGlyph(*points, kGlyphPoints));
+  size_t glyph_size = 12 + 2 * glyph->contours.size() + 5 * kGlyphPoints;
+  auto glyph_data = std::make_shared<std::vector<uint8_t> >(glyph_size);
+  if (!woff2::StoreGlyph(*glyph, glyph_data->data(), &glyph_size)) {
+    return std::vector<Kernel>();
+  }
+  glyph_data->resize(glyph_size);
+  kernels.push_back({"ReadGlyph", glyph_size, [glyph_data]() {
+    woff2::Glyph parsed;
+    if (!woff2::ReadGlyph(glyph_data->data(), glyph_data->size(), &parsed)) {
+      return false;
+    }
+    g_sink = parsed.contours.size();
+    return true;
+  }});
+  auto store_buffer = std::make_shared<std::vector<uint8_t> >(
+      glyph_data->size());
+  kernels.push_back({"StoreGlyph", glyph_size, [glyph, store_buffer]() {
+    size_t size = store_buffer->size();
+    if (!woff2::StoreGlyph(*glyph, store_buffer->data(), &size)) {
+      return false;
+    }
+    g_sink = size;
+    return true;
+  }});
+
+  // Variable length integers, with the value mix of glyph and point counts.
+  auto ushorts = std::make_shared<std::vector<uint8_t> >();
+  auto base128 = std::make_shared<std::vector<uint8_t> >(5 * kNumValues);
+  size_t base128_size = 0;
+  for (size_t i = 0; i < kNumValues; ++i) {
+    uint32_t kind = random.Next() % 8;
+    int value = kind < 5 ? random.Range(0, 252) :
+        kind < 7 ? random.Range(253, 761) : random.Range(762, 65535);
+    woff2::Write255UShort(ushorts.get(), value);
+    woff2::StoreBase128(value * 4, &base128_size, base128->data());
+  }
+  base128->resize(base128_size);
+  kernels.push_back({"Read255UShort", ushorts->size(), [ushorts]() {
+    woff2::Buffer buffer(ushorts->data(), ushorts->size());
+    uint32_t sum = 0;
+    for (size_t i = 0; i < kNumValues; ++i) {
+      unsigned int value;
+      if (!woff2::Read255UShort(&buffer, &value)) {
+        return false;
+      }
+      sum += value;
+    }
+    g_sink = sum;
+    return true;
+  }});
+  kernels.push_back({"ReadBase128", base128->size(), [base128]() {
+    woff2::Buffer buffer(base128->data(), base128->size());
+    uint32_t sum = 0;
+    for (size_t i = 0; i < kNumValues; ++i) {
+      uint32_t value;
+      if (!woff2::ReadBase128(&buffer, &value)) {
+        return false;
+      }
+      sum += value;
+    }
+    g_sink = sum;
+    return true;
+  }});
+
+  // loca, in both index formats.
+  auto loca_values = std::make_shared<std::vector<uint32_t> >(kNumGlyphs + 1);
+  for (size_t i = 1; i <= kNumGlyphs; ++i) {
+    (*loca_values)[i] = (*loca_values)[i - 1] + 2 * random.Range(0, 60);
+  }
+  auto loca_buffer = std::make_shared<std::vector<uint8_t> >(
+      4 * loca_values->size());
+  for (int index_format = 0; index_format < 2; ++index_format) {
+    kernels.push_back({index_format ? "StoreLoca/long" : "StoreLoca/short",
+                       (index_format ? 4 : 2) * loca_values->size(),
+                       [loca_values, loca_buffer, index_format]() {
+      woff2::WOFF2MemoryOut out(loca_buffer->data(), loca_buffer->size());
+      uint32_t checksum;
+      if (!woff2::StoreLoca(*loca_values, index_format, &checksum, 0,
+                            &out)) {
+        return false;
+      }
+      g_sink = checksum;
+      return true;
+    }});
+  }
+
+  // Output writers, appending table-sized runs in small chunks.
+  auto string_output = std::make_shared<std::string>();
+  kernels.push_back({"WOFF2StringOut::Write", kBufferSize,
+                     [table, string_output]() {
+    string_output->clear();
+    woff2::WOFF2StringOut out(string_output.get());
+    for (size_t i = 0; i < kBufferSize; i += kWriteChunk) {
+      if (!out.Write(table->data() + i, kWriteChunk)) {
+        return false;
+      }
+    }
+    g_sink = out.Size();
+    return true;
+  }});
+  auto memory_output = std::make_shared<std::vector<uint8_t> >(kBufferSize);
+  kernels.push_back({"WOFF2MemoryOut::Write", kBufferSize,
+                     [table, memory_output]() {
+    woff2::WOFF2MemoryOut out(memory_output->data(), memory_output->size());
+    for (size_t i = 0; i < kBufferSize; i += kWriteChunk) {
+      if (!out.Write(table->data() + i, kWriteChunk)) {
+        return false;
+      }
+    }
+    g_sink = out.Size();
+    return true;
+  }});
+  kernels.push_back({"WOFF2MemoryOut::Write(offset)", kBufferSize,
+                     [table, memory_output]() {
+    woff2::WOFF2MemoryOut out(memory_output->data(), memory_output->size());
+    for (size_t i = kBufferSize; i > 0; i -= kWriteChunk) {
+      if (!out.Write(table->data() + i - kWriteChunk, i - kWriteChunk,
+                     kWriteChunk)) {
+        return false;
+      }
+    }
+    g_sink = out.Size();
+    return true;
+  }});
+  return kernels;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc > 2 || (argc == 2 && argv[1][0] == '-')) {
+    fprintf(stderr,
+        "Usage: woff2_microbench [filter]\n"
+        "  Times each kernel whose name contains filter, or all of them.\n");
+    return 1;
+  }
+  const char* filter = argc == 2 ? argv[1] : "";
+  std::vector<Kernel> kernels = MakeKernels();
+  if (kernels.empty()) {
+    fprintf(stderr, "Failed to build the synthetic inputs\n");
+    return 1;
+  }
+
+#ifdef WOFF2_HAVE_RDTSC
+  // The TSC ticks at a fixed reference rate, which is not the core clock
+  // under frequency scaling; pin the frequency for stable cycle counts.
+  fprintf(stdout, "%-30s %10s %12s %12s %12s\n", "kernel", "bytes/op",
+          "ns/op", "cycles/op", "bytes/cycle");
+#else
+  fprintf(stdout, "%-30s %10s %12s %12s\n", "kernel", "bytes/op", "ns/op",
+          "bytes/ns");
+#endif
+  int failures = 0;
+  for (const Kernel& kernel : kernels) {
+    if (kernel.name.find(filter) == std::string::npos) {
+      continue;
+    }
+    Result result;
+    if (!Measure(kernel, &result)) {
+      fprintf(stderr, "%s failed\n", kernel.name.c_str());
+      ++failures;
+      continue;
+    }
+#ifdef WOFF2_HAVE_RDTSC
+    fprintf(stdout, "%-30s %10zu %12.1f %12.1f %12.3f\n", kernel.name.c_str(),
+            kernel.bytes_per_op, result.ns_per_op, result.cycles_per_op,
+            kernel.bytes_per_op / result.cycles_per_op);
+#else
+    fprintf(stdout, "%-30s %10zu %12.1f %12.3f\n", kernel.name.c_str(),
+            kernel.bytes_per_op, result.ns_per_op,
+            kernel.bytes_per_op / result.ns_per_op);
+#endif
+  }
+  return failures == 0 ? 0 : 1;
+}
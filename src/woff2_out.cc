@@ -8,6 +8,10 @@
 
 #include <woff2/output.h>
 
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
 namespace woff2 {
 
 WOFF2StringOut::WOFF2StringOut(std::string *buf)
@@ -60,4 +64,109 @@ bool WOFF2MemoryOut::Write(const void *buf, size_t offset, size_t n) {
   return true;
 }
 
+const size_t WOFF2ChunkPool::kDefaultChunkSize;
+
+WOFF2ChunkPool::WOFF2ChunkPool(size_t chunk_size)
+    : chunk_size_(std::max<size_t>(chunk_size, 1)) {}
+
+uint8_t* WOFF2ChunkPool::Allocate() {
+  if (free_.empty()) {
+    return new uint8_t[chunk_size_];
+  }
+  uint8_t* chunk = free_.back().release();
+  free_.pop_back();
+  return chunk;
+}
+
+void WOFF2ChunkPool::Release(uint8_t* chunk) {
+  free_.emplace_back(chunk);
+}
+
+WOFF2ChunkedOut::WOFF2ChunkedOut(WOFF2ChunkPool* pool)
+    : pool_(pool), max_size_(kDefaultMaxSize), size_(0) {}
+
+WOFF2ChunkedOut::~WOFF2ChunkedOut() {
+  Reset();
+}
+
+bool WOFF2ChunkedOut::Write(const void *buf, size_t n) {
+  return Write(buf, size_, n);
+}
+
+bool WOFF2ChunkedOut::Write(const void *buf, size_t offset, size_t n) {
+  if (offset > max_size_ || n > max_size_ - offset) {
+    return false;
+  }
+  const size_t chunk_size = pool_->ChunkSize();
+  const size_t end = offset + n;
+  while (chunks_.size() * chunk_size < end) {
+    chunks_.push_back(pool_->Allocate());
+  }
+  // Zero any gap between the old end and offset, as WOFF2StringOut does.
+  for (size_t pos = size_; pos < offset;) {
+    const size_t in_chunk = pos % chunk_size;
+    const size_t len = std::min(chunk_size - in_chunk, offset - pos);
+    std::memset(chunks_[pos / chunk_size] + in_chunk, 0, len);
+    pos += len;
+  }
+  const uint8_t* src = static_cast<const uint8_t*>(buf);
+  for (size_t pos = offset; pos < end;) {
+    const size_t in_chunk = pos % chunk_size;
+    const size_t len = std::min(chunk_size - in_chunk, end - pos);
+    std::memcpy(chunks_[pos / chunk_size] + in_chunk, src, len);
+    src += len;
+    pos += len;
+  }
+  size_ = std::max(size_, end);
+
+  return true;
+}
+
+void WOFF2ChunkedOut::SetMaxSize(size_t max_size) {
+  max_size_ = max_size;
+  if (size_ > max_size_) {
+    size_ = max_size_;
+  }
+}
+
+void WOFF2ChunkedOut::GetChunks(std::vector<Chunk>* chunks) const {
+  const size_t chunk_size = pool_->ChunkSize();
+  chunks->clear();
+  for (size_t pos = 0; pos < size_; pos += chunk_size) {
+    Chunk chunk = {chunks_[pos / chunk_size],
+                   std::min(chunk_size, size_ - pos)};
+    chunks->push_back(chunk);
+  }
+}
+
+#ifndef _WIN32
+void WOFF2ChunkedOut::GetIovecs(std::vector<struct iovec>* iovecs) const {
+  std::vector<Chunk> chunks;
+  GetChunks(&chunks);
+  iovecs->resize(chunks.size());
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    (*iovecs)[i].iov_base = const_cast<uint8_t*>(chunks[i].data);
+    (*iovecs)[i].iov_len = chunks[i].size;
+  }
+}
+#endif
+
+void WOFF2ChunkedOut::Flatten(std::string* result) const {
+  std::vector<Chunk> chunks;
+  GetChunks(&chunks);
+  result->clear();
+  result->reserve(size_);
+  for (const Chunk& chunk : chunks) {
+    result->append(reinterpret_cast<const char*>(chunk.data), chunk.size);
+  }
+}
+
+void WOFF2ChunkedOut::Reset() {
+  for (uint8_t* chunk : chunks_) {
+    pool_->Release(chunk);
+  }
+  chunks_.clear();
+  size_ = 0;
+}
+
 } // namespace woff2
@@ -0,0 +1,190 @@
+/* Copyright 2026 Google Inc. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* A commandline tool for building packs of WOFF2 files, listing them and
+   decoding fonts straight out of them. */
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "file.h"
+#include <woff2/decode.h>
+#include <woff2/output.h>
+#include <woff2/pack.h>
+
+namespace {
+
+// A pack file, mapped where mmap is available and read otherwise.
+class PackFile {
+ public:
+  explicit PackFile(const std::string& filename)
+      : data_(NULL), length_(0), mapped_(false) {
+#ifndef _WIN32
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+      void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (map != MAP_FAILED) {
+        data_ = static_cast<const uint8_t*>(map);
+        length_ = st.st_size;
+        mapped_ = true;
+      }
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+    if (mapped_) {
+      return;
+    }
+#endif
+    content_ = woff2::GetFileContent(filename);
+    data_ = reinterpret_cast<const uint8_t*>(content_.data());
+    length_ = content_.size();
+  }
+
+  ~PackFile() {
+#ifndef _WIN32
+    if (mapped_) {
+      munmap(const_cast<uint8_t*>(data_), length_);
+    }
+#endif
+  }
+
+  const uint8_t* data() const { return data_; }
+  size_t length() const { return length_; }
+
+ private:
+  const uint8_t* data_;
+  size_t length_;
+  bool mapped_;
+  std::string content_;
+};
+
+std::string BaseName(const std::string& path) {
+  return path.substr(path.find_last_of('/') + 1);
+}
+
+std::string TagString(uint32_t tag) {
+  char tag_string[] = {
+    static_cast<char>(tag >> 24), static_cast<char>(tag >> 16),
+    static_cast<char>(tag >> 8), static_cast<char>(tag), 0
+  };
+  return tag_string;
+}
+
+int Create(const std::string& pack_name, int num_files, char** files) {
+  woff2::WOFF2PackWriter writer;
+  for (int i = 0; i < num_files; ++i) {
+    std::string input = woff2::GetFileContent(files[i]);
+    if (!writer.Add(BaseName(files[i]),
+                    reinterpret_cast<const uint8_t*>(input.data()),
+                    input.size())) {
+      fprintf(stderr, "%s: not a WOFF2 file, or its name is taken\n",
+              files[i]);
+      return 1;
+    }
+  }
+  std::string pack;
+  if (!writer.Finish(&pack)) {
+    fprintf(stderr, "The pack would exceed 4 GB.\n");
+    return 1;
+  }
+  woff2::SetFileContents(pack_name, pack.begin(), pack.end());
+  return 0;
+}
+
+int List(const woff2::WOFF2PackReader& reader, bool tables) {
+  for (size_t i = 0; i < reader.num_entries(); ++i) {
+    woff2::WOFF2PackEntry entry;
+    if (!reader.GetEntry(i, &entry)) {
+      fprintf(stderr, "Entry %zu is corrupt.\n", i);
+      return 1;
+    }
+    fprintf(stdout, "%-32s %10zu -> %10u bytes, flavor 0x%08x, %u tables, "
+            "%u fonts\n", entry.name, entry.length, entry.total_sfnt_size,
+            entry.flavor, entry.num_tables, entry.num_fonts);
+    for (size_t j = 0; tables && j < entry.num_tables; ++j) {
+      woff2::WOFF2PackTable table;
+      if (!reader.GetTable(i, j, &table)) {
+        fprintf(stderr, "Table %zu of entry %zu is corrupt.\n", j, i);
+        return 1;
+      }
+      fprintf(stdout, "  %s version %d %10u %10u\n",
+              TagString(table.tag).c_str(), table.transform_version,
+              table.orig_length, table.transform_length);
+    }
+  }
+  return 0;
+}
+
+int Decode(const woff2::WOFF2PackReader& reader, const std::string& name) {
+  size_t index;
+  woff2::WOFF2PackEntry entry;
+  if (!reader.Find(name, &index) || !reader.GetEntry(index, &entry)) {
+    fprintf(stderr, "%s is not in the pack.\n", name.c_str());
+    return 1;
+  }
+  std::string output(std::min<size_t>(entry.total_sfnt_size,
+                                      woff2::kDefaultMaxSize), 0);
+  woff2::WOFF2StringOut out(&output);
+  if (!woff2::ConvertWOFF2ToTTF(entry.data, entry.length, &out)) {
+    fprintf(stderr, "Decompression of %s failed.\n", name.c_str());
+    return 1;
+  }
+  output.resize(out.Size());
+  const std::string outfilename =
+      name.substr(0, name.find_last_of(".")) + ".ttf";
+  woff2::SetFileContents(outfilename, output.begin(), output.end());
+  return 0;
+}
+
+void Usage() {
+  fprintf(stderr,
+      "Usage: woff2_pack create pack file.woff2...\n"
+      "       woff2_pack list [-t] pack\n"
+      "       woff2_pack decode pack name\n"
+      "  create packs the files under their base names, list prints each\n"
+      "  entry (and with -t its table directory), decode writes the entry\n"
+      "  named name to name.ttf.\n");
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc >= 4 && strcmp(argv[1], "create") == 0) {
+    return Create(argv[2], argc - 3, argv + 3);
+  }
+  const bool tables = argc == 4 && strcmp(argv[2], "-t") == 0;
+  std::string pack_name;
+  if (argc == 3 + tables && strcmp(argv[1], "list") == 0) {
+    pack_name = argv[2 + tables];
+  } else if (argc == 4 && strcmp(argv[1], "decode") == 0) {
+    pack_name = argv[2];
+  } else {
+    Usage();
+    return 1;
+  }
+
+  PackFile file(pack_name);
+  woff2::WOFF2PackReader reader;
+  if (!reader.Open(file.data(), file.length())) {
+    fprintf(stderr, "%s is not a pack.\n", pack_name.c_str());
+    return 1;
+  }
+  if (strcmp(argv[1], "list") == 0) {
+    return List(reader, tables);
+  }
+  return Decode(reader, argv[3]);
+}
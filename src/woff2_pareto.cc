@@ -0,0 +1,467 @@
+/* Copyright 2026 Google Inc. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* A commandline tool for tabulating compressed size against encode and decode
+   time over a font corpus, for every Brotli quality and a few window sizes. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <brotli/decode.h>
+#include <brotli/encode.h>
+
+#include "file.h"
+#include <woff2/decode.h>
+#include <woff2/encode.h>
+#include "./buffer.h"
+#include "./font.h"
+#include "./round.h"
+#include "./store_bytes.h"
+#include "./table_tags.h"
+#include "./variable_length.h"
+#include "./woff2_common.h"
+
+namespace {
+
+const int kWindows[] = { 16, 18, 20, 22 };
+const size_t kWoff2HeaderSize = 48;
+const size_t kLengthOffset = 8;
+const size_t kTotalCompressedSizeOffset = 20;
+
+struct Config {
+  int quality;
+  int lgwin;
+};
+
+struct Sample {
+  Config config;
+  size_t size;
+  double encode_ms;  // front end plus Brotli
+  double decode_ms;
+  bool pareto;
+};
+
+struct FontReport {
+  std::string path;  // empty for a class total
+  std::string font_class;
+  int font_count;
+  double front_end_ms;
+  std::vector<Sample> samples;  // one per config, in the same order
+};
+
+void Usage() {
+  fprintf(stderr,
+      "Usage: woff2_pareto [-f csv|json] [-n runs] font...\n"
+      "  Encodes each font once, then recompresses its table data at every\n"
+      "  Brotli quality and window sizes 16, 18, 20 and 22, timing encode\n"
+      "  and decode. Marks the configs on the size/encode time Pareto\n"
+      "  frontier, per font and summed over each font class (cjk, latin,\n"
+      "  icon, color or other).\n"
+      "  -f  output format (default csv)\n"
+      "  -n  time each step this many times and keep the median (default 3)\n");
+}
+
+double MedianMs(int runs, const std::function<bool()>& run) {
+  std::vector<double> times;
+  for (int i = 0; i < runs; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    if (!run()) {
+      return -1;
+    }
+    times.push_back(std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count());
+  }
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+bool HasUnicodeRange(const woff2::Font::Table* os2, int bit) {
+  const size_t offset = 42 + 4 * (bit / 32);
+  if (os2 == NULL || os2->length < offset + 4) {
+    return false;
+  }
+  const uint8_t* p = os2->data + offset;
+  uint32_t range = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+  return (range >> (bit % 32)) & 1;
+}
+
+// Guesses the class of the (first) font from its tables and the OS/2
+// Unicode ranges it claims.
+std::string FontClass(const std::string& input) {
+  woff2::FontCollection collection;
+  if (!woff2::ReadFontCollection(
+          reinterpret_cast<const uint8_t*>(input.data()), input.size(),
+          &collection) || collection.fonts.empty()) {
+    return "other";
+  }
+  const woff2::Font& font = collection.fonts[0];
+  if (font.FindTable(woff2::kColrTableTag) ||
+      font.FindTable(woff2::kCbdtTableTag) ||
+      font.FindTable(woff2::kSbixTableTag) ||
+      font.FindTable(woff2::kSvgTableTag)) {
+    return "color";
+  }
+  const woff2::Font::Table* os2 = font.FindTable(woff2::kOs2TableTag);
+  // CJK symbols, kana, bopomofo, Hangul, enclosed and compatibility CJK and
+  // the unified ideographs.
+  const int kCjkBits[] = { 48, 49, 50, 51, 52, 54, 55, 56, 59 };
+  for (int bit : kCjkBits) {
+    if (HasUnicodeRange(os2, bit)) {
+      return "cjk";
+    }
+  }
+  const bool basic_latin = HasUnicodeRange(os2, 0);
+  if (!basic_latin && HasUnicodeRange(os2, 60)) {  // private use area
+    return "icon";
+  }
+  return basic_latin ? "latin" : "other";
+}
+
+// Finds where the compressed table data starts in a WOFF2 file, and the
+// length it decompresses to.
+bool ParseLayout(const std::string& woff2_data, size_t* data_offset,
+                 size_t* stream_length) {
+  woff2::Buffer file(reinterpret_cast<const uint8_t*>(woff2_data.data()),
+                     woff2_data.size());
+  uint32_t flavor;
+  uint16_t num_tables;
+  if (!file.Skip(4) || !file.ReadU32(&flavor) || !file.Skip(4) ||
+      !file.ReadU16(&num_tables) ||
+      !file.Skip(kWoff2HeaderSize - file.offset())) {
+    return false;
+  }
+  *stream_length = 0;
+  for (int i = 0; i < num_tables; ++i) {
+    uint8_t flags;
+    uint32_t tag, orig_length, transform_length;
+    if (!file.ReadU8(&flags)) {
+      return false;
+    }
+    if ((flags & 0x3f) == 0x3f) {
+      if (!file.ReadU32(&tag)) {
+        return false;
+      }
+    } else {
+      tag = woff2::kKnownTags[flags & 0x3f];
+    }
+    if (!woff2::ReadBase128(&file, &orig_length)) {
+      return false;
+    }
+    transform_length = orig_length;
+    uint8_t xform_version = (flags >> 6) & 0x3;
+    bool transformed = tag == woff2::kGlyfTableTag ||
+        tag == woff2::kLocaTableTag ? xform_version == 0 : xform_version != 0;
+    if (transformed && !woff2::ReadBase128(&file, &transform_length)) {
+      return false;
+    }
+    *stream_length += transform_length;
+  }
+  if (flavor == woff2::kTtcFontFlavor) {
+    uint32_t num_fonts;
+    if (!file.Skip(4) || !woff2::Read255UShort(&file, &num_fonts)) {
+      return false;
+    }
+    for (uint32_t i = 0; i < num_fonts; ++i) {
+      uint32_t font_tables, index;
+      if (!woff2::Read255UShort(&file, &font_tables) || !file.Skip(4)) {
+        return false;
+      }
+      for (uint32_t j = 0; j < font_tables; ++j) {
+        if (!woff2::Read255UShort(&file, &index)) {
+          return false;
+        }
+      }
+    }
+  }
+  *data_offset = file.offset();
+  return true;
+}
+
+// Replaces the compressed table data of a WOFF2 file without metadata.
+std::string Splice(const std::string& woff2_data, size_t data_offset,
+                   const std::string& compressed) {
+  std::string result = woff2_data.substr(0, data_offset) + compressed;
+  result.resize(woff2::Round4(result.size()), 0);
+  uint8_t* dst = reinterpret_cast<uint8_t*>(&result[0]);
+  woff2::StoreU32(dst, kLengthOffset, result.size());
+  woff2::StoreU32(dst, kTotalCompressedSizeOffset, compressed.size());
+  return result;
+}
+
+bool BrotliCompress(const std::string& input, int quality, int lgwin,
+                    std::string* output) {
+  size_t length = BrotliEncoderMaxCompressedSize(input.size());
+  output->resize(length);
+  if (!BrotliEncoderCompress(quality, lgwin, BROTLI_MODE_FONT, input.size(),
+          reinterpret_cast<const uint8_t*>(input.data()), &length,
+          reinterpret_cast<uint8_t*>(&(*output)[0]))) {
+    return false;
+  }
+  output->resize(length);
+  return true;
+}
+
+bool Decode(const std::string& woff2_data, std::string* output) {
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(woff2_data.data());
+  output->assign(std::min(woff2::ComputeWOFF2FinalSize(data, woff2_data.size()),
+                          woff2::kDefaultMaxSize), 0);
+  woff2::WOFF2StringOut out(output);
+  if (!woff2::ConvertWOFF2ToTTF(data, woff2_data.size(), &out)) {
+    return false;
+  }
+  output->resize(out.Size());
+  return true;
+}
+
+// Marks the samples that no other sample beats on both size and encode time.
+void MarkPareto(std::vector<Sample>* samples) {
+  for (Sample& a : *samples) {
+    a.pareto = true;
+    for (const Sample& b : *samples) {
+      if (b.size <= a.size && b.encode_ms <= a.encode_ms &&
+          (b.size < a.size || b.encode_ms < a.encode_ms)) {
+        a.pareto = false;
+        break;
+      }
+    }
+  }
+}
+
+bool Measure(const std::string& path, const std::vector<Config>& configs,
+             int runs, FontReport* report) {
+  std::string input = woff2::GetFileContent(path);
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(input.data());
+  report->path = path;
+  report->font_class = FontClass(input);
+  report->font_count = 1;
+
+  // The front end, with the fastest Brotli setting standing in for the real
+  // compression; its cost is subtracted below.
+  woff2::WOFF2Params params;
+  params.brotli_quality = 0;
+  std::string woff2_data(
+      woff2::MaxWOFF2CompressedSize(data, input.size()), 0);
+  size_t woff2_length = 0;
+  double convert_ms = MedianMs(runs, [&]() {
+    woff2_length = woff2_data.size();
+    return woff2::ConvertTTFToWOFF2(data, input.size(),
+        reinterpret_cast<uint8_t*>(&woff2_data[0]), &woff2_length, params);
+  });
+  if (convert_ms < 0) {
+    fprintf(stderr, "%s: encode failed\n", path.c_str());
+    return false;
+  }
+  woff2_data.resize(woff2_length);
+
+  size_t data_offset, stream_length;
+  if (!ParseLayout(woff2_data, &data_offset, &stream_length) ||
+      data_offset > woff2_data.size()) {
+    fprintf(stderr, "%s: cannot parse the encoded font\n", path.c_str());
+    return false;
+  }
+  std::string stream(stream_length, 0);
+  size_t decoded_length = stream_length;
+  if (BrotliDecoderDecompress(woff2_data.size() - data_offset,
+          reinterpret_cast<const uint8_t*>(woff2_data.data()) + data_offset,
+          &decoded_length, reinterpret_cast<uint8_t*>(&stream[0])) !=
+      BROTLI_DECODER_RESULT_SUCCESS || decoded_length != stream_length) {
+    fprintf(stderr, "%s: cannot decompress the table data\n", path.c_str());
+    return false;
+  }
+  std::string compressed;
+  double fast_ms = MedianMs(runs, [&]() {
+    return BrotliCompress(stream, 0, BROTLI_DEFAULT_WINDOW, &compressed);
+  });
+  report->front_end_ms = std::max(0.0, convert_ms - fast_ms);
+
+  std::string expected;
+  if (!Decode(woff2_data, &expected)) {
+    fprintf(stderr, "%s: decode failed\n", path.c_str());
+    return false;
+  }
+
+  for (const Config& config : configs) {
+    Sample sample;
+    sample.config = config;
+    double brotli_ms = MedianMs(runs, [&]() {
+      return BrotliCompress(stream, config.quality, config.lgwin,
+                            &compressed);
+    });
+    if (brotli_ms < 0) {
+      fprintf(stderr, "%s: Brotli failed at quality %d window %d\n",
+              path.c_str(), config.quality, config.lgwin);
+      return false;
+    }
+    std::string file = Splice(woff2_data, data_offset, compressed);
+    std::string decoded;
+    sample.decode_ms = MedianMs(runs, [&]() {
+      return Decode(file, &decoded);
+    });
+    if (sample.decode_ms < 0 || decoded != expected) {
+      fprintf(stderr, "%s: round trip failed at quality %d window %d\n",
+              path.c_str(), config.quality, config.lgwin);
+      return false;
+    }
+    sample.size = file.size();
+    sample.encode_ms = report->front_end_ms + brotli_ms;
+    report->samples.push_back(sample);
+  }
+  MarkPareto(&report->samples);
+  return true;
+}
+
+// Sums the samples of every font in each class, config by config.
+std::map<std::string, FontReport> AggregateByClass(
+    const std::vector<FontReport>& reports) {
+  std::map<std::string, FontReport> classes;
+  for (const FontReport& report : reports) {
+    auto it = classes.find(report.font_class);
+    if (it == classes.end()) {
+      FontReport& total = classes[report.font_class];
+      total = report;
+      total.path.clear();
+      continue;
+    }
+    FontReport& total = it->second;
+    total.font_count += report.font_count;
+    total.front_end_ms += report.front_end_ms;
+    for (size_t i = 0; i < report.samples.size(); ++i) {
+      total.samples[i].size += report.samples[i].size;
+      total.samples[i].encode_ms += report.samples[i].encode_ms;
+      total.samples[i].decode_ms += report.samples[i].decode_ms;
+    }
+  }
+  for (auto& entry : classes) {
+    MarkPareto(&entry.second.samples);
+  }
+  return classes;
+}
+
+std::string Quote(const std::string& text, bool json) {
+  std::string result = "\"";
+  for (char c : text) {
+    if (c == '"') {
+      result += json ? "\\\"" : "\"\"";
+    } else if (json && c == '\\') {
+      result += "\\\\";
+    } else {
+      result += c;
+    }
+  }
+  return result + "\"";
+}
+
+void PrintCsv(const FontReport& report) {
+  const char* scope = report.path.empty() ? "class" : "font";
+  for (const Sample& sample : report.samples) {
+    fprintf(stdout, "%s,%s,%s,%d,%d,%d,%zu,%.3f,%.3f,%.3f,%d\n", scope,
+            Quote(report.path, false).c_str(), report.font_class.c_str(),
+            report.font_count, sample.config.quality, sample.config.lgwin, sample.size,
+            report.front_end_ms, sample.encode_ms, sample.decode_ms,
+            sample.pareto);
+  }
+}
+
+void PrintJson(const FontReport& report, bool last) {
+  if (report.path.empty()) {
+    fprintf(stdout, "    {\"class\": \"%s\", \"fonts\": %d, ",
+            report.font_class.c_str(), report.font_count);
+  } else {
+    fprintf(stdout, "    {\"font\": %s, \"class\": \"%s\", ",
+            Quote(report.path, true).c_str(), report.font_class.c_str());
+  }
+  fprintf(stdout, "\"front_end_ms\": %.3f, \"results\": [\n",
+          report.front_end_ms);
+  for (size_t i = 0; i < report.samples.size(); ++i) {
+    const Sample& sample = report.samples[i];
+    fprintf(stdout, "      {\"quality\": %d, \"window\": %d, \"size\": %zu, "
+            "\"encode_ms\": %.3f, \"decode_ms\": %.3f, \"pareto\": %s}%s\n",
+            sample.config.quality, sample.config.lgwin, sample.size,
+            sample.encode_ms, sample.decode_ms,
+            sample.pareto ? "true" : "false",
+            i + 1 < report.samples.size() ? "," : "");
+  }
+  fprintf(stdout, "    ]}%s\n", last ? "" : ",");
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  bool json = false;
+  int runs = 3;
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-'; ++arg) {
+    if (strcmp(argv[arg], "-f") == 0 && arg + 1 < argc) {
+      ++arg;
+      if (strcmp(argv[arg], "json") == 0) {
+        json = true;
+      } else if (strcmp(argv[arg], "csv") != 0) {
+        Usage();
+        return 1;
+      }
+    } else if (strcmp(argv[arg], "-n") == 0 && arg + 1 < argc) {
+      runs = std::max(1, atoi(argv[++arg]));
+    } else {
+      Usage();
+      return 1;
+    }
+  }
+  if (arg == argc) {
+    Usage();
+    return 1;
+  }
+
+  std::vector<Config> configs;
+  for (int quality = BROTLI_MIN_QUALITY; quality <= BROTLI_MAX_QUALITY;
+       ++quality) {
+    for (int lgwin : kWindows) {
+      configs.push_back({quality, lgwin});
+    }
+  }
+
+  std::vector<FontReport> reports;
+  int failures = 0;
+  for (; arg < argc; ++arg) {
+    fprintf(stderr, "%s\n", argv[arg]);
+    FontReport report;
+    if (!Measure(argv[arg], configs, runs, &report)) {
+      ++failures;
+      continue;
+    }
+    reports.push_back(report);
+  }
+  std::map<std::string, FontReport> classes = AggregateByClass(reports);
+
+  if (json) {
+    fprintf(stdout, "{\n  \"fonts\": [\n");
+    for (size_t i = 0; i < reports.size(); ++i) {
+      PrintJson(reports[i], i + 1 == reports.size());
+    }
+    fprintf(stdout, "  ],\n  \"classes\": [\n");
+    size_t i = 0;
+    for (const auto& entry : classes) {
+      PrintJson(entry.second, ++i == classes.size());
+    }
+    fprintf(stdout, "  ]\n}\n");
+  } else {
+    fprintf(stdout, "scope,font,class,fonts,quality,window,size,front_end_ms,"
+            "encode_ms,decode_ms,pareto\n");
+    for (const FontReport& report : reports) {
+      PrintCsv(report);
+    }
+    for (const auto& entry : classes) {
+      PrintCsv(entry.second);
+    }
+  }
+  return failures == 0 ? 0 : 1;
+}